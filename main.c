@@ -18,6 +18,32 @@
  *     - Search, edit (by position), delete, and summary views
  *     - Save/load fleet from text file (bus_data.txt)
  *     - Export maintenance report to a CSV file
+ *     - Paginated fleet table rendered a page at a time (single write)
+ *     - Full-screen live dashboard that redraws only changed cells
+ *     - Streaming report mode (--report) with bounded memory
+ *     - Background autosave to a recovery file (--autosave N)
+ *     - Indexed fixed-size record file for single-bus lookups/updates
+ *     - On-disk B+tree store keyed by bus number with an LRU page cache,
+ *       with its own menu (--btree) for fleets larger than memory
+ *     - Optional sharded data files loaded/saved in parallel (--shards K)
+ *     - CRC32C-checksummed block snapshots with parallel fsck
+ *     - Line-oriented loader that quarantines malformed lines
+ *     - Columnar Arrow IPC / Feather export for analytics tools
+ *     - JSON Lines export with vectorized string escaping
+ *     - Change sequence numbers with a change log and delta export
+ *     - Streaming migration of NIMBUS fleet_data.csv files
+ *     - One loader for every fleet file format, detected from its contents
+ *     - Multi-level undo / redo of menu edits
+ *     - Compact audit log of every field edit, indexed per bus and per field
+ *     - Bulk edit: "set field=value where field op value" in one pass
+ *     - Bulk delete by bus list or filter, compacting the fleet once
+ *     - Workshop calendar: service intervals counted in working days
+ *     - Due calendar: daily due counts for the next year in one fleet pass
+ *     - Overdue aging (days / km overdue) per depot
+ *     - Downtime log and availability per bus, depot and month
+ *     - Month-by-month maintenance cost projection per depot
+ *     - One fleet shared by several terminals in shared memory (--shared)
+ *     - Warm standby that follows the primary's change journal and takes over
  *
  *  Developed By: Shayan Shome
  *********************************************************************/
@@ -26,6 +52,34 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <pthread.h>
+#endif
 
 /* ---------- ANSI colors ---------- */
 
@@ -41,6 +95,20 @@
 #define DUE_SOON_KM   500
 #define DATA_FILE     "bus_data.txt"
 #define REPORT_FILE   "fleet_report.csv"
+#define AUTOSAVE_FILE "bus_data.autosave.txt"
+#define AUTOSAVE_SECS 30
+#define INDEX_FILE    "bus_data.fgx"
+#define BTREE_FILE    "bus_data.fgt"
+#define SHARD_MANIFEST "bus_data.manifest"
+#define SNAPSHOT_FILE "bus_data.fgs"
+#define ARROW_FILE    "fleet_report.arrow"
+#define JSON_FILE     "fleet_report.ndjson"
+#define CHANGE_LOG    "bus_data.changes"
+#define DELTA_FILE    "fleet_delta.ndjson"
+#define AUDIT_LOG     "bus_audit.log"
+#define AUDIT_INDEX   "bus_audit.idx"
+#define WORKSHOP_FILE "workshop_calendar.txt"
+#define MAX_SHARDS    256
 
 /* ---------- Status & Data Structures ---------- */
 
@@ -74,8 +142,14 @@ typedef struct {
     int   health_score;
     float avg_daily_km;
     float fuel_efficiency;
+
+    int   change_seq;        /* sequence number of the last change, 0 = none */
 } Bus;
 
+/* Set while the fleet array is the --shared segment, which has a fixed
+   capacity and must never be realloc'd. */
+static int fleet_capacity_fixed;
+
 /* ---------- Banner / UI helpers ---------- */
 
 void print_banner(void) {
@@ -219,6 +293,401 @@ void read_driver_name(char *dest, int size) {
     }
 }
 
+/* ---------- Output buffer & terminal helpers ---------- */
+
+/* Growable text buffer: screens and exports are formatted here first
+   and handed to the OS in one go instead of line by line. */
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+} TextBuf;
+
+int tb_reserve(TextBuf *tb, size_t extra) {
+    if (tb->len + extra + 1 <= tb->cap) return 1;
+    size_t new_cap = (tb->cap == 0) ? 4096 : tb->cap;
+    while (new_cap < tb->len + extra + 1) new_cap *= 2;
+    char *tmp = realloc(tb->data, new_cap);
+    if (!tmp) return 0;
+    tb->data = tmp;
+    tb->cap = new_cap;
+    return 1;
+}
+
+void tb_append(TextBuf *tb, const char *s, size_t n) {
+    if (!tb_reserve(tb, n)) return;
+    memcpy(tb->data + tb->len, s, n);
+    tb->len += n;
+    tb->data[tb->len] = '\0';
+}
+
+void tb_puts(TextBuf *tb, const char *s) {
+    tb_append(tb, s, strlen(s));
+}
+
+void tb_free(TextBuf *tb) {
+    free(tb->data);
+    tb->data = NULL;
+    tb->len = tb->cap = 0;
+}
+
+/* Hand-rolled formatters for hot output paths (data file, JSON rows);
+   they write at p and return the new end, so callers reserve first. */
+char *put_text(char *p, const char *s) {
+    size_t n = strlen(s);
+    memcpy(p, s, n);
+    return p + n;
+}
+
+char *put_int(char *p, long long v) {
+    char tmp[24];
+    int n = 0;
+    unsigned long long u = (v < 0) ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    if (v < 0) *p++ = '-';
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    while (n) *p++ = tmp[--n];
+    return p;
+}
+
+/* Same text as "%.2f" (at most 32 bytes). A float times 100 is exact in
+   a double, so rounding that to an integer, ties to even, is exactly
+   printf's rounding. */
+char *put_fixed2(char *p, float v) {
+    double d = v;
+    if (!(d > -1e15 && d < 1e15)) {
+        if (isfinite(d)) return p + snprintf(p, 32, "%.6e", d);
+        return p + snprintf(p, 32, "%f", d);
+    }
+    if (signbit(d)) {
+        *p++ = '-';
+        d = -d;
+    }
+    double scaled = d * 100.0;
+    long long c = (long long)scaled;
+    double frac = scaled - (double)c;
+    if (frac > 0.5 || (frac == 0.5 && (c & 1))) c++;
+    p = put_int(p, c / 100);
+    *p++ = '.';
+    *p++ = (char)('0' + (c / 10) % 10);
+    *p++ = (char)('0' + c % 10);
+    return p;
+}
+
+/* Size of the visible terminal window (24x80 if unknown). */
+void terminal_size(int *rows, int *cols) {
+    *rows = 0;
+    *cols = 0;
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        *rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+        *cols = info.srWindow.Right - info.srWindow.Left + 1;
+    }
+#else
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0) {
+        *rows = ws.ws_row;
+        *cols = ws.ws_col;
+    }
+#endif
+    const char *env;
+    if (*rows <= 0) {
+        env = getenv("LINES");
+        *rows = (env && atoi(env) > 0) ? atoi(env) : 24;
+    }
+    if (*cols <= 0) {
+        env = getenv("COLUMNS");
+        *cols = (env && atoi(env) > 0) ? atoi(env) : 80;
+    }
+}
+
+int terminal_rows(void) {
+    int rows, cols;
+    terminal_size(&rows, &cols);
+    return rows;
+}
+
+/* Emit a whole block to stdout with as few system calls as possible. */
+void write_block(const char *buf, size_t len) {
+    fflush(stdout);
+#ifdef _WIN32
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+#else
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf += n;
+        len -= (size_t)n;
+    }
+#endif
+}
+
+/* ---------- Threads (portable) ---------- */
+
+/* Thin wrapper so the same code builds with MinGW (Win32 threads) and on
+   POSIX systems (pthreads) without extra libraries on the gcc line. */
+#ifdef _WIN32
+typedef HANDLE             fg_thread;
+typedef CRITICAL_SECTION   fg_mutex;
+typedef CONDITION_VARIABLE fg_cond;
+#else
+typedef pthread_t          fg_thread;
+typedef pthread_mutex_t    fg_mutex;
+typedef pthread_cond_t     fg_cond;
+#endif
+
+typedef void *(*fg_thread_fn)(void *);
+
+#ifdef _WIN32
+typedef struct {
+    fg_thread_fn fn;
+    void        *arg;
+} ThreadStart;
+
+static DWORD WINAPI fg_thread_trampoline(LPVOID p) {
+    ThreadStart ts = *(ThreadStart *)p;
+    free(p);
+    ts.fn(ts.arg);
+    return 0;
+}
+#endif
+
+int fg_thread_start(fg_thread *t, fg_thread_fn fn, void *arg) {
+#ifdef _WIN32
+    ThreadStart *ts = malloc(sizeof *ts);
+    if (!ts) return 0;
+    ts->fn = fn;
+    ts->arg = arg;
+    *t = CreateThread(NULL, 0, fg_thread_trampoline, ts, 0, NULL);
+    if (*t == NULL) {
+        free(ts);
+        return 0;
+    }
+    return 1;
+#else
+    return pthread_create(t, NULL, fn, arg) == 0;
+#endif
+}
+
+void fg_thread_join(fg_thread t) {
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+void fg_mutex_init(fg_mutex *m) {
+#ifdef _WIN32
+    InitializeCriticalSection(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+void fg_mutex_lock(fg_mutex *m) {
+#ifdef _WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+/* Nonzero if it took the lock without waiting. */
+int fg_mutex_trylock(fg_mutex *m) {
+#ifdef _WIN32
+    return TryEnterCriticalSection(m) != 0;
+#else
+    return pthread_mutex_trylock(m) == 0;
+#endif
+}
+
+void fg_mutex_unlock(fg_mutex *m) {
+#ifdef _WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+void fg_mutex_destroy(fg_mutex *m) {
+#ifdef _WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+void fg_cond_init(fg_cond *c) {
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
+
+void fg_cond_wait(fg_cond *c, fg_mutex *m) {
+#ifdef _WIN32
+    SleepConditionVariableCS(c, m, INFINITE);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+/* Waits at most ms milliseconds (spurious and timed-out wakeups return
+   normally; callers re-check their condition). */
+void fg_cond_timedwait(fg_cond *c, fg_mutex *m, int ms) {
+#ifdef _WIN32
+    SleepConditionVariableCS(c, m, (DWORD)ms);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(c, m, &ts);
+#endif
+}
+
+void fg_cond_broadcast(fg_cond *c) {
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+void fg_cond_destroy(fg_cond *c) {
+#ifdef _WIN32
+    (void)c;
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+int cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int)n : 1;
+#endif
+}
+
+/* Runs fn(ctx, task) for task = 0 .. ntasks-1 on up to nthreads
+   threads (the caller's thread included). */
+typedef struct {
+    void    (*fn)(void *ctx, int task);
+    void     *ctx;
+    int       ntasks;
+    int       next;
+    fg_mutex  lock;
+} TaskPool;
+
+static void *task_pool_worker(void *arg) {
+    TaskPool *p = arg;
+    while (1) {
+        fg_mutex_lock(&p->lock);
+        int task = p->next++;
+        fg_mutex_unlock(&p->lock);
+        if (task >= p->ntasks) break;
+        p->fn(p->ctx, task);
+    }
+    return NULL;
+}
+
+void run_parallel(int ntasks, void (*fn)(void *ctx, int task), void *ctx,
+                  int nthreads) {
+    TaskPool p;
+    fg_thread threads[64];
+    int started = 0;
+
+    p.fn = fn;
+    p.ctx = ctx;
+    p.ntasks = ntasks;
+    p.next = 0;
+    fg_mutex_init(&p.lock);
+    if (nthreads > ntasks) nthreads = ntasks;
+    if (nthreads > 64) nthreads = 64;
+    for (int i = 1; i < nthreads; i++) {
+        if (fg_thread_start(&threads[started], task_pool_worker, &p)) started++;
+    }
+    task_pool_worker(&p);
+    for (int i = 0; i < started; i++) fg_thread_join(threads[i]);
+    fg_mutex_destroy(&p.lock);
+}
+
+/* Monotonic wall-clock seconds, for timings and benchmarks. */
+double now_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, t;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&t);
+    return (double)t.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+/* Bounded FIFO of pointers shared between pipeline stages. */
+typedef struct {
+    void    **items;
+    int       cap;
+    int       head;
+    int       len;
+    fg_mutex  lock;
+    fg_cond   changed;
+} WorkQueue;
+
+int wq_init(WorkQueue *q, int cap) {
+    q->items = calloc((size_t)cap, sizeof(void *));
+    if (!q->items) return 0;
+    q->cap = cap;
+    q->head = q->len = 0;
+    fg_mutex_init(&q->lock);
+    fg_cond_init(&q->changed);
+    return 1;
+}
+
+void wq_push(WorkQueue *q, void *item) {
+    fg_mutex_lock(&q->lock);
+    while (q->len == q->cap) fg_cond_wait(&q->changed, &q->lock);
+    q->items[(q->head + q->len) % q->cap] = item;
+    q->len++;
+    fg_cond_broadcast(&q->changed);
+    fg_mutex_unlock(&q->lock);
+}
+
+void *wq_pop(WorkQueue *q) {
+    fg_mutex_lock(&q->lock);
+    while (q->len == 0) fg_cond_wait(&q->changed, &q->lock);
+    void *item = q->items[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->len--;
+    fg_cond_broadcast(&q->changed);
+    fg_mutex_unlock(&q->lock);
+    return item;
+}
+
+void wq_destroy(WorkQueue *q) {
+    fg_cond_destroy(&q->changed);
+    fg_mutex_destroy(&q->lock);
+    free(q->items);
+}
+
 /* ---------- Date helpers (simplified) ---------- */
 
 int is_valid_date(Date d) {
@@ -268,6 +737,284 @@ void print_date(Date d) {
     printf("%02d-%02d-%04d", d.day, d.month, d.year);
 }
 
+/* Parses "dd/mm/yyyy" from a command-line argument. */
+int parse_date_arg(const char *s, Date *out) {
+    Date d;
+    if (sscanf(s, "%d/%d/%d", &d.day, &d.month, &d.year) == 3 &&
+        is_valid_date(d)) {
+        *out = d;
+        return 1;
+    }
+    return 0;
+}
+
+Date today_from_clock(void) {
+    Date d = {1, 1, 1970};
+    time_t now = time(NULL);
+    struct tm *lt = localtime(&now);
+    if (lt) {
+        d.day = lt->tm_mday;
+        d.month = lt->tm_mon + 1;
+        d.year = lt->tm_year + 1900;
+    }
+    return d;
+}
+
+int is_leap_year(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int days_in_month(int month, int year) {
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12) return 0;
+    return (month == 2 && is_leap_year(year)) ? 29 : days[month - 1];
+}
+
+/* Like is_valid_date, but also checks month lengths and leap years. */
+int is_calendar_date(Date d) {
+    return is_valid_date(d) && d.day <= days_in_month(d.month, d.year);
+}
+
+/* Days since 01-01-1970 on the real (proleptic Gregorian) calendar, for
+   exports read by other tools; maintenance math keeps date_to_days. */
+int date_to_civil_days(Date d) {
+    int y = d.year - (d.month <= 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (d.month + (d.month > 2 ? -3 : 9)) + 2) / 5 + d.day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Writes "dd-mm-yyyy" (10 chars + NUL) without going through printf. */
+void format_date_fixed(char *out, Date d) {
+    int y = d.year % 10000;
+    out[0] = (char)('0' + (d.day / 10) % 10);
+    out[1] = (char)('0' + d.day % 10);
+    out[2] = '-';
+    out[3] = (char)('0' + (d.month / 10) % 10);
+    out[4] = (char)('0' + d.month % 10);
+    out[5] = '-';
+    out[6] = (char)('0' + y / 1000);
+    out[7] = (char)('0' + (y / 100) % 10);
+    out[8] = (char)('0' + (y / 10) % 10);
+    out[9] = (char)('0' + y % 10);
+    out[10] = '\0';
+}
+
+/* ---------- Bitmaps ---------- */
+
+/* Flat bit sets, 64 positions per word. */
+#define BITMAP_WORDS(n) (((size_t)(n) + 63) / 64)
+
+void bitmap_set(uint64_t *bits, int i) {
+    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+int bitmap_test(const uint64_t *bits, int i) {
+    return (int)((bits[i >> 6] >> (i & 63)) & 1);
+}
+
+int bit_count64(uint64_t x) {
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+/* ---------- Workshop calendar ---------- */
+
+/* Days the workshop is open, loaded from WORKSHOP_FILE:
+
+       closed sunday              weekly closing day (repeatable)
+       holiday 26/01/2025 ...     closed on that date (rest of line ignored)
+       open 02/02/2025            open on that date despite the rules
+
+   The calendar is a bitmap over real calendar days from CAL_FIRST_YEAR
+   to CAL_LAST_YEAR, one bit per day (1 = open). rank[] holds the number
+   of open days before each 64-day word, so counting open days between
+   two dates is two table lookups and two popcounts. sel[] holds the word
+   containing every 64th open day, so finding the Nth open day jumps
+   straight to its word. Days outside the span count as open. Without a
+   calendar file the maintenance math keeps its plain day counts. */
+#define CAL_FIRST_YEAR 1970
+#define CAL_LAST_YEAR  2199
+
+typedef struct {
+    int       loaded;
+    int       first_day;     /* civil day number of bit 0 */
+    int       ndays;
+    uint64_t *bits;
+    int      *rank;          /* open days before word w; rank[nwords] = total */
+    int      *sel;           /* word holding open day k * 64 */
+    int       nwords;
+    int       nopen;
+} WorkshopCalendar;
+
+static WorkshopCalendar workshop;
+
+/* Inverse of date_to_civil_days. */
+Date date_from_civil_days(int z) {
+    Date d;
+    z += 719468;
+    int era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = z - era * 146097;
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    d.day = doy - (153 * mp + 2) / 5 + 1;
+    d.month = mp < 10 ? mp + 3 : mp - 9;
+    d.year = yoe + era * 400 + (d.month <= 2);
+    return d;
+}
+
+/* Open days in [first_day, day). */
+static int workshop_rank(int day) {
+    int i = day - workshop.first_day;
+    if (i <= 0) return i;
+    if (i >= workshop.ndays) return workshop.nopen + (i - workshop.ndays);
+    uint64_t below = workshop.bits[i >> 6] & (((uint64_t)1 << (i & 63)) - 1);
+    return workshop.rank[i >> 6] + bit_count64(below);
+}
+
+/* Position of the r-th (0-based) set bit of w. */
+static int select_in_word(uint64_t w, int r) {
+    for (int b = 0; b < 64; b += 8) {
+        int c = bit_count64((w >> b) & 0xFF);
+        if (r < c) {
+            for (int i = b;; i++) {
+                if ((w >> i) & 1) {
+                    if (r-- == 0) return i;
+                }
+            }
+        }
+        r -= c;
+    }
+    return 63;
+}
+
+/* Civil day of the k-th (0-based) open day; inverse of workshop_rank. */
+static int workshop_select(int k) {
+    if (k < 0) return workshop.first_day + k;
+    if (k >= workshop.nopen) return workshop.first_day + workshop.ndays + (k - workshop.nopen);
+    int w = workshop.sel[k >> 6];
+    while (workshop.rank[w + 1] <= k) w++;
+    return workshop.first_day + w * 64 + select_in_word(workshop.bits[w], k - workshop.rank[w]);
+}
+
+/* Open days d with from < d <= to. */
+int working_days_between(Date from, Date to) {
+    return workshop_rank(date_to_civil_days(to) + 1) -
+           workshop_rank(date_to_civil_days(from) + 1);
+}
+
+/* The n-th open day after d (n >= 1). */
+Date add_working_days(Date d, int n) {
+    return date_from_civil_days(workshop_select(workshop_rank(date_to_civil_days(d) + 1) + n - 1));
+}
+
+static void workshop_index(void) {
+    int sel = 0;
+    workshop.rank[0] = 0;
+    for (int w = 0; w < workshop.nwords; w++) {
+        int before = workshop.rank[w];
+        workshop.rank[w + 1] = before + bit_count64(workshop.bits[w]);
+        /* every multiple of 64 in [before, rank[w+1]) lives in word w */
+        while (sel * 64 < workshop.rank[w + 1]) workshop.sel[sel++] = w;
+    }
+    workshop.nopen = workshop.rank[workshop.nwords];
+}
+
+/* Loads the calendar; returns 1 if one was loaded. A missing file leaves
+   every day open. */
+int workshop_load(const char *filename) {
+    static const char *weekdays[7] = {"sunday", "monday", "tuesday", "wednesday",
+                                      "thursday", "friday", "saturday"};
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return 0;
+
+    Date first = {1, 1, CAL_FIRST_YEAR}, last = {31, 12, CAL_LAST_YEAR};
+    WorkshopCalendar *c = &workshop;
+    free(c->bits);
+    free(c->rank);
+    free(c->sel);
+    memset(c, 0, sizeof *c);
+    c->first_day = date_to_civil_days(first);
+    c->ndays = date_to_civil_days(last) - c->first_day + 1;
+    c->nwords = (int)BITMAP_WORDS(c->ndays);
+    c->bits = calloc((size_t)c->nwords, sizeof *c->bits);
+    c->rank = malloc(((size_t)c->nwords + 1) * sizeof *c->rank);
+    c->sel = malloc(((size_t)c->ndays / 64 + 1) * sizeof *c->sel);
+    if (!c->bits || !c->rank || !c->sel) {
+        fclose(fp);
+        printf(COLOR_RED "Memory error loading %s.\n" COLOR_RESET, filename);
+        return 0;
+    }
+
+    int closed_weekday[7] = {0};
+    int *overrides = NULL, noverrides = 0, cap = 0;   /* +day open, -day-1 closed */
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof line, fp)) {
+        char word[32] = "", arg[64] = "";
+        line_no++;
+        if (sscanf(line, "%31s %63s", word, arg) < 1 || word[0] == '#') continue;
+        for (char *q = word; *q; q++) *q = (char)tolower((unsigned char)*q);
+        for (char *q = arg; *q; q++) *q = (char)tolower((unsigned char)*q);
+
+        int ok = 0;
+        Date d;
+        if (strcmp(word, "closed") == 0) {
+            for (int k = 0; k < 7; k++) {
+                if (strcmp(arg, weekdays[k]) == 0) closed_weekday[k] = ok = 1;
+            }
+        } else if ((strcmp(word, "holiday") == 0 || strcmp(word, "open") == 0) &&
+                   parse_date_arg(arg, &d) && is_calendar_date(d)) {
+            int day = date_to_civil_days(d) - c->first_day;
+            ok = 1;
+            if (day >= 0 && day < c->ndays) {
+                if (noverrides >= cap) {
+                    int new_cap = (cap == 0) ? 64 : cap * 2;
+                    int *tmp = realloc(overrides, (size_t)new_cap * sizeof *tmp);
+                    if (!tmp) break;
+                    overrides = tmp;
+                    cap = new_cap;
+                }
+                overrides[noverrides++] = (word[0] == 'o') ? day : -day - 1;
+            }
+        }
+        if (!ok) {
+            printf(COLOR_YELLOW "%s:%d: ignoring '%.*s'\n" COLOR_RESET, filename,
+                   line_no, (int)strcspn(line, "\r\n"), line);
+        }
+    }
+    fclose(fp);
+
+    /* weekly rule a word at a time: the pattern repeats every 7 words */
+    uint64_t week_words[7];
+    int weekday0 = ((c->first_day % 7) + 7 + 4) % 7;   /* 01-01-1970 was a Thursday */
+    for (int w = 0; w < 7; w++) {
+        uint64_t m = 0;
+        for (int b = 0; b < 64; b++) {
+            if (!closed_weekday[(weekday0 + w * 64 + b) % 7]) m |= (uint64_t)1 << b;
+        }
+        week_words[w] = m;
+    }
+    for (int w = 0; w < c->nwords; w++) c->bits[w] = week_words[w % 7];
+    if (c->ndays & 63) c->bits[c->nwords - 1] &= ((uint64_t)1 << (c->ndays & 63)) - 1;
+
+    for (int k = 0; k < noverrides; k++) {
+        int day = overrides[k] >= 0 ? overrides[k] : -overrides[k] - 1;
+        if (overrides[k] >= 0) bitmap_set(c->bits, day);
+        else c->bits[day >> 6] &= ~((uint64_t)1 << (day & 63));
+    }
+    free(overrides);
+
+    workshop_index();
+    c->loaded = 1;
+    return 1;
+}
+
 /* ---------- Maintenance logic ---------- */
 
 void update_maintenance_status(Bus *b, Date today) {
@@ -278,7 +1025,13 @@ void update_maintenance_status(Bus *b, Date today) {
     int mileage_due_soon = (!mileage_overdue && b->km_left <= DUE_SOON_KM);
 
     int date_overdue = 0;
-    if (b->service_interval_days > 0 &&
+    if (b->service_interval_days > 0 && workshop.loaded &&
+        is_calendar_date(b->last_service) && is_calendar_date(today)) {
+        /* interval counted in workshop working days */
+        date_overdue = working_days_between(b->last_service, today) >=
+                       b->service_interval_days;
+        b->next_due = add_working_days(b->last_service, b->service_interval_days);
+    } else if (b->service_interval_days > 0 &&
         is_valid_date(b->last_service) &&
         is_valid_date(today)) {
         int days_since = date_to_days(today) - date_to_days(b->last_service);
@@ -361,186 +1114,731 @@ int bus_no_exists(Bus *fleet, int count, int bus_no, int exclude_index) {
 
 /* ---------- File I/O: save / load ---------- */
 
-void save_fleet_to_file(Bus *fleet, int count, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) {
-        printf(COLOR_RED "Error opening file for writing.\n" COLOR_RESET);
-        return;
+#define BUS_RECORD_MAX 512
+
+/* Formats one bus_data.txt line (with its newline) into `out`, which must
+   hold BUS_RECORD_MAX bytes; returns its length. Same text as
+   "%s|%s|%d|...|%.2f|..." without going through printf. */
+size_t format_bus_record(char *out, const Bus *b) {
+    const int ints[] = {
+        b->last_service.day, b->last_service.month, b->last_service.year,
+        b->next_due.day, b->next_due.month, b->next_due.year
+    };
+    char *p = put_text(out, b->bus_code);
+    *p++ = '|';
+    p = put_text(p, b->driver_name);
+    *p++ = '|';
+    p = put_int(p, b->bus_no);
+    for (int i = 0; i < 6; i++) {
+        *p++ = '|';
+        p = put_int(p, ints[i]);
     }
+    *p++ = '|';
+    p = put_fixed2(p, b->current_mileage);
+    *p++ = '|';
+    p = put_fixed2(p, b->last_service_mileage);
+    *p++ = '|';
+    p = put_fixed2(p, b->service_interval_km);
+    *p++ = '|';
+    p = put_int(p, b->service_interval_days);
+    *p++ = '|';
+    p = put_int(p, b->service_history_count);
+    *p++ = '|';
+    p = put_int(p, b->status);
+    *p++ = '|';
+    p = put_fixed2(p, b->km_left);
+    *p++ = '|';
+    p = put_int(p, b->health_score);
+    *p++ = '|';
+    p = put_fixed2(p, b->avg_daily_km);
+    *p++ = '|';
+    p = put_fixed2(p, b->fuel_efficiency);
+    *p++ = '|';
+    p = put_int(p, b->change_seq);
+    *p++ = '\n';
+    return (size_t)(p - out);
+}
 
-    fprintf(fp, "%d\n", count);
-    for (int i = 0; i < count; i++) {
-        Bus *b = &fleet[i];
-        fprintf(fp,
-                "%s|%s|%d|"
-                "%d|%d|%d|"
-                "%d|%d|%d|"
-                "%.2f|%.2f|%.2f|"
-                "%d|%d|%d|"
-                "%.2f|%d|%.2f|%.2f\n",
-                b->bus_code,
-                b->driver_name,
-                b->bus_no,
-                b->last_service.day,
-                b->last_service.month,
-                b->last_service.year,
-                b->next_due.day,
-                b->next_due.month,
-                b->next_due.year,
-                b->current_mileage,
-                b->last_service_mileage,
-                b->service_interval_km,
-                b->service_interval_days,
-                b->service_history_count,
-                b->status,
-                b->km_left,
-                b->health_score,
-                b->avg_daily_km,
-                b->fuel_efficiency);
-    }
+void write_bus_record(FILE *fp, Bus *b) {
+    char line[BUS_RECORD_MAX];
+    fwrite(line, 1, format_bus_record(line, b), fp);
+}
 
-    fclose(fp);
-    printf(COLOR_GREEN "Fleet saved to %s\n" COLOR_RESET, filename);
+/* Flushes stdio and OS buffers so a following rename cannot expose a
+   partially written file after a crash. Returns 0 on success. */
+int flush_to_disk(FILE *fp) {
+    if (fflush(fp) != 0) return -1;
+#ifdef _WIN32
+    return FlushFileBuffers((HANDLE)_get_osfhandle(_fileno(fp))) ? 0 : -1;
+#else
+    return fsync(fileno(fp));
+#endif
 }
 
-void load_fleet_from_file(Bus **fleet_ptr, int *count, int *capacity,
-                          const char *filename) {
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        *count = 0;
-        return;
-    }
+/* Blocks until this process holds an exclusive lock on the whole file,
+   so several processes can append to one log in turn. Returns 0 on
+   success. The lock goes away with file_unlock or when fp is closed. */
+int file_lock(FILE *fp) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof ov);
+    return LockFileEx((HANDLE)_get_osfhandle(_fileno(fp)), LOCKFILE_EXCLUSIVE_LOCK,
+                      0, MAXDWORD, MAXDWORD, &ov) ? 0 : -1;
+#else
+    struct flock fl;
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    int rc;
+    while ((rc = fcntl(fileno(fp), F_SETLKW, &fl)) != 0 && errno == EINTR) {}
+    return rc;
+#endif
+}
 
-    int n;
-    if (fscanf(fp, "%d\n", &n) != 1 || n <= 0) {
-        printf(COLOR_YELLOW "Data file empty or invalid.\n" COLOR_RESET);
+void file_unlock(FILE *fp) {
+    fflush(fp);
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof ov);
+    UnlockFileEx((HANDLE)_get_osfhandle(_fileno(fp)), 0, MAXDWORD, MAXDWORD, &ov);
+#else
+    struct flock fl;
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(fileno(fp), F_SETLK, &fl);
+#endif
+}
+
+/* Opens filename for reading and writing, creating it empty if needed
+   (unlike "w+b", never truncating what another process wrote). */
+FILE *open_for_append_update(const char *filename) {
+    FILE *fp = fopen(filename, "r+b");
+    if (!fp && (fp = fopen(filename, "ab")) != NULL) {
         fclose(fp);
-        *count = 0;
-        return;
+        fp = fopen(filename, "r+b");
     }
+    return fp;
+}
 
-    if (n > *capacity) {
-        Bus *tmp = realloc(*fleet_ptr, n * sizeof(Bus));
-        if (!tmp) {
-            printf(COLOR_RED
-                   "Memory allocation failed while loading file.\n"
-                   COLOR_RESET);
-            fclose(fp);
-            *count = 0;
-            return;
-        }
-        *fleet_ptr = tmp;
-        *capacity = n;
-    }
+/* Atomically replaces dst with src (rename over an existing file). */
+int replace_file(const char *src, const char *dst) {
+#ifdef _WIN32
+    return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING |
+                                 MOVEFILE_WRITE_THROUGH) ? 0 : -1;
+#else
+    return rename(src, dst);
+#endif
+}
 
-    for (int i = 0; i < n; i++) {
-        Bus *b = &((*fleet_ptr)[i]);
-        int status_int;
-        if (fscanf(fp,
-                   "%19[^|]|%49[^|]|%d|"
-                   "%d|%d|%d|"
-                   "%d|%d|%d|"
-                   "%f|%f|%f|"
-                   "%d|%d|%d|"
-                   "%f|%d|%f|%f\n",
-                   b->bus_code,
-                   b->driver_name,
-                   &b->bus_no,
-                   &b->last_service.day,
-                   &b->last_service.month,
-                   &b->last_service.year,
-                   &b->next_due.day,
-                   &b->next_due.month,
-                   &b->next_due.year,
-                   &b->current_mileage,
-                   &b->last_service_mileage,
-                   &b->service_interval_km,
-                   &b->service_interval_days,
-                   &b->service_history_count,
-                   &status_int,
-                   &b->km_left,
-                   &b->health_score,
-                   &b->avg_daily_km,
-                   &b->fuel_efficiency) != 19) {
-            printf(COLOR_YELLOW "Warning: corrupted line in data file.\n" COLOR_RESET);
-        }
-        b->status = (Status)status_int;
-    }
+/* Writes the fleet to "<filename>.tmp" and renames it over filename, so
+   readers only ever see the old or the new complete file. Prints nothing;
+   returns 0 on success. */
+int save_fleet_atomic(Bus *fleet, int count, const char *filename) {
+    char tmp_name[512];
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
 
-    fclose(fp);
-    *count = n;
-    printf(COLOR_GREEN "Loaded %d buses from %s\n" COLOR_RESET, *count, filename);
-}
+    FILE *fp = fopen(tmp_name, "w");
+    if (!fp) return -1;
 
-/* ---------- Display / Search / Reports ---------- */
+    fprintf(fp, "%d\n", count);
+    for (int i = 0; i < count; i++) {
+        write_bus_record(fp, &fleet[i]);
+    }
 
-void display_one_bus(Bus *b) {
-    const char *col = status_color(b->status);
-    printf("%sBus %d [%s] (%s)%s\n",
-           col, b->bus_no, b->bus_code, status_label(b->status), COLOR_RESET);
-    printf("  Driver name       : %s\n", b->driver_name);
-    printf("  Last service date : ");
-    print_date(b->last_service);
-    printf("\n");
-    if (b->next_due.year > 0) {
-        printf("  Next due date     : ");
-        print_date(b->next_due);
-        printf("\n");
+    int failed = ferror(fp) || flush_to_disk(fp) != 0;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
     }
-    printf("  Last service km   : %.1f\n", b->last_service_mileage);
-    printf("  Current km        : %.1f\n", b->current_mileage);
-    printf("  Interval          : %.1f km, %d days\n",
-           b->service_interval_km, b->service_interval_days);
-    printf("  Km left           : %.1f\n", b->km_left);
-    printf("  Avg daily km      : %.1f\n", b->avg_daily_km);
-    printf("  Fuel efficiency   : %.1f km/l\n", b->fuel_efficiency);
-    printf("  Health score      : %d/100\n", b->health_score);
-    printf("  Service history   : %d\n", b->service_history_count);
+    return 0;
 }
 
-void display_all_buses(Bus *fleet, int count) {
-    if (count == 0) {
-        printf(COLOR_YELLOW "No buses in fleet.\n" COLOR_RESET);
-        return;
+int save_fleet_to_file(Bus *fleet, int count, const char *filename) {
+    if (save_fleet_atomic(fleet, count, filename) != 0) {
+        printf(COLOR_RED "Error opening file for writing.\n" COLOR_RESET);
+        return -1;
     }
+    printf(COLOR_GREEN "Fleet saved to %s\n" COLOR_RESET, filename);
+    return 0;
+}
 
-    printf(COLOR_BOLD
-           "\n================ Fleet Summary (All Buses) ================\n"
-           COLOR_RESET);
-    printf("Total buses: %d\n\n", count);
+typedef enum {
+    LOAD_OK = 0,
+    LOAD_NO_FILE,
+    LOAD_EMPTY,
+    LOAD_NO_MEMORY
+} LoadResult;
 
-    printf("Bus  | Code      | Driver        | Last Service | Next Due   | CurrKm     | KmLeft    | Health   | Status   \n");
-    printf("-----+-----------+---------------+--------------+------------+------------+-----------+----------+---------\n");
+/* ---------- Line reader & record parser ---------- */
 
-    for (int i = 0; i < count; i++) {
-        Bus *b = &fleet[i];
-        const char *col = status_color(b->status);
-        char last_buf[16];
-        char next_buf[16];
+#define LINE_CHUNK  (1 << 20)
+#define BUS_FIELDS  20
+#define BUS_FIELDS_MIN 19   /* files written before change_seq existed */
 
-        snprintf(last_buf, sizeof last_buf, "%02d-%02d-%04d",
-                 b->last_service.day, b->last_service.month, b->last_service.year);
+/* Reads a text file in large chunks and hands out one line at a time;
+   newlines are located with memchr rather than character by character. */
+typedef struct {
+    FILE  *fp;
+    char  *buf;
+    size_t cap;
+    size_t start;     /* first unread byte */
+    size_t end;       /* end of valid data */
+    int    eof;
+    long   line_no;   /* 1-based number of the last returned line */
+} LineReader;
+
+int lr_open(LineReader *lr, const char *filename) {
+    memset(lr, 0, sizeof *lr);
+    lr->fp = fopen(filename, "rb");
+    if (!lr->fp) return 0;
+    lr->cap = LINE_CHUNK;
+    lr->buf = malloc(lr->cap + 1);
+    if (!lr->buf) {
+        fclose(lr->fp);
+        lr->fp = NULL;
+        return 0;
+    }
+    return 1;
+}
 
-        if (b->next_due.year > 0) {
-            snprintf(next_buf, sizeof next_buf, "%02d-%02d-%04d",
-                     b->next_due.day, b->next_due.month, b->next_due.year);
-        } else {
-            strcpy(next_buf, "-");
+/* Returns the next line without its line ending (NUL-terminated, may be
+   modified by the caller), or NULL at end of file. */
+char *lr_next(LineReader *lr, size_t *len) {
+    while (1) {
+        char *base = lr->buf + lr->start;
+        size_t avail = lr->end - lr->start;
+        char *nl = avail ? memchr(base, '\n', avail) : NULL;
+
+        if (nl || (lr->eof && avail > 0)) {
+            size_t n = nl ? (size_t)(nl - base) : avail;
+            lr->start += nl ? n + 1 : n;
+            if (n > 0 && base[n - 1] == '\r') n--;
+            base[n] = '\0';
+            lr->line_no++;
+            if (len) *len = n;
+            return base;
         }
-
-        printf("%-4d | %-9.9s | %-13.13s | %-12s | %-10s | %10.1f | %9.1f | %8d | %s%-9s%s\n",
-               b->bus_no,
-               b->bus_code,
-               b->driver_name,
-               last_buf,
-               next_buf,
-               b->current_mileage,
-               b->km_left,
-               b->health_score,
-               col, status_label(b->status), COLOR_RESET);
+        if (lr->eof) return NULL;
+
+        /* Keep the partial line, grow only if one line fills the buffer. */
+        memmove(lr->buf, base, avail);
+        lr->start = 0;
+        lr->end = avail;
+        if (lr->end == lr->cap) {
+            char *tmp = realloc(lr->buf, lr->cap * 2 + 1);
+            if (!tmp) return NULL;
+            lr->buf = tmp;
+            lr->cap *= 2;
+        }
+        size_t got = fread(lr->buf + lr->end, 1, lr->cap - lr->end, lr->fp);
+        lr->end += got;
+        if (got == 0) lr->eof = 1;
     }
+}
 
-    printf("\n");
+void lr_close(LineReader *lr) {
+    if (lr->fp) fclose(lr->fp);
+    free(lr->buf);
+    lr->fp = NULL;
+    lr->buf = NULL;
+}
+
+/* Splits `line` in place on `sep`; returns the number of fields found
+   (which may exceed max_fields, in which case only max_fields are set). */
+int split_fields(char *line, char sep, char **fields, int max_fields) {
+    int n = 0;
+    char *p = line;
+    while (1) {
+        char *next = strchr(p, sep);
+        if (n < max_fields) fields[n] = p;
+        n++;
+        if (!next) break;
+        *next = '\0';
+        p = next + 1;
+    }
+    return n;
+}
+
+int parse_int_field(const char *s, int *out) {
+    char *end;
+    long v;
+    errno = 0;
+    v = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || errno == ERANGE) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+int parse_float_field(const char *s, float *out) {
+    char *end;
+    float v = strtof(s, &end);
+    if (end == s || *end != '\0') return 0;
+    *out = v;
+    return 1;
+}
+
+/* Parses one bus_data.txt record ("code|driver|no|..."), modifying `line`.
+   Returns 1 only if the line has BUS_FIELDS (or, without change_seq,
+   BUS_FIELDS_MIN) well-formed fields; on failure `b` is left untouched. */
+int parse_bus_line(char *line, Bus *b) {
+    char *f[BUS_FIELDS];
+    Bus t;
+    int status_int;
+
+    int nf = split_fields(line, '|', f, BUS_FIELDS);
+    if (nf < BUS_FIELDS_MIN || nf > BUS_FIELDS) return 0;
+    if (f[0][0] == '\0' || strlen(f[0]) >= sizeof t.bus_code) return 0;
+
+    memset(&t, 0, sizeof t);
+    strncpy(t.bus_code, f[0], sizeof t.bus_code - 1);
+    strncpy(t.driver_name, f[1], sizeof t.driver_name - 1);
+
+    if (!parse_int_field(f[2], &t.bus_no) ||
+        !parse_int_field(f[3], &t.last_service.day) ||
+        !parse_int_field(f[4], &t.last_service.month) ||
+        !parse_int_field(f[5], &t.last_service.year) ||
+        !parse_int_field(f[6], &t.next_due.day) ||
+        !parse_int_field(f[7], &t.next_due.month) ||
+        !parse_int_field(f[8], &t.next_due.year) ||
+        !parse_float_field(f[9], &t.current_mileage) ||
+        !parse_float_field(f[10], &t.last_service_mileage) ||
+        !parse_float_field(f[11], &t.service_interval_km) ||
+        !parse_int_field(f[12], &t.service_interval_days) ||
+        !parse_int_field(f[13], &t.service_history_count) ||
+        !parse_int_field(f[14], &status_int) ||
+        !parse_float_field(f[15], &t.km_left) ||
+        !parse_int_field(f[16], &t.health_score) ||
+        !parse_float_field(f[17], &t.avg_daily_km) ||
+        !parse_float_field(f[18], &t.fuel_efficiency)) {
+        return 0;
+    }
+    if (status_int < STATUS_OK || status_int > STATUS_OVERDUE) return 0;
+    t.status = (Status)status_int;
+    if (nf == BUS_FIELDS &&
+        (!parse_int_field(f[19], &t.change_seq) || t.change_seq < 0)) {
+        return 0;
+    }
+
+    *b = t;
+    return 1;
+}
+
+/* ---------- Text data file loader ---------- */
+
+/* Parses one line of a line-oriented format into *b: returns 1 for a
+   bus, 0 for a malformed line and -1 for a line to skip silently. */
+typedef int (*LineParser)(char *line, Bus *b);
+
+/* Reads a line-oriented fleet file one line at a time (LineReader), so a
+   malformed line can never shift the fields of the lines after it. Each
+   line goes through `parse`; rejected lines are copied with their line
+   number to "<filename>.quarantine" and skipped. A bare count on the
+   first line is only a capacity hint, and a CSV report header is
+   skipped. Prints nothing, so it can also re-read the file behind a live
+   screen. */
+LoadResult load_fleet_lines(Bus **fleet_ptr, int *count, int *capacity,
+                            const char *filename, int *corrupted,
+                            LineParser parse) {
+    LineReader lr;
+    FILE *quarantine = NULL;
+    char *line;
+    size_t len;
+    int n = 0;
+
+    *corrupted = 0;
+    *count = 0;
+    if (!lr_open(&lr, filename)) return LOAD_NO_FILE;
+
+    while ((line = lr_next(&lr, &len)) != NULL) {
+        if (len == 0) continue;
+        if (lr.line_no == 1) {
+            int hint;
+            if (parse_int_field(line, &hint)) {
+                if (hint > *capacity && hint < 100000000) {
+                    Bus *tmp = realloc(*fleet_ptr, (size_t)hint * sizeof(Bus));
+                    if (tmp) {
+                        *fleet_ptr = tmp;
+                        *capacity = hint;
+                    }
+                }
+                continue;
+            }
+            if (strncmp(line, "BusNo,", 6) == 0) continue;
+        }
+
+        if (n >= *capacity) {
+            int new_cap = (*capacity == 0) ? 64 : *capacity * 2;
+            Bus *tmp = realloc(*fleet_ptr, (size_t)new_cap * sizeof(Bus));
+            if (!tmp) {
+                lr_close(&lr);
+                if (quarantine) fclose(quarantine);
+                return LOAD_NO_MEMORY;
+            }
+            *fleet_ptr = tmp;
+            *capacity = new_cap;
+        }
+
+        /* Parsers split in place; keep the original for quarantine. */
+        char saved[1024];
+        size_t keep = (len < sizeof saved - 1) ? len : sizeof saved - 1;
+        memcpy(saved, line, keep);
+        saved[keep] = '\0';
+
+        int rc = parse(line, &(*fleet_ptr)[n]);
+        if (rc != 0) {
+            if (rc > 0) n++;
+            continue;
+        }
+        (*corrupted)++;
+        if (!quarantine) {
+            char qname[512];
+            snprintf(qname, sizeof qname, "%s.quarantine", filename);
+            quarantine = fopen(qname, "w");
+        }
+        if (quarantine) fprintf(quarantine, "line %ld: %s\n", lr.line_no, saved);
+    }
+
+    lr_close(&lr);
+    if (quarantine) fclose(quarantine);
+    *count = n;
+    return (n > 0) ? LOAD_OK : LOAD_EMPTY;
+}
+
+/* Any supported format; see the format-detecting loader further down. */
+LoadResult load_fleet_quiet(Bus **fleet_ptr, int *count, int *capacity,
+                            const char *filename, int *corrupted);
+
+void load_fleet_from_file(Bus **fleet_ptr, int *count, int *capacity,
+                          const char *filename) {
+    int corrupted;
+    switch (load_fleet_quiet(fleet_ptr, count, capacity, filename, &corrupted)) {
+        case LOAD_NO_FILE:
+            return;
+        case LOAD_EMPTY:
+            printf(COLOR_YELLOW "Data file empty or invalid.\n" COLOR_RESET);
+            if (corrupted == 0) return;
+            break;
+        case LOAD_NO_MEMORY:
+            printf(COLOR_RED
+                   "Memory allocation failed while loading file.\n"
+                   COLOR_RESET);
+            return;
+        case LOAD_OK:
+            break;
+    }
+    if (corrupted > 0) {
+        printf(COLOR_YELLOW
+               "Warning: %d corrupted line(s) skipped; see %s.quarantine\n"
+               COLOR_RESET, corrupted, filename);
+    }
+    if (*count > 0) {
+        printf(COLOR_GREEN "Loaded %d buses from %s\n" COLOR_RESET, *count, filename);
+    }
+}
+
+/* ---------- NIMBUS migration ---------- */
+
+/* Converts NIMBUS.c's fleet_data.csv into bus_data.txt. A NIMBUS line is
+     bus_no,last_service_km,current_km,DD-MM-YYYY,next_due_km,
+     days_since_service,due_in_days,overdue_flag
+   and is mapped to a Bus with a synthesized code ("NIM-<bus_no>"), the
+   service interval implied by next_due_km, NIMBUS's fixed 180-day date
+   interval and statuses refreshed for `today`. Input is read with a
+   LineReader and output goes through one large stdio buffer, so memory
+   stays constant whatever the file size; the only per-bus state is a
+   bitmap of bus numbers already seen. Rejected lines are copied with
+   their line number to "<in>.quarantine". */
+#define NIMBUS_FILE           "fleet_data.csv"
+#define NIMBUS_FIELDS         8
+#define NIMBUS_INTERVAL_KM    10000
+#define NIMBUS_INTERVAL_DAYS  180
+#define NIMBUS_MAX_BUS_NO     9999999
+
+/* Strict "DD-MM-YYYY" (two-digit day and month, four-digit year). */
+static int parse_ddmmyyyy(const char *s, Date *out) {
+    Date d;
+    if (strlen(s) != 10 || s[2] != '-' || s[5] != '-') return 0;
+    for (int i = 0; i < 10; i++) {
+        if (i != 2 && i != 5 && !isdigit((unsigned char)s[i])) return 0;
+    }
+    d.day = (s[0] - '0') * 10 + (s[1] - '0');
+    d.month = (s[3] - '0') * 10 + (s[4] - '0');
+    d.year = (s[6] - '0') * 1000 + (s[7] - '0') * 100 + (s[8] - '0') * 10 + (s[9] - '0');
+    if (!is_valid_date(d)) return 0;
+    *out = d;
+    return 1;
+}
+
+/* Statuses are left for the caller to refresh. */
+int parse_nimbus_line(char *line, Bus *b) {
+    char *f[NIMBUS_FIELDS];
+    int v[NIMBUS_FIELDS];
+    Date last;
+
+    if (split_fields(line, ',', f, NIMBUS_FIELDS) != NIMBUS_FIELDS) return 0;
+    for (int i = 0; i < NIMBUS_FIELDS; i++) {
+        if (i != 3 && !parse_int_field(f[i], &v[i])) return 0;
+    }
+    if (!parse_ddmmyyyy(f[3], &last) || !is_calendar_date(last)) return 0;
+    if (v[0] < 1 || v[0] > NIMBUS_MAX_BUS_NO || v[1] < 0 || v[2] < 0) return 0;
+
+    memset(b, 0, sizeof *b);
+    b->bus_no = v[0];
+    snprintf(b->bus_code, sizeof b->bus_code, "NIM-%d", v[0]);
+    strcpy(b->driver_name, "Unassigned");
+    b->last_service = last;
+    b->last_service_mileage = (float)v[1];
+    b->current_mileage = (float)v[2];
+    b->service_interval_km = (float)(v[4] > v[1] ? v[4] - v[1] : NIMBUS_INTERVAL_KM);
+    b->service_interval_days = NIMBUS_INTERVAL_DAYS;
+    if (v[5] > 0 && v[2] >= v[1]) b->avg_daily_km = (float)(v[2] - v[1]) / (float)v[5];
+    return 1;
+}
+
+int migrate_nimbus(const char *in_file, const char *out_file, Date today) {
+    LineReader lr;
+    char tmp_name[512];
+    char *line;
+    size_t len;
+    long migrated = 0, rejected = 0;
+    FILE *quarantine = NULL;
+    struct stat st;
+
+    if (stat(out_file, &st) == 0 && st.st_size > 0) {
+        printf(COLOR_RED "%s already exists; remove it or pick another output file.\n"
+               COLOR_RESET, out_file);
+        return 1;
+    }
+    if (!lr_open(&lr, in_file)) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, in_file);
+        return 1;
+    }
+    uint8_t *seen = calloc(NIMBUS_MAX_BUS_NO / 8 + 1, 1);
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", out_file);
+    FILE *fp = seen ? fopen(tmp_name, "wb") : NULL;
+    if (!fp) {
+        printf(COLOR_RED "Could not create %s.\n" COLOR_RESET, tmp_name);
+        free(seen);
+        lr_close(&lr);
+        return 1;
+    }
+    setvbuf(fp, NULL, _IOFBF, LINE_CHUNK);
+
+    /* Fixed-width count, patched once the real number is known. */
+    fprintf(fp, "%010d\n", 0);
+
+    double t0 = now_seconds();
+    while ((line = lr_next(&lr, &len)) != NULL) {
+        if (len == 0) continue;
+        char saved[1024];
+        size_t keep = (len < sizeof saved - 1) ? len : sizeof saved - 1;
+        memcpy(saved, line, keep);
+        saved[keep] = '\0';
+
+        Bus b;
+        if (parse_nimbus_line(line, &b) &&
+            !(seen[b.bus_no >> 3] & (1u << (b.bus_no & 7)))) {
+            seen[b.bus_no >> 3] |= (uint8_t)(1u << (b.bus_no & 7));
+            update_maintenance_status(&b, today);
+            write_bus_record(fp, &b);
+            migrated++;
+            continue;
+        }
+        rejected++;
+        if (!quarantine) {
+            char qname[512];
+            snprintf(qname, sizeof qname, "%s.quarantine", in_file);
+            quarantine = fopen(qname, "w");
+        }
+        if (quarantine) fprintf(quarantine, "line %ld: %s\n", lr.line_no, saved);
+    }
+    lr_close(&lr);
+    free(seen);
+    if (quarantine) fclose(quarantine);
+
+    int failed = ferror(fp) || fseek(fp, 0, SEEK_SET) != 0 ||
+                 fprintf(fp, "%010ld", migrated) != 10 ||
+                 flush_to_disk(fp) != 0;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, out_file) != 0) {
+        remove(tmp_name);
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, out_file);
+        return 1;
+    }
+
+    double elapsed = now_seconds() - t0;
+    printf(COLOR_GREEN "Migrated %ld buses from %s to %s in %.2f s\n" COLOR_RESET,
+           migrated, in_file, out_file, elapsed);
+    if (rejected > 0) {
+        printf(COLOR_YELLOW
+               "Warning: %ld line(s) rejected (bad fields, dates or duplicate "
+               "bus numbers); see %s.quarantine\n" COLOR_RESET, rejected, in_file);
+    }
+    return 0;
+}
+
+/* ---------- Display / Search / Reports ---------- */
+
+void display_one_bus(Bus *b) {
+    const char *col = status_color(b->status);
+    printf("%sBus %d [%s] (%s)%s\n",
+           col, b->bus_no, b->bus_code, status_label(b->status), COLOR_RESET);
+    printf("  Driver name       : %s\n", b->driver_name);
+    printf("  Last service date : ");
+    print_date(b->last_service);
+    printf("\n");
+    if (b->next_due.year > 0) {
+        printf("  Next due date     : ");
+        print_date(b->next_due);
+        printf("\n");
+    }
+    printf("  Last service km   : %.1f\n", b->last_service_mileage);
+    printf("  Current km        : %.1f\n", b->current_mileage);
+    printf("  Interval          : %.1f km, %d days\n",
+           b->service_interval_km, b->service_interval_days);
+    printf("  Km left           : %.1f\n", b->km_left);
+    printf("  Avg daily km      : %.1f\n", b->avg_daily_km);
+    printf("  Fuel efficiency   : %.1f km/l\n", b->fuel_efficiency);
+    printf("  Health score      : %d/100\n", b->health_score);
+    printf("  Service history   : %d\n", b->service_history_count);
+}
+
+/* ---------- Paginated fleet table ---------- */
+
+#define TABLE_HEADER_LINES 6   /* title, total, blank, heading, rule, ... */
+#define TABLE_FOOTER_LINES 3   /* blank, page line, prompt */
+
+typedef struct {
+    char  *text;   /* formatted page, NULL until first rendered */
+    size_t len;
+} RenderedPage;
+
+static void render_table_row(TextBuf *tb, Bus *b) {
+    char last_buf[16];
+    char next_buf[16];
+
+    format_date_fixed(last_buf, b->last_service);
+    if (b->next_due.year > 0) {
+        format_date_fixed(next_buf, b->next_due);
+    } else {
+        strcpy(next_buf, "-");
+    }
+
+    /* A huge float can overrun the usual 256 bytes; retry with room for it. */
+    size_t want = 256;
+    for (;;) {
+        if (!tb_reserve(tb, want)) return;
+        size_t room = tb->cap - tb->len;
+        int n = snprintf(tb->data + tb->len, room,
+                         "%-4d | %-9.9s | %-13.13s | %-12s | %-10s | %10.1f | %9.1f | %8d | %s%-9s%s\n",
+                         b->bus_no,
+                         b->bus_code,
+                         b->driver_name,
+                         last_buf,
+                         next_buf,
+                         b->current_mileage,
+                         b->km_left,
+                         b->health_score,
+                         status_color(b->status), status_label(b->status),
+                         COLOR_RESET);
+        if (n < 0) return;
+        if ((size_t)n < room) {
+            tb->len += (size_t)n;
+            return;
+        }
+        want = (size_t)n + 1;
+    }
+}
+
+static void render_table_page(RenderedPage *page, Bus *fleet, int count,
+                              int first, int rows, int page_no, int pages) {
+    TextBuf tb = {0};
+    char line[96];
+
+    tb_puts(&tb, COLOR_BOLD
+            "\n================ Fleet Summary (All Buses) ================\n"
+            COLOR_RESET);
+    snprintf(line, sizeof line, "Total buses: %d\n\n", count);
+    tb_puts(&tb, line);
+    tb_puts(&tb, "Bus  | Code      | Driver        | Last Service | Next Due   | CurrKm     | KmLeft    | Health   | Status   \n");
+    tb_puts(&tb, "-----+-----------+---------------+--------------+------------+------------+-----------+----------+---------\n");
+
+    int last = first + rows;
+    if (last > count) last = count;
+    for (int i = first; i < last; i++) {
+        render_table_row(&tb, &fleet[i]);
+    }
+
+    if (pages > 1) {
+        snprintf(line, sizeof line, "\nPage %d/%d (buses %d-%d)\n",
+                 page_no + 1, pages, first + 1, last);
+    } else {
+        snprintf(line, sizeof line, "\n");
+    }
+    tb_puts(&tb, line);
+
+    page->text = tb.data;
+    page->len = tb.len;
+}
+
+void display_all_buses(Bus *fleet, int count) {
+    if (count == 0) {
+        printf(COLOR_YELLOW "No buses in fleet.\n" COLOR_RESET);
+        return;
+    }
+
+    int rows = terminal_rows() - TABLE_HEADER_LINES - TABLE_FOOTER_LINES;
+    if (rows < 5) rows = 5;
+    int pages = (count + rows - 1) / rows;
+
+    RenderedPage *cache = calloc((size_t)pages, sizeof(RenderedPage));
+    if (!cache) {
+        printf(COLOR_RED "Memory allocation failed while rendering.\n"
+               COLOR_RESET);
+        return;
+    }
+
+    int cur = 0;
+    char buf[64];
+    while (1) {
+        if (!cache[cur].text) {
+            render_table_page(&cache[cur], fleet, count,
+                              cur * rows, rows, cur, pages);
+        }
+        if (cache[cur].text) {
+            write_block(cache[cur].text, cache[cur].len);
+        }
+        if (pages == 1) break;
+
+        printf("[n]ext, [p]rev, page number to jump, [q]uit: ");
+        if (!read_line_stdin(buf, sizeof buf)) break;
+
+        char c = (char)tolower((unsigned char)buf[0]);
+        if (c == 'q') {
+            break;
+        } else if (c == 'p') {
+            if (cur > 0) cur--;
+        } else if (isdigit((unsigned char)c)) {
+            int target = atoi(buf);
+            if (target >= 1 && target <= pages) {
+                cur = target - 1;
+            } else {
+                printf(COLOR_YELLOW "Please enter a page between 1 and %d.\n"
+                       COLOR_RESET, pages);
+            }
+        } else if (cur < pages - 1) {
+            cur++;                  /* 'n' or Enter */
+        } else {
+            break;                  /* Enter on the last page leaves */
+        }
+    }
+
+    for (int i = 0; i < pages; i++) {
+        free(cache[i].text);
+    }
+    free(cache);
 }
 
 void show_due_soon_or_overdue(Bus *fleet, int count) {
@@ -572,369 +1870,7964 @@ void search_bus(Bus *fleet, int count) {
     display_one_bus(&fleet[idx]);
 }
 
-/* ---------- Edit by position ---------- */
+/* ---------- Due calendar ---------- */
+
+/* How many buses will be due on each of the next DUE_CALENDAR_DAYS days.
+   One pass over the fleet computes each bus's forecast due day (the
+   earlier of its calendar due date and the day its mileage, at
+   avg_daily_km, reaches the service interval) into a day histogram.
+   Prefix sums then give the cumulative overdue count for every day, so a
+   year of daily counts costs one fleet pass instead of one per day. */
+#define DUE_CALENDAR_DAYS 365
+#define DUE_CALENDAR_FILE "due_calendar.csv"
+#define DUE_NEVER         INT_MAX
+
+/* Days from today until b's day interval runs out (<= 0: already due),
+   or DUE_NEVER; counts the same way as update_maintenance_status. */
+int calendar_due_offset(const Bus *b, Date today) {
+    if (b->service_interval_days <= 0 || !is_valid_date(b->last_service) ||
+        !is_valid_date(today)) return DUE_NEVER;
+    if (workshop.loaded && is_calendar_date(b->last_service) &&
+        is_calendar_date(today)) {
+        Date d = add_working_days(b->last_service, b->service_interval_days);
+        return date_to_civil_days(d) - date_to_civil_days(today);
+    }
+    return date_to_days(b->last_service) + b->service_interval_days -
+           date_to_days(today);
+}
 
-int choose_bus_position(Bus *fleet, int count) {
-    if (count == 0) {
-        printf(COLOR_YELLOW "No buses available to select.\n" COLOR_RESET);
-        return -1;
+/* ceil(a / b) for a, b > 0 by truncating and rounding up, so the plain
+   "gcc main.c" build needs no libm; DUE_NEVER if it does not fit. */
+int ceil_div_days(double a, double b) {
+    double q = a / b;
+    if (q >= DUE_NEVER) return DUE_NEVER;
+    int n = (int)q;
+    return (n < q) ? n + 1 : n;
+}
+
+/* Days from today until b is due (<= 0: already due), or DUE_NEVER. */
+int forecast_due_day(const Bus *b, Date today) {
+    int due = calendar_due_offset(b, today);
+    if (b->service_interval_km > 0.0f) {
+        float km_left = b->last_service_mileage + b->service_interval_km -
+                        b->current_mileage;
+        int by_km = DUE_NEVER;
+        if (km_left <= 0.0f) {
+            by_km = 0;
+        } else if (b->avg_daily_km > 0.0f) {
+            by_km = ceil_div_days(km_left, b->avg_daily_km);
+        }
+        if (by_km < due) due = by_km;
     }
+    return due;
+}
 
-    printf("\nAvailable buses (positions):\n");
-    printf("Pos | BusNo | Code        | Driver\n");
-    printf("----+-------+-------------+----------------\n");
+/* counts[k] = buses due on day k (k = 0 also holds those already due);
+   overdue[k] = buses due on or before day k. Both hold days + 1 entries. */
+void due_calendar(const Bus *fleet, int count, Date today, int days,
+                  int *counts, int *overdue) {
+    memset(counts, 0, (size_t)(days + 1) * sizeof *counts);
     for (int i = 0; i < count; i++) {
-        printf("%-3d | %-5d | %-11.11s | %-16.16s\n",
-               i + 1,
-               fleet[i].bus_no,
-               fleet[i].bus_code,
-               fleet[i].driver_name);
+        int d = forecast_due_day(&fleet[i], today);
+        if (d <= days) counts[d > 0 ? d : 0]++;
+    }
+    int run = 0;
+    for (int k = 0; k <= days; k++) {
+        run += counts[k];
+        overdue[k] = run;
     }
-
-    int pos = read_int_strict("\nEnter position: ", 1, count);
-    return pos - 1;
 }
 
-void edit_bus_by_position(Bus *fleet, int count) {
-    int idx = choose_bus_position(fleet, count);
-    if (idx < 0) return;
-
-    Bus *b = &fleet[idx];
-    printf(COLOR_CYAN "Editing position %d (Bus %d, %s)\n"
-           COLOR_RESET, idx + 1, b->bus_no, b->bus_code);
-
-    char tmp[64];
+int export_due_calendar(const Bus *fleet, int count, Date today,
+                        const char *filename) {
+    int counts[DUE_CALENDAR_DAYS + 1], overdue[DUE_CALENDAR_DAYS + 1];
+    due_calendar(fleet, count, today, DUE_CALENDAR_DAYS, counts, overdue);
 
-    /* Unique bus_code (allow keeping same, case-insensitive) */
-    while (1) {
-        printf("Enter new bus code (leave empty to keep '%s'): ",
-               b->bus_code);
-        if (!read_line_stdin(tmp, sizeof tmp))
-            continue;
-        if (tmp[0] == '\0') {
-            /* keep old */
-            break;
-        }
-        to_upper_str(tmp);
-        if (bus_code_exists(fleet, count, tmp, idx)) {
-            printf(COLOR_RED
-                   "This bus code already exists (case-insensitive). Please enter a different code.\n"
-                   COLOR_RESET);
-            continue;
-        }
-        strncpy(b->bus_code, tmp, sizeof b->bus_code - 1);
-        b->bus_code[sizeof b->bus_code - 1] = '\0';
-        break;
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+    TextBuf tb = {0};
+    char line[64];
+    tb_puts(&tb, "Date,DueThatDay,OverdueTotal\n");
+    /* Label day k the way its offset was counted: on the real calendar
+       with a workshop calendar, else with the 30-day-month day model
+       next_due uses. */
+    int civil = workshop.loaded && is_calendar_date(today);
+    int base = civil ? date_to_civil_days(today) : 0;
+    for (int k = 0; k <= DUE_CALENDAR_DAYS; k++) {
+        char *p = line;
+        format_date_fixed(p, civil ? date_from_civil_days(base + k) : add_days(today, k));
+        p += 10;
+        *p++ = ',';
+        p = put_int(p, counts[k]);
+        *p++ = ',';
+        p = put_int(p, overdue[k]);
+        *p++ = '\n';
+        tb_append(&tb, line, (size_t)(p - line));
+    }
+    int failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+    tb_free(&tb);
+    if (fclose(fp) != 0) failed = 1;
+    if (failed) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, filename);
+        return -1;
     }
 
-    /* Unique bus_no (allow keeping same) */
-    while (1) {
-        int new_no = read_int_strict(
-            "Enter new numeric bus number (or same as before): ",
-            1, 9999999);
-        if (bus_no_exists(fleet, count, new_no, idx)) {
-            printf(COLOR_RED
-                   "This bus number already exists. Please enter a different number.\n"
-                   COLOR_RESET);
-            continue;
-        }
-        b->bus_no = new_no;
-        break;
+    printf(COLOR_BOLD "\n=== Due calendar from " COLOR_RESET);
+    print_date(today);
+    printf(COLOR_BOLD " ===\n" COLOR_RESET);
+    printf("Due now: %d\n", overdue[0]);
+    static const int marks[] = {7, 14, 30, 90, 180, DUE_CALENDAR_DAYS};
+    for (size_t m = 0; m < sizeof marks / sizeof marks[0]; m++) {
+        printf("Due within %3d days: %d\n", marks[m], overdue[marks[m]]);
     }
+    printf(COLOR_GREEN "Daily counts for %d days written to %s\n" COLOR_RESET,
+           DUE_CALENDAR_DAYS, filename);
+    return 0;
+}
 
-    read_driver_name(b->driver_name, sizeof b->driver_name);
+/* ---------- Depots & overdue aging ---------- */
 
-    b->last_service = read_date("Enter new last service date (dd/mm/yyyy): ");
+/* A bus's depot is its bus_code up to the first '_' or '-' ("CU_B001" is
+   depot CU). Depot names are interned once in a small open-addressing
+   table, so later passes work with dense depot ids. */
+#define DEPOT_NAME_MAX 20
+#define AGING_BUCKETS  4
 
-    b->last_service_mileage =
-        read_float_strict("Enter new last service mileage (km): ",
-                          0.0f, 100000.0f);
+typedef struct {
+    char name[DEPOT_NAME_MAX];
+    int  buses;
+    int  overdue;
+    int  by_days[AGING_BUCKETS];   /* 0-7, 8-30, 31-90, 90+ days overdue */
+    int  by_km[AGING_BUCKETS];     /* 0-500, 501-2000, 2001-5000, 5000+ km over */
+} Depot;
 
-    b->current_mileage =
-        read_float_strict("Enter new current mileage (km): ",
-                          0.0f, 100000.0f);
+typedef struct {
+    Depot *depots;
+    int    ndepots;
+    int    cap;
+    int   *slots;                  /* depot id + 1, 0 = empty */
+    int    nslots;                 /* power of two */
+} DepotTable;
+
+static DepotTable depot_table;
+
+/* Codes with no prefix share one depot stored under the empty name. */
+const char *depot_label(int id) {
+    const char *name = depot_table.depots[id].name;
+    return name[0] ? name : "-";
+}
 
-    b->service_interval_km =
-        read_float_strict("Enter new service interval (km): ",
-                          1.0f, 100000.0f);
+size_t depot_prefix_len(const char *code) {
+    size_t n = strcspn(code, "_-");
+    return n < DEPOT_NAME_MAX ? n : DEPOT_NAME_MAX - 1;
+}
 
-    b->service_interval_days =
-        read_int_strict("Enter new service interval in days (0 if not used): ",
-                        0, 5000);
+static uint32_t depot_hash(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)toupper((unsigned char)s[i])) * 16777619u;
+    return h;
+}
 
-    b->avg_daily_km =
-        read_float_strict("Enter new average daily km: ",
-                          0.0f, 100000.0f);
+static int depot_rehash(int nslots) {
+    int *slots = calloc((size_t)nslots, sizeof *slots);
+    if (!slots) return 0;
+    for (int id = 0; id < depot_table.ndepots; id++) {
+        const char *name = depot_table.depots[id].name;
+        uint32_t h = depot_hash(name, strlen(name)) & (uint32_t)(nslots - 1);
+        while (slots[h]) h = (h + 1) & (uint32_t)(nslots - 1);
+        slots[h] = id + 1;
+    }
+    free(depot_table.slots);
+    depot_table.slots = slots;
+    depot_table.nslots = nslots;
+    return 1;
+}
 
-    b->fuel_efficiency =
-        read_float_strict("Enter new fuel efficiency (km/l): ",
-                          0.0f, 100.0f);
+/* Dense id of the depot a bus code belongs to (names compare ignoring
+   case), adding it on first sight; -1 if out of memory. */
+int depot_id(const char *code) {
+    DepotTable *t = &depot_table;
+    size_t n = depot_prefix_len(code);
+    if (t->ndepots * 2 >= t->nslots && !depot_rehash(t->nslots ? t->nslots * 2 : 64))
+        return -1;
 
-    b->service_history_count =
-        read_int_strict("Enter new service history count: ",
-                        0, 1500);
+    uint32_t mask = (uint32_t)(t->nslots - 1);
+    uint32_t h = depot_hash(code, n) & mask;
+    for (; t->slots[h]; h = (h + 1) & mask) {
+        const char *name = t->depots[t->slots[h] - 1].name;
+        size_t k = 0;
+        while (k < n && name[k] && toupper((unsigned char)name[k]) ==
+                                   toupper((unsigned char)code[k])) k++;
+        if (k == n && name[n] == '\0') return t->slots[h] - 1;
+    }
 
-    printf(COLOR_GREEN "Bus at position %d updated.\n" COLOR_RESET, idx + 1);
+    if (t->ndepots >= t->cap) {
+        int new_cap = (t->cap == 0) ? 16 : t->cap * 2;
+        Depot *tmp = realloc(t->depots, (size_t)new_cap * sizeof *tmp);
+        if (!tmp) return -1;
+        t->depots = tmp;
+        t->cap = new_cap;
+    }
+    Depot *d = &t->depots[t->ndepots];
+    memset(d, 0, sizeof *d);
+    for (size_t k = 0; k < n; k++) d->name[k] = (char)toupper((unsigned char)code[k]);
+    t->slots[h] = ++t->ndepots;
+    return t->ndepots - 1;
 }
 
-/* ---------- Add / update / delete ---------- */
+/* Aging counts are rebuilt by the status refresh itself: aging_reset()
+   before the pass, aging_add() for each bus right after its status is
+   refreshed. The report then only reads the per-depot counters. */
+void aging_reset(void) {
+    for (int i = 0; i < depot_table.ndepots; i++) {
+        Depot *d = &depot_table.depots[i];
+        d->buses = d->overdue = 0;
+        memset(d->by_days, 0, sizeof d->by_days);
+        memset(d->by_km, 0, sizeof d->by_km);
+    }
+}
 
-void add_bus(Bus **fleet_ptr, int *count, int *capacity) {
-    if (*count >= *capacity) {
-        int new_cap = (*capacity == 0) ? 4 : (*capacity * 2);
-        Bus *tmp = realloc(*fleet_ptr, new_cap * sizeof(Bus));
-        if (!tmp) {
-            printf(COLOR_RED "Memory allocation failed while adding bus.\n"
-                   COLOR_RESET);
-            return;
+void aging_add(const Bus *b, Date today) {
+    int id = depot_id(b->bus_code);
+    if (id < 0) return;
+    Depot *d = &depot_table.depots[id];
+    d->buses++;
+    if (b->status != STATUS_OVERDUE) return;
+    d->overdue++;
+
+    int late = calendar_due_offset(b, today);
+    if (late != DUE_NEVER && late <= 0) {
+        late = -late;
+        d->by_days[(late > 7) + (late > 30) + (late > 90)]++;
+    }
+    float over = -b->km_left;
+    if (over >= 0.0f) {
+        d->by_km[(over > 500.0f) + (over > 2000.0f) + (over > 5000.0f)]++;
+    }
+}
+
+static int compare_depot_name(const void *a, const void *b) {
+    return strcmp(((const Depot *)a)->name, ((const Depot *)b)->name);
+}
+
+void show_overdue_aging(void) {
+    Depot total;
+    memset(&total, 0, sizeof total);
+    strcpy(total.name, "FLEET");
+
+    Depot *rows = malloc((size_t)(depot_table.ndepots + 1) * sizeof *rows);
+    if (!rows) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+        return;
+    }
+    int nrows = 0;
+    for (int i = 0; i < depot_table.ndepots; i++) {
+        const Depot *d = &depot_table.depots[i];
+        if (d->buses == 0) continue;
+        rows[nrows++] = *d;
+        total.buses += d->buses;
+        total.overdue += d->overdue;
+        for (int k = 0; k < AGING_BUCKETS; k++) {
+            total.by_days[k] += d->by_days[k];
+            total.by_km[k] += d->by_km[k];
+        }
+    }
+    qsort(rows, (size_t)nrows, sizeof *rows, compare_depot_name);
+    rows[nrows++] = total;
+
+    printf(COLOR_BOLD "\n=== Overdue aging by depot ===\n" COLOR_RESET);
+    printf("%-10s %7s %7s | %-27s | %-27s\n", "", "", "",
+           "    days overdue", "      km over interval");
+    printf("%-10s %7s %7s | %6s %6s %6s %6s | %6s %6s %6s %6s\n",
+           "Depot", "Buses", "Overdue", "0-7", "8-30", "31-90", "90+",
+           "<=500", "<=2000", "<=5000", ">5000");
+    for (int i = 0; i < nrows; i++) {
+        const Depot *d = &rows[i];
+        if (i == nrows - 1) printf(COLOR_BOLD);
+        printf("%-10s %7d %7d | %6d %6d %6d %6d | %6d %6d %6d %6d\n",
+               d->name[0] ? d->name : "-", d->buses, d->overdue,
+               d->by_days[0], d->by_days[1], d->by_days[2], d->by_days[3],
+               d->by_km[0], d->by_km[1], d->by_km[2], d->by_km[3]);
+        if (i == nrows - 1) printf(COLOR_RESET);
+    }
+    free(rows);
+}
+
+/* ---------- Change tracking ---------- */
+
+/* Every mutation stamps the bus with the next change sequence number and
+   queues a (seq, op, bus_no) entry. Queued entries are appended to
+   CHANGE_LOG only after the fleet itself has been saved, so the log never
+   names a change the data file does not hold. With --shared, where the
+   numbers are handed out across terminals, each change is logged as it
+   is made instead (see the shared segment). Entries are fixed-size and
+   in seq order, which lets a delta export binary-search its start. */
+#define CHANGE_UPSERT 'U'
+#define CHANGE_DELETE 'D'
+
+typedef struct {
+    int seq;
+    int op;
+    int bus_no;
+} ChangeEntry;
+
+typedef struct {
+    int          last_seq;
+    ChangeEntry *pending;
+    int          npending;
+    int          cap;
+} ChangeTracker;
+
+static ChangeTracker changes;
+
+/* Reads the newest entry of a change log; returns 0 if there is none. */
+int change_log_last_seq(const char *filename) {
+    ChangeEntry e;
+    int seq = 0;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return 0;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long size = ftell(fp);
+        long n = (size > 0) ? size / (long)sizeof e : 0;
+        if (n > 0 && fseek(fp, (n - 1) * (long)sizeof e, SEEK_SET) == 0 &&
+            fread(&e, sizeof e, 1, fp) == 1) {
+            seq = e.seq;
+        }
+    }
+    fclose(fp);
+    return seq;
+}
+
+/* Continues numbering after both the log and any loaded bus (a recovered
+   autosave can hold changes the log never saw). */
+void change_tracker_init(Bus *fleet, int count, const char *log_file) {
+    changes.last_seq = change_log_last_seq(log_file);
+    for (int i = 0; i < count; i++) {
+        if (fleet[i].change_seq > changes.last_seq)
+            changes.last_seq = fleet[i].change_seq;
+    }
+    changes.npending = 0;
+}
+
+static void change_record(int op, int bus_no) {
+    if (changes.npending >= changes.cap) {
+        int new_cap = (changes.cap == 0) ? 64 : changes.cap * 2;
+        ChangeEntry *tmp = realloc(changes.pending, (size_t)new_cap * sizeof *tmp);
+        if (!tmp) return;
+        changes.pending = tmp;
+        changes.cap = new_cap;
+    }
+    ChangeEntry *e = &changes.pending[changes.npending++];
+    e->seq = changes.last_seq;
+    e->op = op;
+    e->bus_no = bus_no;
+}
+
+void change_stamp(Bus *b) {
+    b->change_seq = ++changes.last_seq;
+    change_record(CHANGE_UPSERT, b->bus_no);
+}
+
+void change_tombstone(int bus_no) {
+    ++changes.last_seq;
+    change_record(CHANGE_DELETE, bus_no);
+}
+
+/* Refreshes a bus's status and stamps it if the status band changed. */
+void refresh_bus_status(Bus *b, Date today) {
+    Status before = b->status;
+    update_maintenance_status(b, today);
+    if (b->status != before) change_stamp(b);
+}
+
+/* Appends queued entries to the log; call after a successful save. */
+int change_log_flush(const char *filename) {
+    if (changes.npending == 0) return 0;
+    FILE *fp = fopen(filename, "ab");
+    if (!fp) return -1;
+    int failed = fwrite(changes.pending, sizeof(ChangeEntry),
+                        (size_t)changes.npending, fp) != (size_t)changes.npending ||
+                 flush_to_disk(fp) != 0;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed) return -1;
+    changes.npending = 0;
+    return 0;
+}
+
+/* ---------- Audit log ---------- */
+
+/* AUDIT_LOG keeps every field a user edit changed, as (time, bus_no,
+   field id, old value, new value), packed with varints. Each record also
+   stores the byte distance back to the previous record for the same bus
+   and for the same field. AUDIT_INDEX holds the newest offset of each
+   chain, so a query for one bus or one field only reads that chain's
+   records. Edits are queued and appended after a successful save, the
+   same way as the change log. If the index is stale, opening the log
+   catches it up by reading only the records past the offset it covers. */
+#define AUDIT_MAGIC       "FGAUDIT1"
+#define AUDIT_INDEX_MAGIC "FGAIDX01"
+#define AUDIT_MAGIC_LEN   8
+#define AUDIT_RECORD_MAX  256
+
+typedef enum {
+    AUDIT_INT,
+    AUDIT_FLOAT,
+    AUDIT_DATE,
+    AUDIT_TEXT
+} AuditKind;
+
+typedef struct {
+    const char *name;
+    AuditKind   kind;
+    size_t      offset;
+    size_t      size;
+} AuditField;
+
+/* The position in this table is the field id stored in the log, so new
+   fields may only be appended. */
+static const AuditField audit_fields[] = {
+    {"bus_no",                AUDIT_INT,   offsetof(Bus, bus_no),                sizeof(int)},
+    {"bus_code",              AUDIT_TEXT,  offsetof(Bus, bus_code),              sizeof(((Bus *)0)->bus_code)},
+    {"driver_name",           AUDIT_TEXT,  offsetof(Bus, driver_name),           sizeof(((Bus *)0)->driver_name)},
+    {"last_service",          AUDIT_DATE,  offsetof(Bus, last_service),          sizeof(Date)},
+    {"last_service_mileage",  AUDIT_FLOAT, offsetof(Bus, last_service_mileage),  sizeof(float)},
+    {"current_mileage",       AUDIT_FLOAT, offsetof(Bus, current_mileage),       sizeof(float)},
+    {"service_interval_km",   AUDIT_FLOAT, offsetof(Bus, service_interval_km),   sizeof(float)},
+    {"service_interval_days", AUDIT_INT,   offsetof(Bus, service_interval_days), sizeof(int)},
+    {"avg_daily_km",          AUDIT_FLOAT, offsetof(Bus, avg_daily_km),          sizeof(float)},
+    {"fuel_efficiency",       AUDIT_FLOAT, offsetof(Bus, fuel_efficiency),       sizeof(float)},
+    {"service_history_count", AUDIT_INT,   offsetof(Bus, service_history_count), sizeof(int)},
+};
+#define AUDIT_NFIELDS ((int)(sizeof audit_fields / sizeof audit_fields[0]))
+
+/* Nonzero if a and b agree on every field the user enters (the derived
+   status fields and change stamp are ignored). */
+int bus_same_entry(const Bus *a, const Bus *b) {
+    for (int f = 0; f < AUDIT_NFIELDS; f++) {
+        const AuditField *af = &audit_fields[f];
+        const char *x = (const char *)a + af->offset;
+        const char *y = (const char *)b + af->offset;
+        if (af->kind == AUDIT_TEXT ? strncmp(x, y, af->size) != 0
+                                   : memcmp(x, y, af->size) != 0) return 0;
+    }
+    return 1;
+}
+
+typedef struct {
+    int  bus_no;
+    long head;               /* offset of the newest record for this bus */
+} AuditHead;
+
+typedef struct {
+    time_t when;
+    Bus    before;
+    Bus    after;
+} AuditEdit;
+
+typedef struct {
+    long       size;                       /* log bytes the heads cover */
+    long       field_head[AUDIT_NFIELDS];  /* 0 = no record yet */
+    AuditHead *bus;                        /* sorted by bus_no */
+    int        nbus;
+    int        bus_cap;
+    AuditEdit *pending;
+    int        npending;
+    int        pending_cap;
+} AuditLog;
+
+static AuditLog audit;
+
+typedef struct {
+    long long i;
+    float     f;
+    Date      d;
+    char      text[64];
+} AuditValue;
+
+typedef struct {
+    long       offset;
+    long       next;         /* offset just past this record */
+    time_t     when;
+    int        bus_no;
+    int        field;
+    long       bus_prev;     /* 0 = first record of its chain */
+    long       field_prev;
+    AuditValue old_value;
+    AuditValue new_value;
+} AuditEntry;
+
+static unsigned char *audit_put_varint(unsigned char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static int audit_get_varint(const unsigned char **p, const unsigned char *end,
+                            uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char c = *(*p)++;
+        x |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *v = x;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned char *audit_put_value(unsigned char *p, const AuditField *f,
+                                      const Bus *b) {
+    const char *src = (const char *)b + f->offset;
+    switch (f->kind) {
+        case AUDIT_INT: {
+            int v;
+            memcpy(&v, src, sizeof v);
+            /* 32-bit zigzag, so small negatives stay short */
+            return audit_put_varint(p, ((uint32_t)v << 1) ^ (0u - (uint32_t)(v < 0)));
+        }
+        case AUDIT_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, src, sizeof bits);
+            for (int k = 0; k < 4; k++) *p++ = (unsigned char)(bits >> (8 * k));
+            return p;
+        }
+        case AUDIT_DATE: {
+            Date d;
+            memcpy(&d, src, sizeof d);
+            if (!is_valid_date(d)) return audit_put_varint(p, 0);
+            return audit_put_varint(p, ((uint64_t)d.year * 16 + (uint64_t)d.month) * 32 +
+                                       (uint64_t)d.day);
+        }
+        default: {
+            size_t len = 0;
+            while (len < f->size && src[len]) len++;
+            p = audit_put_varint(p, len);
+            memcpy(p, src, len);
+            return p + len;
+        }
+    }
+}
+
+static int audit_get_value(const unsigned char **p, const unsigned char *end,
+                           AuditKind kind, AuditValue *v) {
+    uint64_t x;
+    memset(v, 0, sizeof *v);
+    switch (kind) {
+        case AUDIT_INT:
+            if (!audit_get_varint(p, end, &x)) return 0;
+            /* Only the low 32 bits: older logs sign-extended negatives to
+               64 bits, and those decode to the same value this way. */
+            v->i = (int32_t)(((uint32_t)x >> 1) ^ (0u - ((uint32_t)x & 1u)));
+            return 1;
+        case AUDIT_FLOAT: {
+            if (end - *p < 4) return 0;
+            uint32_t bits = 0;
+            for (int k = 0; k < 4; k++) bits |= (uint32_t)(*p)[k] << (8 * k);
+            memcpy(&v->f, &bits, sizeof v->f);
+            *p += 4;
+            return 1;
+        }
+        case AUDIT_DATE:
+            if (!audit_get_varint(p, end, &x)) return 0;
+            v->d.day = (int)(x % 32);
+            v->d.month = (int)(x / 32 % 16);
+            v->d.year = (int)(x / 512);
+            return 1;
+        default:
+            if (!audit_get_varint(p, end, &x) || x >= sizeof v->text ||
+                (uint64_t)(end - *p) < x) return 0;
+            memcpy(v->text, *p, (size_t)x);
+            v->text[x] = '\0';
+            *p += x;
+            return 1;
+    }
+}
+
+/* Reads the record at offset; 0 at end of file or on a torn/garbled one. */
+static int audit_read_entry(FILE *fp, long offset, AuditEntry *e) {
+    unsigned char buf[AUDIT_RECORD_MAX];
+    if (fseek(fp, offset, SEEK_SET) != 0) return 0;
+    size_t got = fread(buf, 1, sizeof buf, fp);
+    const unsigned char *p = buf, *end = buf + got;
+    uint64_t len, when, bus_no, bus_back, field_back;
+
+    if (!audit_get_varint(&p, end, &len) || len > (uint64_t)(end - p)) return 0;
+    end = p + len;
+    if (!audit_get_varint(&p, end, &when) || !audit_get_varint(&p, end, &bus_no) ||
+        p >= end) return 0;
+    e->field = *p++;
+    if (e->field >= AUDIT_NFIELDS ||
+        !audit_get_varint(&p, end, &bus_back) ||
+        !audit_get_varint(&p, end, &field_back) ||
+        bus_back > (uint64_t)offset || field_back > (uint64_t)offset) return 0;
+    AuditKind kind = audit_fields[e->field].kind;
+    if (!audit_get_value(&p, end, kind, &e->old_value) ||
+        !audit_get_value(&p, end, kind, &e->new_value) || p != end) return 0;
+
+    e->offset = offset;
+    e->next = offset + (long)(end - buf);
+    e->when = (time_t)when;
+    e->bus_no = (int)bus_no;
+    e->bus_prev = bus_back ? offset - (long)bus_back : 0;
+    e->field_prev = field_back ? offset - (long)field_back : 0;
+    return 1;
+}
+
+static AuditHead *audit_bus_head(int bus_no, int create) {
+    int lo = 0, hi = audit.nbus;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (audit.bus[mid].bus_no < bus_no) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < audit.nbus && audit.bus[lo].bus_no == bus_no) return &audit.bus[lo];
+    if (!create) return NULL;
+    if (audit.nbus >= audit.bus_cap) {
+        int new_cap = (audit.bus_cap == 0) ? 64 : audit.bus_cap * 2;
+        AuditHead *tmp = realloc(audit.bus, (size_t)new_cap * sizeof *tmp);
+        if (!tmp) return NULL;
+        audit.bus = tmp;
+        audit.bus_cap = new_cap;
+    }
+    memmove(&audit.bus[lo + 1], &audit.bus[lo],
+            (size_t)(audit.nbus - lo) * sizeof *audit.bus);
+    audit.nbus++;
+    audit.bus[lo].bus_no = bus_no;
+    audit.bus[lo].head = 0;
+    return &audit.bus[lo];
+}
+
+static void audit_reset_heads(void) {
+    audit.size = AUDIT_MAGIC_LEN;
+    memset(audit.field_head, 0, sizeof audit.field_head);
+    audit.nbus = 0;
+}
+
+static int audit_load_index(const char *filename) {
+    char magic[AUDIT_MAGIC_LEN];
+    int nfields = 0, nbus = 0;
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return 0;
+    int ok = fread(magic, sizeof magic, 1, fp) == 1 &&
+             memcmp(magic, AUDIT_INDEX_MAGIC, sizeof magic) == 0 &&
+             fread(&nfields, sizeof nfields, 1, fp) == 1 &&
+             nfields == AUDIT_NFIELDS &&
+             fread(&audit.size, sizeof audit.size, 1, fp) == 1 &&
+             fread(audit.field_head, sizeof audit.field_head, 1, fp) == 1 &&
+             fread(&nbus, sizeof nbus, 1, fp) == 1 && nbus >= 0;
+    if (ok && nbus > audit.bus_cap) {
+        AuditHead *tmp = realloc(audit.bus, (size_t)nbus * sizeof *tmp);
+        if (tmp) {
+            audit.bus = tmp;
+            audit.bus_cap = nbus;
+        } else {
+            ok = 0;
+        }
+    }
+    if (ok) ok = fread(audit.bus, sizeof *audit.bus, (size_t)nbus, fp) == (size_t)nbus;
+    fclose(fp);
+    audit.nbus = ok ? nbus : 0;
+    return ok;
+}
+
+static int audit_save_index(const char *filename) {
+    char tmp_name[512];
+    int nfields = AUDIT_NFIELDS;
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+    FILE *fp = fopen(tmp_name, "wb");
+    if (!fp) return -1;
+    int failed = fwrite(AUDIT_INDEX_MAGIC, AUDIT_MAGIC_LEN, 1, fp) != 1 ||
+                 fwrite(&nfields, sizeof nfields, 1, fp) != 1 ||
+                 fwrite(&audit.size, sizeof audit.size, 1, fp) != 1 ||
+                 fwrite(audit.field_head, sizeof audit.field_head, 1, fp) != 1 ||
+                 fwrite(&audit.nbus, sizeof audit.nbus, 1, fp) != 1 ||
+                 fwrite(audit.bus, sizeof *audit.bus, (size_t)audit.nbus, fp) !=
+                     (size_t)audit.nbus;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Follows the records in fp past audit.size that the heads have not seen
+   yet, e.g. ones another process appended. A torn record at the tail ends
+   the log; the next append overwrites it. Returns 0 (with the heads
+   reset) if fp is not an audit log. */
+static int audit_catch_up(FILE *fp) {
+    char magic[AUDIT_MAGIC_LEN];
+    if (fseek(fp, 0, SEEK_SET) != 0 || fread(magic, sizeof magic, 1, fp) != 1 ||
+        memcmp(magic, AUDIT_MAGIC, sizeof magic) != 0) {
+        audit_reset_heads();
+        return 0;
+    }
+    long end = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    if (audit.size > end) audit_reset_heads();
+
+    AuditEntry e;
+    while (audit.size < end && audit_read_entry(fp, audit.size, &e)) {
+        AuditHead *h = audit_bus_head(e.bus_no, 1);
+        if (h) h->head = e.offset;
+        audit.field_head[e.field] = e.offset;
+        audit.size = e.next;
+    }
+    return 1;
+}
+
+/* Loads the chain heads, then follows any records the index has not seen. */
+void audit_open(const char *log_file, const char *index_file) {
+    audit.npending = 0;
+    if (!audit_load_index(index_file)) audit_reset_heads();
+
+    FILE *fp = fopen(log_file, "rb");
+    if (!fp) {
+        audit_reset_heads();
+        return;
+    }
+    audit_catch_up(fp);
+    fclose(fp);
+}
+
+/* Queues the fields that differ between two versions of one bus. */
+void audit_record(const Bus *before, const Bus *after) {
+    if (audit.npending >= audit.pending_cap) {
+        int new_cap = (audit.pending_cap == 0) ? 16 : audit.pending_cap * 2;
+        AuditEdit *tmp = realloc(audit.pending, (size_t)new_cap * sizeof *tmp);
+        if (!tmp) return;
+        audit.pending = tmp;
+        audit.pending_cap = new_cap;
+    }
+    AuditEdit *e = &audit.pending[audit.npending++];
+    e->when = time(NULL);
+    e->before = *before;
+    e->after = *after;
+}
+
+/* Appends queued edits to the log and rewrites the index; call after a
+   successful save. Records are filed under the bus number the bus had
+   before the edit. Other processes (command-line edits, other --shared
+   terminals) append to the same log, so this locks it and first follows
+   whatever they added since audit_open. */
+int audit_flush(const char *log_file, const char *index_file) {
+    if (audit.npending == 0) return 0;
+
+    FILE *fp = open_for_append_update(log_file);
+    if (!fp) return -1;
+    if (file_lock(fp) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    audit_catch_up(fp);
+
+    int failed = 0;
+    if (audit.size == AUDIT_MAGIC_LEN)
+        failed = fseek(fp, 0, SEEK_SET) != 0 ||
+                 fwrite(AUDIT_MAGIC, AUDIT_MAGIC_LEN, 1, fp) != 1;
+    if (!failed) failed = fseek(fp, audit.size, SEEK_SET) != 0;
+
+    long pos = audit.size;
+    for (int i = 0; i < audit.npending && !failed; i++) {
+        const AuditEdit *ed = &audit.pending[i];
+        for (int f = 0; f < AUDIT_NFIELDS && !failed; f++) {
+            const AuditField *af = &audit_fields[f];
+            const char *a = (const char *)&ed->before + af->offset;
+            const char *b = (const char *)&ed->after + af->offset;
+            if (af->kind == AUDIT_TEXT ? strncmp(a, b, af->size) == 0
+                                       : memcmp(a, b, af->size) == 0)
+                continue;
+
+            AuditHead *h = audit_bus_head(ed->before.bus_no, 1);
+            if (!h) { failed = 1; break; }
+            unsigned char body[AUDIT_RECORD_MAX], rec[AUDIT_RECORD_MAX + 10];
+            unsigned char *p = body;
+            p = audit_put_varint(p, (uint64_t)ed->when);
+            p = audit_put_varint(p, (uint64_t)(uint32_t)ed->before.bus_no);
+            *p++ = (unsigned char)f;
+            p = audit_put_varint(p, h->head ? (uint64_t)(pos - h->head) : 0);
+            p = audit_put_varint(p, audit.field_head[f]
+                                        ? (uint64_t)(pos - audit.field_head[f]) : 0);
+            p = audit_put_value(p, af, &ed->before);
+            p = audit_put_value(p, af, &ed->after);
+            unsigned char *r = audit_put_varint(rec, (uint64_t)(p - body));
+            memcpy(r, body, (size_t)(p - body));
+            r += p - body;
+
+            if (fwrite(rec, 1, (size_t)(r - rec), fp) != (size_t)(r - rec)) {
+                failed = 1;
+                break;
+            }
+            h->head = pos;
+            audit.field_head[f] = pos;
+            pos += (long)(r - rec);
+        }
+    }
+    if (!failed) failed = flush_to_disk(fp) != 0;
+    if (failed) {
+        /* drop the heads we advanced and re-read what actually landed */
+        file_unlock(fp);
+        fclose(fp);
+        audit_open(log_file, index_file);
+        return -1;
+    }
+    audit.size = pos;
+    audit.npending = 0;
+    /* The index too, before the next process may append. */
+    int rc = audit_save_index(index_file);
+    file_unlock(fp);
+    if (fclose(fp) != 0) rc = -1;
+    return rc;
+}
+
+static void print_audit_value(AuditKind kind, const AuditValue *v) {
+    switch (kind) {
+        case AUDIT_INT:   printf("%lld", v->i); break;
+        case AUDIT_FLOAT: printf("%.2f", v->f); break;
+        case AUDIT_DATE:
+            if (v->d.year == 0) printf("-");
+            else print_date(v->d);
+            break;
+        default:          printf("'%s'", v->text); break;
+    }
+}
+
+/* Lists edits newest first, following the bus chain when a bus is given
+   (bus_no > 0) and the field chain otherwise. [from, to) bounds the time;
+   to = 0 leaves it open. */
+int audit_query(const char *log_file, int bus_no, int field, time_t from, time_t to) {
+    long at;
+    if (bus_no > 0) {
+        AuditHead *h = audit_bus_head(bus_no, 0);
+        at = h ? h->head : 0;
+    } else {
+        at = audit.field_head[field];
+    }
+
+    FILE *fp = fopen(log_file, "rb");
+    if (!fp && at != 0) {
+        printf(COLOR_RED "Cannot open %s.\n" COLOR_RESET, log_file);
+        return -1;
+    }
+    int shown = 0;
+    AuditEntry e;
+    while (at != 0 && audit_read_entry(fp, at, &e)) {
+        if (e.when < from) break;
+        if ((to == 0 || e.when < to) && (field < 0 || e.field == field)) {
+            char stamp[32];
+            struct tm *lt = localtime(&e.when);
+            if (!lt || !strftime(stamp, sizeof stamp, "%Y-%m-%d %H:%M:%S", lt))
+                snprintf(stamp, sizeof stamp, "%lld", (long long)e.when);
+            AuditKind kind = audit_fields[e.field].kind;
+            printf("%s  bus %-7d %-22s ", stamp, e.bus_no, audit_fields[e.field].name);
+            print_audit_value(kind, &e.old_value);
+            printf(" -> ");
+            print_audit_value(kind, &e.new_value);
+            printf("\n");
+            shown++;
         }
+        at = (bus_no > 0) ? e.bus_prev : e.field_prev;
+    }
+    if (fp) fclose(fp);
+    printf(COLOR_CYAN "%d edit(s) found.\n" COLOR_RESET, shown);
+    return 0;
+}
+
+/* ---------- Undo / redo ---------- */
+
+/* Each menu mutation pushes one record holding only the bus it touched:
+   the record before and/or after the change and its position. Undo
+   applies the inverse, redo re-applies it, so memory grows with the
+   number of edits (one pair of Bus records each), not with fleet size,
+   and each step touches a single bus. Both directions go through the
+   change tracker like any other edit. A bulk edit or bulk delete is one
+   step holding an entry for each bus it touched. Positions are stored as
+   they were when the step was applied; undo and redo replay strictly in
+   order, so they stay exact. The history is per terminal, so with
+   --shared a step is refused if another terminal has since changed one
+   of its buses or taken its code or number. A new edit drops the redo
+   side; beyond UNDO_LIMIT steps the oldest are forgotten. */
+#define UNDO_LIMIT 256
+
+typedef enum {
+    UNDO_ADD,
+    UNDO_EDIT,
+    UNDO_DELETE,
+    UNDO_BULK_EDIT,
+    UNDO_BULK_DELETE
+} UndoKind;
+
+typedef struct {
+    int index;
+    Bus before;
+    Bus after;
+} UndoItem;
+
+typedef struct {
+    UndoKind  kind;
+    int       index;     /* position of the bus in the fleet */
+    Bus       before;    /* EDIT, DELETE */
+    Bus       after;     /* ADD, EDIT */
+    UndoItem *items;     /* BULK_*, owned by the record */
+    int       nitems;
+} UndoRecord;
+
+typedef struct {
+    UndoRecord *recs;
+    int         count;   /* recorded steps */
+    int         top;     /* steps currently applied (redo = count - top) */
+    int         cap;
+} UndoStack;
+
+static UndoStack undo_stack;
+
+/* Drops the redo side and returns a cleared slot for a new step. */
+static UndoRecord *undo_new(UndoKind kind) {
+    UndoStack *u = &undo_stack;
+    while (u->count > u->top) free(u->recs[--u->count].items);
+    if (u->count == UNDO_LIMIT) {
+        free(u->recs[0].items);
+        memmove(u->recs, u->recs + 1, (UNDO_LIMIT - 1) * sizeof *u->recs);
+        u->count--;
+    }
+    if (u->count >= u->cap) {
+        int new_cap = (u->cap == 0) ? 16 : u->cap * 2;
+        UndoRecord *tmp = realloc(u->recs, (size_t)new_cap * sizeof *tmp);
+        if (!tmp) return NULL;
+        u->recs = tmp;
+        u->cap = new_cap;
+    }
+    UndoRecord *r = &u->recs[u->count++];
+    memset(r, 0, sizeof *r);
+    r->kind = kind;
+    u->top = u->count;
+    return r;
+}
+
+void undo_push(UndoKind kind, int index, const Bus *before, const Bus *after) {
+    UndoRecord *r = undo_new(kind);
+    if (!r) return;
+    r->index = index;
+    if (before) r->before = *before;
+    if (after) r->after = *after;
+}
+
+/* Takes ownership of items (malloc'd). */
+void undo_push_bulk(UndoKind kind, UndoItem *items, int nitems) {
+    UndoRecord *r = undo_new(kind);
+    if (!r) {
+        free(items);
+        return;
+    }
+    r->items = items;
+    r->nitems = nitems;
+}
+
+int undo_available(void) { return undo_stack.top; }
+int redo_available(void) { return undo_stack.count - undo_stack.top; }
+
+/* The recorded position, or wherever the bus is now if that moved; -1
+   if it is gone or no longer holds what the history expects (with
+   --shared another terminal may have edited it since). */
+static int undo_locate(Bus *fleet, int count, int index, const Bus *expect) {
+    int i = (index >= 0 && index < count && fleet[index].bus_no == expect->bus_no)
+                ? index : find_bus_index(fleet, count, expect->bus_no);
+    return (i >= 0 && bus_same_entry(&fleet[i], expect)) ? i : -1;
+}
+
+/* Nonzero if b can come back without duplicating a code or number. */
+static int undo_can_insert(Bus *fleet, int count, const Bus *b) {
+    return !bus_no_exists(fleet, count, b->bus_no, -1) &&
+           !bus_code_exists(fleet, count, b->bus_code, -1);
+}
+
+static int undo_insert(Bus **fleet_ptr, int *count, int *capacity, int index,
+                       const Bus *b) {
+    if (!undo_can_insert(*fleet_ptr, *count, b)) return 0;
+    if (*count >= *capacity) {
+        if (fleet_capacity_fixed) return 0;
+        int new_cap = (*capacity == 0) ? 4 : *capacity * 2;
+        Bus *tmp = realloc(*fleet_ptr, (size_t)new_cap * sizeof(Bus));
+        if (!tmp) return 0;
         *fleet_ptr = tmp;
         *capacity = new_cap;
     }
+    if (index > *count) index = *count;
+    memmove(&(*fleet_ptr)[index + 1], &(*fleet_ptr)[index],
+            (size_t)(*count - index) * sizeof(Bus));
+    (*fleet_ptr)[index] = *b;
+    (*count)++;
+    change_stamp(&(*fleet_ptr)[index]);
+    return 1;
+}
 
-    Bus *b = &((*fleet_ptr)[*count]);
-    char tmp[64];
+static int undo_remove(Bus *fleet, int *count, int index, const Bus *b) {
+    int i = undo_locate(fleet, *count, index, b);
+    if (i < 0) return 0;
+    memmove(&fleet[i], &fleet[i + 1], (size_t)(*count - i - 1) * sizeof(Bus));
+    (*count)--;
+    change_tombstone(b->bus_no);
+    return 1;
+}
 
-    /* Unique bus_code (case-insensitive, normalised to upper-case) */
-    while (1) {
-        printf("Enter bus code (e.g. CHD-101A): ");
-        if (!read_line_stdin(tmp, sizeof tmp) || tmp[0] == '\0') {
-            printf(COLOR_RED "Code cannot be empty.\n" COLOR_RESET);
+static int undo_replace(Bus *fleet, int count, int index, const Bus *from,
+                        const Bus *to) {
+    int i = undo_locate(fleet, count, index, from);
+    if (i < 0) return 0;
+    if (to->bus_no != from->bus_no && bus_no_exists(fleet, count, to->bus_no, i)) return 0;
+    if (bus_code_exists(fleet, count, to->bus_code, i)) return 0;
+    audit_record(&fleet[i], to);
+    fleet[i] = *to;
+    if (to->bus_no != from->bus_no) change_tombstone(from->bus_no);
+    change_stamp(&fleet[i]);
+    return 1;
+}
+
+/* Removes every marked position in one stable pass, tombstoning each
+   removed bus and, if removed is given, copying it there with its old
+   position (in ascending order). Unmarked 64-bus stretches move as one
+   block. Returns the number removed. */
+int fleet_remove_marked(Bus *fleet, int *count, const uint64_t *marked,
+                        UndoItem *removed) {
+    int n = *count, j = 0, k = 0;
+    for (int lo = 0; lo < n; lo += 64) {
+        int hi = (lo + 64 < n) ? lo + 64 : n;
+        uint64_t m = marked[lo >> 6];
+        if (m == 0) {
+            if (j != lo) memmove(&fleet[j], &fleet[lo], (size_t)(hi - lo) * sizeof(Bus));
+            j += hi - lo;
             continue;
         }
-        to_upper_str(tmp);
-        if (bus_code_exists(*fleet_ptr, *count, tmp, -1)) {
-            printf(COLOR_RED
-                   "This bus code already exists (case-insensitive). Please enter a different code.\n"
-                   COLOR_RESET);
-            continue;
+        for (int i = lo; i < hi; i++) {
+            if ((m >> (i & 63)) & 1) {
+                if (removed) {
+                    removed[k].index = i;
+                    removed[k].before = fleet[i];
+                }
+                change_tombstone(fleet[i].bus_no);
+                k++;
+            } else {
+                if (j != i) fleet[j] = fleet[i];
+                j++;
+            }
+        }
+    }
+    *count = j;
+    return k;
+}
+
+/* Inverse of fleet_remove_marked: merges items (ascending old positions)
+   back in with one pass from the end. */
+static int fleet_reinsert(Bus **fleet_ptr, int *count, int *capacity,
+                          const UndoItem *items, int nitems) {
+    int total = *count + nitems;
+    for (int k = 0; k < nitems; k++) {
+        if (!undo_can_insert(*fleet_ptr, *count, &items[k].before)) return 0;
+    }
+    if (total > *capacity) {
+        if (fleet_capacity_fixed) return 0;
+        Bus *tmp = realloc(*fleet_ptr, (size_t)total * sizeof(Bus));
+        if (!tmp) return 0;
+        *fleet_ptr = tmp;
+        *capacity = total;
+    }
+    Bus *fleet = *fleet_ptr;
+    int src = *count - 1, k = nitems - 1;
+    for (int pos = total - 1; pos >= 0; pos--) {
+        if (k >= 0 && (items[k].index >= pos || src < 0)) {
+            fleet[pos] = items[k--].before;
+            change_stamp(&fleet[pos]);
+        } else {
+            fleet[pos] = fleet[src--];
+        }
+    }
+    *count = total;
+    return 1;
+}
+
+/* Redo of a bulk delete: the fleet is back in its pre-delete state, so
+   every item is found at its recorded position. */
+static int fleet_redo_remove(Bus *fleet, int *count, const UndoItem *items,
+                             int nitems) {
+    uint64_t *marked = calloc(BITMAP_WORDS(*count) + 1, sizeof *marked);
+    if (!marked) return 0;
+    for (int k = 0; k < nitems; k++) {
+        int i = undo_locate(fleet, *count, items[k].index, &items[k].before);
+        if (i < 0) {
+            free(marked);
+            return 0;
+        }
+        bitmap_set(marked, i);
+    }
+    fleet_remove_marked(fleet, count, marked, NULL);
+    free(marked);
+    return 1;
+}
+
+/* Steps back (redo = 0) or forward (redo = 1) one change. */
+int undo_step(Bus **fleet_ptr, int *count, int *capacity, int redo) {
+    UndoStack *u = &undo_stack;
+    if (redo ? u->top >= u->count : u->top <= 0) {
+        printf(COLOR_YELLOW "Nothing to %s.\n" COLOR_RESET, redo ? "redo" : "undo");
+        return 0;
+    }
+    UndoRecord *r = &u->recs[redo ? u->top : u->top - 1];
+    int ok;
+    switch (r->kind) {
+        case UNDO_ADD:
+            ok = redo ? undo_insert(fleet_ptr, count, capacity, r->index, &r->after)
+                      : undo_remove(*fleet_ptr, count, r->index, &r->after);
+            break;
+        case UNDO_DELETE:
+            ok = redo ? undo_remove(*fleet_ptr, count, r->index, &r->before)
+                      : undo_insert(fleet_ptr, count, capacity, r->index, &r->before);
+            break;
+        case UNDO_BULK_EDIT:
+            /* All or nothing: check every bus before touching any. */
+            ok = 1;
+            for (int k = 0; k < r->nitems && ok; k++) {
+                const UndoItem *it = &r->items[k];
+                ok = undo_locate(*fleet_ptr, *count, it->index,
+                                 redo ? &it->before : &it->after) >= 0;
+            }
+            for (int k = 0; k < r->nitems && ok; k++) {
+                const UndoItem *it = &r->items[redo ? k : r->nitems - 1 - k];
+                ok &= redo ? undo_replace(*fleet_ptr, *count, it->index, &it->before, &it->after)
+                           : undo_replace(*fleet_ptr, *count, it->index, &it->after, &it->before);
+            }
+            break;
+        case UNDO_BULK_DELETE:
+            ok = redo ? fleet_redo_remove(*fleet_ptr, count, r->items, r->nitems)
+                      : fleet_reinsert(fleet_ptr, count, capacity, r->items, r->nitems);
+            break;
+        default:
+            ok = redo ? undo_replace(*fleet_ptr, *count, r->index, &r->before, &r->after)
+                      : undo_replace(*fleet_ptr, *count, r->index, &r->after, &r->before);
+            break;
+    }
+    if (!ok) {
+        printf(COLOR_RED "Could not %s: the fleet no longer matches the history.\n"
+               COLOR_RESET, redo ? "redo" : "undo");
+        return 0;
+    }
+
+    static const char *what[] = {"add", "edit", "delete", "bulk edit", "bulk delete"};
+    const Bus *b = (r->kind == UNDO_DELETE) ? &r->before : &r->after;
+    u->top += redo ? 1 : -1;
+    printf(COLOR_GREEN "%s %s of ", redo ? "Redid" : "Undid", what[r->kind]);
+    if (r->items) printf("%d buses", r->nitems);
+    else printf("bus %d", b->bus_no);
+    printf(". (%d undo / %d redo left)\n" COLOR_RESET,
+           undo_available(), redo_available());
+    return 1;
+}
+
+/* ---------- Fleet lock ---------- */
+
+/* Menu commands ask for all their input first and hold the fleet lock
+   only while they change the fleet, so a user sitting at a prompt never
+   holds up the autosave or standby threads (which take the same lock to
+   copy the fleet) or, with --shared, other terminals. main() installs
+   the hooks; without them these calls do nothing. */
+typedef struct {
+    void     (*write_begin)(void *ctx, int *count);
+    void     (*write_end)(void *ctx, Bus *fleet, int count);
+    uint64_t (*read_begin)(void *ctx, int *count);
+    int      (*read_changed)(void *ctx, uint64_t seen);
+    void      *ctx;
+} FleetLock;
+
+static FleetLock fleet_lock;
+
+/* *count is refreshed: another terminal may have changed the fleet. */
+void fleet_write_begin(int *count) {
+    if (fleet_lock.write_begin) fleet_lock.write_begin(fleet_lock.ctx, count);
+}
+
+void fleet_write_end(Bus *fleet, int count) {
+    if (fleet_lock.write_end) fleet_lock.write_end(fleet_lock.ctx, fleet, count);
+}
+
+/* For readers that take no lock: read, then retry if this says so. */
+uint64_t fleet_read_begin(int *count) {
+    return fleet_lock.read_begin ? fleet_lock.read_begin(fleet_lock.ctx, count) : 0;
+}
+
+int fleet_read_changed(uint64_t seen) {
+    return fleet_lock.read_changed ? fleet_lock.read_changed(fleet_lock.ctx, seen) : 0;
+}
+
+/* With the lock held: where `before` (read at prompt time from position
+   idx) is now, or -1 if it has since been changed or deleted. */
+int fleet_locate_unchanged(Bus *fleet, int count, int idx, const Bus *before) {
+    int i = (idx < count && fleet[idx].bus_no == before->bus_no)
+                ? idx : find_bus_index(fleet, count, before->bus_no);
+    if (i < 0 || fleet[i].change_seq != before->change_seq) {
+        printf(COLOR_RED "Bus %d was changed or deleted meanwhile; nothing saved.\n"
+               COLOR_RESET, before->bus_no);
+        return -1;
+    }
+    return i;
+}
+
+/* ---------- Edit by position ---------- */
+
+int choose_bus_position(Bus *fleet, int count) {
+    if (count == 0) {
+        printf(COLOR_YELLOW "No buses available to select.\n" COLOR_RESET);
+        return -1;
+    }
+
+    printf("\nAvailable buses (positions):\n");
+    printf("Pos | BusNo | Code        | Driver\n");
+    printf("----+-------+-------------+----------------\n");
+    for (int i = 0; i < count; i++) {
+        printf("%-3d | %-5d | %-11.11s | %-16.16s\n",
+               i + 1,
+               fleet[i].bus_no,
+               fleet[i].bus_code,
+               fleet[i].driver_name);
+    }
+
+    int pos = read_int_strict("\nEnter position: ", 1, count);
+    return pos - 1;
+}
+
+void edit_bus_by_position(Bus *fleet, int count) {
+    int idx = choose_bus_position(fleet, count);
+    if (idx < 0) return;
+
+    Bus before = fleet[idx];
+    Bus edited = before;
+    Bus *b = &edited;
+    printf(COLOR_CYAN "Editing position %d (Bus %d, %s)\n"
+           COLOR_RESET, idx + 1, b->bus_no, b->bus_code);
+
+    char tmp[64];
+
+    /* Unique bus_code (allow keeping same, case-insensitive) */
+    while (1) {
+        printf("Enter new bus code (leave empty to keep '%s'): ",
+               b->bus_code);
+        if (!read_line_stdin(tmp, sizeof tmp))
+            continue;
+        if (tmp[0] == '\0') {
+            /* keep old */
+            break;
+        }
+        to_upper_str(tmp);
+        if (bus_code_exists(fleet, count, tmp, idx)) {
+            printf(COLOR_RED
+                   "This bus code already exists (case-insensitive). Please enter a different code.\n"
+                   COLOR_RESET);
+            continue;
+        }
+        strncpy(b->bus_code, tmp, sizeof b->bus_code - 1);
+        b->bus_code[sizeof b->bus_code - 1] = '\0';
+        break;
+    }
+
+    /* Unique bus_no (allow keeping same) */
+    while (1) {
+        int new_no = read_int_strict(
+            "Enter new numeric bus number (or same as before): ",
+            1, 9999999);
+        if (bus_no_exists(fleet, count, new_no, idx)) {
+            printf(COLOR_RED
+                   "This bus number already exists. Please enter a different number.\n"
+                   COLOR_RESET);
+            continue;
+        }
+        b->bus_no = new_no;
+        break;
+    }
+
+    read_driver_name(b->driver_name, sizeof b->driver_name);
+
+    b->last_service = read_date("Enter new last service date (dd/mm/yyyy): ");
+
+    b->last_service_mileage =
+        read_float_strict("Enter new last service mileage (km): ",
+                          0.0f, 100000.0f);
+
+    b->current_mileage =
+        read_float_strict("Enter new current mileage (km): ",
+                          0.0f, 100000.0f);
+
+    b->service_interval_km =
+        read_float_strict("Enter new service interval (km): ",
+                          1.0f, 100000.0f);
+
+    b->service_interval_days =
+        read_int_strict("Enter new service interval in days (0 if not used): ",
+                        0, 5000);
+
+    b->avg_daily_km =
+        read_float_strict("Enter new average daily km: ",
+                          0.0f, 100000.0f);
+
+    b->fuel_efficiency =
+        read_float_strict("Enter new fuel efficiency (km/l): ",
+                          0.0f, 100.0f);
+
+    b->service_history_count =
+        read_int_strict("Enter new service history count: ",
+                        0, 1500);
+
+    fleet_write_begin(&count);
+    int i = fleet_locate_unchanged(fleet, count, idx, &before);
+    if (i >= 0 && (bus_code_exists(fleet, count, b->bus_code, i) ||
+                   bus_no_exists(fleet, count, b->bus_no, i))) {
+        printf(COLOR_RED "Bus code or number was taken meanwhile; nothing saved.\n"
+               COLOR_RESET);
+        i = -1;
+    }
+    if (i >= 0) {
+        fleet[i] = edited;
+        if (fleet[i].bus_no != before.bus_no) change_tombstone(before.bus_no);
+        change_stamp(&fleet[i]);
+        undo_push(UNDO_EDIT, i, &before, &fleet[i]);
+        audit_record(&before, &fleet[i]);
+    }
+    fleet_write_end(fleet, count);
+    if (i >= 0) printf(COLOR_GREEN "Bus at position %d updated.\n" COLOR_RESET, i + 1);
+}
+
+/* ---------- Add / update / delete ---------- */
+
+/* Grows the fleet array for one more bus; call with the fleet lock held. */
+static int fleet_make_room(Bus **fleet_ptr, int count, int *capacity) {
+    if (count < *capacity) return 1;
+    if (fleet_capacity_fixed) {
+        printf(COLOR_RED "The shared fleet is full (%d buses).\n" COLOR_RESET,
+               *capacity);
+        return 0;
+    }
+    int new_cap = (*capacity == 0) ? 4 : (*capacity * 2);
+    Bus *tmp = realloc(*fleet_ptr, new_cap * sizeof(Bus));
+    if (!tmp) {
+        printf(COLOR_RED "Memory allocation failed while adding bus.\n"
+               COLOR_RESET);
+        return 0;
+    }
+    *fleet_ptr = tmp;
+    *capacity = new_cap;
+    return 1;
+}
+
+/* Prompts for a new bus whose code and number are not yet in fleet. */
+void read_new_bus(Bus *fleet, int count, Bus *b) {
+    char tmp[64];
+    memset(b, 0, sizeof *b);
+
+    /* Unique bus_code (case-insensitive, normalised to upper-case) */
+    while (1) {
+        printf("Enter bus code (e.g. CHD-101A): ");
+        if (!read_line_stdin(tmp, sizeof tmp) || tmp[0] == '\0') {
+            printf(COLOR_RED "Code cannot be empty.\n" COLOR_RESET);
+            continue;
+        }
+        to_upper_str(tmp);
+        if (bus_code_exists(fleet, count, tmp, -1)) {
+            printf(COLOR_RED
+                   "This bus code already exists (case-insensitive). Please enter a different code.\n"
+                   COLOR_RESET);
+            continue;
+        }
+        strncpy(b->bus_code, tmp, sizeof b->bus_code - 1);
+        b->bus_code[sizeof b->bus_code - 1] = '\0';
+        break;
+    }
+
+    /* Unique bus_no */
+    while (1) {
+        int no = read_int_strict("Enter numeric bus number: ", 1, 9999999);
+        if (bus_no_exists(fleet, count, no, -1)) {
+            printf(COLOR_RED
+                   "This bus number already exists. Please enter a different number.\n"
+                   COLOR_RESET);
+            continue;
+        }
+        b->bus_no = no;
+        break;
+    }
+
+    read_driver_name(b->driver_name, sizeof b->driver_name);
+
+    b->last_service = read_date("Enter last service date (dd/mm/yyyy): ");
+
+    b->last_service_mileage =
+        read_float_strict("Enter last service mileage (km): ",
+                          0.0f, 100.0f);
+
+    b->current_mileage =
+        read_float_strict("Enter current mileage (km): ",
+                          0.0f, 100.0f);
+
+    b->service_interval_km =
+        read_float_strict("Enter service interval (km), e.g. 10000: ",
+                          1.0f, 100000.0f);
+
+    b->service_interval_days =
+        read_int_strict("Enter service interval in days (0 if not used): ",
+                        0, 5000);
+
+    b->avg_daily_km =
+        read_float_strict("Enter average daily km: ",
+                          0.0f, 100000.0f);
+
+    b->fuel_efficiency =
+        read_float_strict("Enter fuel efficiency (km/l): ",
+                          0.0f, 200.0f);
+
+    b->service_history_count =
+        read_int_strict("Enter service history count: ",
+                        0, 1500);
+
+    b->next_due.day = b->next_due.month = b->next_due.year = 0;
+    b->km_left = 0.0f;
+    b->status = STATUS_OK;
+    b->health_score = 100;
+}
+
+void add_bus(Bus **fleet_ptr, int *count, int *capacity) {
+    if (fleet_capacity_fixed && !fleet_make_room(fleet_ptr, *count, capacity)) return;
+
+    Bus added;
+    Bus *b = &added;
+    read_new_bus(*fleet_ptr, *count, b);
+
+    fleet_write_begin(count);
+    int ok = !bus_code_exists(*fleet_ptr, *count, b->bus_code, -1) &&
+             !bus_no_exists(*fleet_ptr, *count, b->bus_no, -1);
+    if (!ok) {
+        printf(COLOR_RED "Bus code or number was taken meanwhile; nothing saved.\n"
+               COLOR_RESET);
+    } else if ((ok = fleet_make_room(fleet_ptr, *count, capacity))) {
+        b = &(*fleet_ptr)[*count];
+        *b = added;
+        change_stamp(b);
+        undo_push(UNDO_ADD, *count, NULL, b);
+        (*count)++;
+    }
+    fleet_write_end(*fleet_ptr, *count);
+    if (ok) printf(COLOR_GREEN "Bus added. Total buses: %d\n" COLOR_RESET, *count);
+}
+
+void update_mileage(Bus *fleet, int count) {
+    int bus_no = read_int_strict("Enter bus number to update mileage: ",
+                                 1, 9999999);
+
+    int idx = find_bus_index(fleet, count, bus_no);
+    if (idx == -1) {
+        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+        return;
+    }
+
+    Bus before = fleet[idx];
+    printf("Current mileage for bus %d: %.1f km\n",
+           before.bus_no, before.current_mileage);
+    float km = read_float_strict("Enter new current mileage (km): ",
+                                 0.0f, 100000000.0f);
+
+    fleet_write_begin(&count);
+    int i = fleet_locate_unchanged(fleet, count, idx, &before);
+    if (i >= 0) {
+        Bus *b = &fleet[i];
+        b->current_mileage = km;
+        change_stamp(b);
+        undo_push(UNDO_EDIT, i, &before, b);
+        audit_record(&before, b);
+    }
+    fleet_write_end(fleet, count);
+    if (i >= 0) printf(COLOR_GREEN "Mileage updated.\n" COLOR_RESET);
+}
+
+void delete_bus(Bus *fleet, int *count) {
+    int bus_no = read_int_strict("Enter bus number to delete: ",
+                                 1, 9999999);
+
+    fleet_write_begin(count);
+    int idx = find_bus_index(fleet, *count, bus_no);
+    if (idx != -1) {
+        undo_push(UNDO_DELETE, idx, &fleet[idx], NULL);
+        for (int i = idx; i < *count - 1; i++) {
+            fleet[i] = fleet[i + 1];
+        }
+        (*count)--;
+        change_tombstone(bus_no);
+    }
+    fleet_write_end(fleet, *count);
+
+    if (idx == -1) {
+        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+        return;
+    }
+    printf(COLOR_YELLOW "Bus deleted. Remaining: %d\n" COLOR_RESET, *count);
+}
+
+/* ---------- Bulk edit ---------- */
+
+/* "SET field=value[, field=value...] WHERE field OP value [AND ...]",
+   with OP one of = != < <= > >= (and ^= "starts with" for text), and
+   "WHERE ALL" matching every bus.
+   Field names are the audit field names; the "service_" prefix may be
+   left out. Text values may be double-quoted, dates are dd/mm/yyyy and
+   text compares ignore case. Each WHERE clause is evaluated over the
+   whole fleet as one pass over that field into a match mask, then the
+   assignments are applied to the matching buses. The whole batch is one
+   undo step. bus_no and bus_code must stay unique, so they can be
+   filtered on but not assigned. */
+#define BULK_MAX_TERMS 16
+
+typedef enum {
+    CMP_EQ,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+    CMP_PREFIX
+} CmpOp;
+
+typedef struct {
+    int        field;
+    CmpOp      op;
+    AuditValue value;
+} BulkTerm;
+
+typedef struct {
+    BulkTerm set[BULK_MAX_TERMS];
+    int      nset;
+    BulkTerm where[BULK_MAX_TERMS];
+    int      nwhere;     /* 0 = every bus */
+} BulkEdit;
+
+static void bulk_skip_ws(const char **p) {
+    while (isspace((unsigned char)**p)) (*p)++;
+}
+
+/* Consumes keyword kw (any case) if it is the next whole word. */
+static int bulk_keyword(const char **p, const char *kw) {
+    size_t n = strlen(kw);
+    bulk_skip_ws(p);
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)(*p)[i]) != kw[i]) return 0;
+    }
+    if (isalnum((unsigned char)(*p)[n]) || (*p)[n] == '_') return 0;
+    *p += n;
+    return 1;
+}
+
+static int bulk_field(const char **p) {
+    char name[48];
+    size_t n = 0;
+    bulk_skip_ws(p);
+    while ((isalnum((unsigned char)**p) || **p == '_') && n < sizeof name - 1)
+        name[n++] = (char)tolower((unsigned char)*(*p)++);
+    name[n] = '\0';
+    for (int f = 0; f < AUDIT_NFIELDS; f++) {
+        const char *fn = audit_fields[f].name;
+        if (strcmp(name, fn) == 0 ||
+            (strncmp(fn, "service_", 8) == 0 && strcmp(name, fn + 8) == 0))
+            return f;
+    }
+    printf(COLOR_RED "Unknown field '%s'.\n" COLOR_RESET, name);
+    return -1;
+}
+
+static int bulk_op(const char **p, CmpOp *op) {
+    bulk_skip_ws(p);
+    const char *s = *p;
+    if (s[0] == '!' && s[1] == '=') { *op = CMP_NE; *p += 2; }
+    else if (s[0] == '<' && s[1] == '>') { *op = CMP_NE; *p += 2; }
+    else if (s[0] == '<' && s[1] == '=') { *op = CMP_LE; *p += 2; }
+    else if (s[0] == '>' && s[1] == '=') { *op = CMP_GE; *p += 2; }
+    else if (s[0] == '^' && s[1] == '=') { *op = CMP_PREFIX; *p += 2; }
+    else if (s[0] == '<') { *op = CMP_LT; *p += 1; }
+    else if (s[0] == '>') { *op = CMP_GT; *p += 1; }
+    else if (s[0] == '=') { *op = CMP_EQ; *p += (s[1] == '=') ? 2 : 1; }
+    else {
+        printf(COLOR_RED "Expected a comparison at '%s'.\n" COLOR_RESET, s);
+        return 0;
+    }
+    return 1;
+}
+
+/* Reads one value for field f: a quoted string, or up to whitespace/','. */
+static int bulk_value(const char **p, int f, AuditValue *v) {
+    char tok[64];
+    size_t n = 0;
+    bulk_skip_ws(p);
+    if (**p == '"') {
+        (*p)++;
+        while (**p && **p != '"' && n < sizeof tok - 1) tok[n++] = *(*p)++;
+        if (**p != '"') {
+            printf(COLOR_RED "Unterminated or too long quoted value.\n" COLOR_RESET);
+            return 0;
+        }
+        (*p)++;
+    } else {
+        while (**p && !isspace((unsigned char)**p) && **p != ',' && n < sizeof tok - 1)
+            tok[n++] = *(*p)++;
+    }
+    tok[n] = '\0';
+
+    int ok;
+    memset(v, 0, sizeof *v);
+    switch (audit_fields[f].kind) {
+        case AUDIT_INT: {
+            int x = 0;
+            ok = parse_int_field(tok, &x);
+            v->i = x;
+            break;
+        }
+        case AUDIT_FLOAT: ok = parse_float_field(tok, &v->f); break;
+        case AUDIT_DATE:  ok = parse_date_arg(tok, &v->d); break;
+        default:
+            ok = n > 0 && n < audit_fields[f].size && !strchr(tok, '|');
+            memcpy(v->text, tok, n + 1);
+            break;
+    }
+    if (!ok) {
+        printf(COLOR_RED "Invalid value '%s' for %s.\n" COLOR_RESET,
+               tok, audit_fields[f].name);
+    }
+    return ok;
+}
+
+/* Same limits as the interactive editor. */
+static int bulk_assign_ok(int f, const AuditValue *v) {
+    size_t off = audit_fields[f].offset;
+    if (off == offsetof(Bus, bus_no) || off == offsetof(Bus, bus_code)) {
+        printf(COLOR_RED "%s must stay unique; edit it per bus.\n" COLOR_RESET,
+               audit_fields[f].name);
+        return 0;
+    }
+    int ok = 1;
+    if (off == offsetof(Bus, service_interval_km))
+        ok = v->f >= 1.0f && v->f <= 100000.0f;
+    else if (off == offsetof(Bus, fuel_efficiency))
+        ok = v->f >= 0.0f && v->f <= 100.0f;
+    else if (off == offsetof(Bus, service_interval_days))
+        ok = v->i >= 0 && v->i <= 5000;
+    else if (off == offsetof(Bus, service_history_count))
+        ok = v->i >= 0 && v->i <= 1500;
+    else if (off == offsetof(Bus, driver_name))
+        ok = !is_all_digits(v->text);
+    else if (audit_fields[f].kind == AUDIT_FLOAT)
+        ok = v->f >= 0.0f && v->f <= 100000.0f;
+    if (!ok) {
+        printf(COLOR_RED "Value out of range for %s.\n" COLOR_RESET,
+               audit_fields[f].name);
+    }
+    return ok;
+}
+
+/* Parses "WHERE ..." up to the end of the text into be->where. */
+static int parse_bulk_where(const char *p, BulkEdit *be) {
+    if (!bulk_keyword(&p, "where")) {
+        printf(COLOR_RED "Missing WHERE clause (use WHERE ALL for every bus).\n"
+               COLOR_RESET);
+        return 0;
+    }
+    if (!bulk_keyword(&p, "all")) {
+        do {
+            if (be->nwhere == BULK_MAX_TERMS) {
+                printf(COLOR_RED "Too many conditions.\n" COLOR_RESET);
+                return 0;
+            }
+            BulkTerm *t = &be->where[be->nwhere++];
+            if ((t->field = bulk_field(&p)) < 0 || !bulk_op(&p, &t->op) ||
+                !bulk_value(&p, t->field, &t->value)) return 0;
+            if (t->op == CMP_PREFIX && audit_fields[t->field].kind != AUDIT_TEXT) {
+                printf(COLOR_RED "'^=' only applies to text fields.\n" COLOR_RESET);
+                return 0;
+            }
+        } while (bulk_keyword(&p, "and"));
+    }
+    bulk_skip_ws(&p);
+    if (*p) {
+        printf(COLOR_RED "Unexpected '%s'.\n" COLOR_RESET, p);
+        return 0;
+    }
+    return 1;
+}
+
+int parse_bulk_edit(const char *text, BulkEdit *be) {
+    const char *p = text;
+    memset(be, 0, sizeof *be);
+
+    bulk_keyword(&p, "set");
+    do {
+        if (be->nset == BULK_MAX_TERMS) {
+            printf(COLOR_RED "Too many assignments.\n" COLOR_RESET);
+            return 0;
+        }
+        BulkTerm *t = &be->set[be->nset++];
+        CmpOp op;
+        if ((t->field = bulk_field(&p)) < 0 || !bulk_op(&p, &op)) return 0;
+        if (op != CMP_EQ) {
+            printf(COLOR_RED "Assignments use '='.\n" COLOR_RESET);
+            return 0;
+        }
+        if (!bulk_value(&p, t->field, &t->value) ||
+            !bulk_assign_ok(t->field, &t->value)) return 0;
+        bulk_skip_ws(&p);
+    } while (*p == ',' && p++);
+
+    return parse_bulk_where(p, be);
+}
+
+static int cmp_holds(CmpOp op, int c) {
+    switch (op) {
+        case CMP_EQ: return c == 0;
+        case CMP_NE: return c != 0;
+        case CMP_LT: return c < 0;
+        case CMP_LE: return c <= 0;
+        case CMP_GT: return c > 0;
+        default:     return c >= 0;
+    }
+}
+
+static int text_icmp(const char *a, const char *b) {
+    while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) {
+        a++;
+        b++;
+    }
+    return tolower((unsigned char)*a) - tolower((unsigned char)*b);
+}
+
+/* ANDs one clause into mask, reading a single field across the fleet. */
+static void bulk_filter(const Bus *fleet, int count, const BulkTerm *t,
+                        unsigned char *mask) {
+    const AuditField *f = &audit_fields[t->field];
+    switch (f->kind) {
+        case AUDIT_INT: {
+            long long x = t->value.i;
+            for (int i = 0; i < count; i++) {
+                int v;
+                memcpy(&v, (const char *)&fleet[i] + f->offset, sizeof v);
+                mask[i] &= (unsigned char)cmp_holds(t->op, (v > x) - (v < x));
+            }
+            break;
+        }
+        case AUDIT_FLOAT: {
+            float x = t->value.f;
+            for (int i = 0; i < count; i++) {
+                float v;
+                memcpy(&v, (const char *)&fleet[i] + f->offset, sizeof v);
+                mask[i] &= (unsigned char)cmp_holds(t->op, (v > x) - (v < x));
+            }
+            break;
+        }
+        case AUDIT_DATE: {
+            int x = date_to_days(t->value.d);
+            for (int i = 0; i < count; i++) {
+                Date d;
+                memcpy(&d, (const char *)&fleet[i] + f->offset, sizeof d);
+                int v = date_to_days(d);
+                mask[i] &= (unsigned char)cmp_holds(t->op, (v > x) - (v < x));
+            }
+            break;
+        }
+        default: {
+            size_t n = strlen(t->value.text);
+            for (int i = 0; i < count; i++) {
+                if (!mask[i]) continue;
+                const char *v = (const char *)&fleet[i] + f->offset;
+                if (t->op == CMP_PREFIX) {
+                    size_t k = 0;
+                    while (k < n && tolower((unsigned char)v[k]) ==
+                                    tolower((unsigned char)t->value.text[k])) k++;
+                    mask[i] = (unsigned char)(k == n);
+                } else {
+                    mask[i] = (unsigned char)cmp_holds(t->op, text_icmp(v, t->value.text));
+                }
+            }
+            break;
+        }
+    }
+}
+
+/* Compares one bus's field with a term's value (<0, 0, >0). */
+static int bulk_compare(const Bus *b, const BulkTerm *t) {
+    const AuditField *f = &audit_fields[t->field];
+    const char *src = (const char *)b + f->offset;
+    switch (f->kind) {
+        case AUDIT_INT: {
+            int v;
+            memcpy(&v, src, sizeof v);
+            return (v > t->value.i) - (v < t->value.i);
+        }
+        case AUDIT_FLOAT: {
+            float v;
+            memcpy(&v, src, sizeof v);
+            return (v > t->value.f) - (v < t->value.f);
+        }
+        case AUDIT_DATE: {
+            Date d;
+            memcpy(&d, src, sizeof d);
+            int v = date_to_days(d), x = date_to_days(t->value.d);
+            return (v > x) - (v < x);
+        }
+        default:
+            return text_icmp(src, t->value.text);
+    }
+}
+
+static void bulk_assign(Bus *b, const BulkTerm *t) {
+    const AuditField *f = &audit_fields[t->field];
+    char *dst = (char *)b + f->offset;
+    switch (f->kind) {
+        case AUDIT_INT: {
+            int v = (int)t->value.i;
+            memcpy(dst, &v, sizeof v);
+            break;
+        }
+        case AUDIT_FLOAT: memcpy(dst, &t->value.f, sizeof t->value.f); break;
+        case AUDIT_DATE:  memcpy(dst, &t->value.d, sizeof t->value.d); break;
+        default:
+            strncpy(dst, t->value.text, f->size - 1);
+            dst[f->size - 1] = '\0';
+            break;
+    }
+}
+
+/* Applies a parsed bulk edit and refreshes the changed buses for today;
+   returns how many changed (-1 on allocation failure). Matching buses
+   that already hold the assigned values are left untouched. */
+int apply_bulk_edit(Bus *fleet, int count, const BulkEdit *be, Date today,
+                    int *matched) {
+    unsigned char *mask = malloc(count > 0 ? (size_t)count : 1);
+    UndoItem *items = NULL;
+    int nitems = 0, cap = 0;
+    if (!mask) return -1;
+    memset(mask, 1, (size_t)count);
+    for (int k = 0; k < be->nwhere; k++) {
+        bulk_filter(fleet, count, &be->where[k], mask);
+    }
+
+    *matched = 0;
+    for (int i = 0; i < count; i++) {
+        if (!mask[i]) continue;
+        (*matched)++;
+        int differs = 0;
+        for (int k = 0; k < be->nset && !differs; k++) {
+            const BulkTerm *t = &be->set[k];
+            differs = audit_fields[t->field].kind == AUDIT_TEXT
+                          ? strcmp((const char *)&fleet[i] + audit_fields[t->field].offset,
+                                   t->value.text) != 0
+                          : bulk_compare(&fleet[i], t) != 0;
+        }
+        if (!differs) continue;
+        Bus after = fleet[i];
+        for (int k = 0; k < be->nset; k++) bulk_assign(&after, &be->set[k]);
+
+        if (nitems >= cap) {
+            int new_cap = (cap == 0) ? 64 : cap * 2;
+            UndoItem *tmp = realloc(items, (size_t)new_cap * sizeof *tmp);
+            if (!tmp) {
+                /* nothing applied yet: leave the fleet as it was */
+                free(items);
+                free(mask);
+                return -1;
+            }
+            items = tmp;
+            cap = new_cap;
+        }
+        items[nitems].index = i;
+        items[nitems].before = fleet[i];
+        items[nitems].after = after;
+        nitems++;
+    }
+    free(mask);
+
+    for (int k = 0; k < nitems; k++) {
+        Bus *b = &fleet[items[k].index];
+        *b = items[k].after;
+        update_maintenance_status(b, today);
+        change_stamp(b);
+        items[k].after = *b;
+        audit_record(&items[k].before, b);
+    }
+    if (nitems > 0) undo_push_bulk(UNDO_BULK_EDIT, items, nitems);
+    else free(items);
+    return nitems;
+}
+
+void bulk_edit_menu(Bus *fleet, int count, Date today) {
+    char line[512];
+    BulkEdit be;
+    printf("Example: set service_interval_km=12000 where service_interval_km=10000\n");
+    printf("Bulk edit: ");
+    if (!read_line_stdin(line, sizeof line) || line[0] == '\0') return;
+    if (!parse_bulk_edit(line, &be)) return;
+
+    int matched;
+    fleet_write_begin(&count);
+    int changed = apply_bulk_edit(fleet, count, &be, today, &matched);
+    fleet_write_end(fleet, count);
+    if (changed < 0) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+        return;
+    }
+    printf(COLOR_GREEN "%d bus(es) matched, %d updated.\n" COLOR_RESET,
+           matched, changed);
+}
+
+/* ---------- Bulk delete ---------- */
+
+/* Victims are given as a list of bus numbers ("101, 102 107"), a file of
+   them ("@retired.txt") or a filter ("where bus_code ^= DEP_"). They
+   are marked in a bitmap over fleet positions, then the fleet is
+   compacted in one stable pass. The whole delete is one undo step. */
+typedef struct {
+    BulkEdit filter;
+    int      use_filter;
+    int     *bus_nos;
+    int      nbus_nos;
+} BulkDelete;
+
+static int compare_int(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+static int bulk_parse_list(const char *s, BulkDelete *bd) {
+    int cap = 0;
+    while (*s) {
+        while (*s == ',' || isspace((unsigned char)*s)) s++;
+        if (!*s) break;
+        char tok[16];
+        size_t n = 0;
+        while (*s && *s != ',' && !isspace((unsigned char)*s)) {
+            if (n < sizeof tok - 1) tok[n] = *s;
+            n++;
+            s++;
+        }
+        tok[n < sizeof tok ? n : sizeof tok - 1] = '\0';
+        int v;
+        if (n >= sizeof tok || !parse_int_field(tok, &v) || v <= 0) {
+            printf(COLOR_RED "Invalid bus number '%s'.\n" COLOR_RESET, tok);
+            return 0;
+        }
+        if (bd->nbus_nos >= cap) {
+            int new_cap = (cap == 0) ? 64 : cap * 2;
+            int *tmp = realloc(bd->bus_nos, (size_t)new_cap * sizeof *tmp);
+            if (!tmp) return 0;
+            bd->bus_nos = tmp;
+            cap = new_cap;
+        }
+        bd->bus_nos[bd->nbus_nos++] = v;
+    }
+    if (bd->nbus_nos == 0) {
+        printf(COLOR_RED "No bus numbers given.\n" COLOR_RESET);
+        return 0;
+    }
+    qsort(bd->bus_nos, (size_t)bd->nbus_nos, sizeof *bd->bus_nos, compare_int);
+    return 1;
+}
+
+void bulk_delete_free(BulkDelete *bd) {
+    free(bd->bus_nos);
+    bd->bus_nos = NULL;
+    bd->nbus_nos = 0;
+}
+
+int parse_bulk_delete(const char *text, BulkDelete *bd) {
+    const char *p = text;
+    memset(bd, 0, sizeof *bd);
+    bulk_keyword(&p, "delete");
+    bulk_skip_ws(&p);
+
+    const char *q = p;
+    if (bulk_keyword(&q, "where")) {
+        bd->use_filter = 1;
+        return parse_bulk_where(p, &bd->filter);
+    }
+    if (*p != '@') return bulk_parse_list(p, bd);
+
+    FILE *fp = fopen(p + 1, "rb");
+    if (!fp) {
+        printf(COLOR_RED "Cannot open %s.\n" COLOR_RESET, p + 1);
+        return 0;
+    }
+    TextBuf tb = {0};
+    char chunk[65536];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof chunk, fp)) > 0) tb_append(&tb, chunk, got);
+    fclose(fp);
+    tb_append(&tb, "", 1);
+    int ok = tb.data && bulk_parse_list(tb.data, bd);
+    tb_free(&tb);
+    return ok;
+}
+
+/* Marks the victims' positions; returns how many (-1 on allocation failure). */
+int bulk_delete_mark(const Bus *fleet, int count, const BulkDelete *bd,
+                     uint64_t *marked) {
+    int n = 0;
+    memset(marked, 0, BITMAP_WORDS(count) * sizeof *marked);
+    if (bd->use_filter) {
+        unsigned char *mask = malloc(count > 0 ? (size_t)count : 1);
+        if (!mask) return -1;
+        memset(mask, 1, (size_t)count);
+        for (int k = 0; k < bd->filter.nwhere; k++) {
+            bulk_filter(fleet, count, &bd->filter.where[k], mask);
+        }
+        for (int i = 0; i < count; i++) {
+            if (mask[i]) {
+                bitmap_set(marked, i);
+                n++;
+            }
+        }
+        free(mask);
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (bsearch(&fleet[i].bus_no, bd->bus_nos, (size_t)bd->nbus_nos,
+                        sizeof *bd->bus_nos, compare_int)) {
+                bitmap_set(marked, i);
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+/* Removes the marked buses and records them as one undo step. Returns
+   -1, deleting nothing, if the undo step cannot be allocated. */
+int bulk_delete_apply(Bus *fleet, int *count, const uint64_t *marked, int nmarked) {
+    if (nmarked <= 0) return 0;
+    UndoItem *items = malloc((size_t)nmarked * sizeof *items);
+    if (!items) return -1;
+    int removed = fleet_remove_marked(fleet, count, marked, items);
+    undo_push_bulk(UNDO_BULK_DELETE, items, removed);
+    return removed;
+}
+
+void bulk_delete_menu(Bus *fleet, int *count) {
+    char line[4096], buf[16];
+    BulkDelete bd;
+    printf("Bus numbers (101, 102 ...), @file with bus numbers, or where ...\n");
+    printf("Bulk delete: ");
+    if (!read_line_stdin(line, sizeof line) || line[0] == '\0') return;
+    if (!parse_bulk_delete(line, &bd)) {
+        bulk_delete_free(&bd);
+        return;
+    }
+
+    uint64_t *marked = malloc((BITMAP_WORDS(*count) + 1) * sizeof *marked);
+    int n = marked ? bulk_delete_mark(fleet, *count, &bd, marked) : -1;
+    if (n < 0) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+    } else if (n == 0) {
+        printf(COLOR_YELLOW "No matching buses.\n" COLOR_RESET);
+    } else {
+        printf("Delete %d bus(es)? (y/n): ", n);
+        if (read_line_stdin(buf, sizeof buf) && tolower((unsigned char)buf[0]) == 'y') {
+            /* Mark again under the lock: the fleet may have moved since. */
+            fleet_write_begin(count);
+            uint64_t *tmp = realloc(marked, (BITMAP_WORDS(*count) + 1) * sizeof *marked);
+            if (tmp) marked = tmp;
+            n = tmp ? bulk_delete_mark(fleet, *count, &bd, marked) : -1;
+            int removed = (n < 0) ? -1 : bulk_delete_apply(fleet, count, marked, n);
+            fleet_write_end(fleet, *count);
+            if (removed < 0) {
+                printf(COLOR_RED "Not enough memory to make this delete undoable; "
+                       "nothing was deleted.\n" COLOR_RESET);
+            } else {
+                printf(COLOR_YELLOW "%d bus(es) deleted. Remaining: %d\n" COLOR_RESET,
+                       removed, *count);
+            }
+        }
+    }
+    bulk_delete_free(&bd);
+    free(marked);
+}
+
+/* ---------- Quick summary after entering reference date ---------- */
+
+void summarize_maintenance(Bus *fleet, int count, Date today) {
+    if (count == 0) {
+        printf(COLOR_YELLOW
+               "No buses in fleet yet. Add bus data to check maintenance.\n"
+               COLOR_RESET);
+        return;
+    }
+
+    int overdue = 0;
+    int due_soon = 0;
+
+    for (int i = 0; i < count; i++) {
+        refresh_bus_status(&fleet[i], today);
+        if (fleet[i].status == STATUS_OVERDUE) {
+            overdue++;
+        } else if (fleet[i].status == STATUS_DUE_SOON) {
+            due_soon++;
+        }
+    }
+
+    if (overdue == 0 && due_soon == 0) {
+        printf(COLOR_GREEN
+               "No maintenance due right now, or upcoming in the next few days.\n"
+               COLOR_RESET);
+        return;
+    }
+
+    if (overdue > 0) {
+        printf(COLOR_RED
+               "\nThese buses NEED maintenance on or before the chosen date:\n"
+               COLOR_RESET);
+        for (int i = 0; i < count; i++) {
+            if (fleet[i].status == STATUS_OVERDUE) {
+                printf("  - Bus %d [%s] (driver: %s)\n",
+                       fleet[i].bus_no,
+                       fleet[i].bus_code,
+                       fleet[i].driver_name);
+            }
+        }
+    }
+
+    if (due_soon > 0) {
+        printf(COLOR_YELLOW
+               "\nThese buses will need maintenance SOON (within %d km):\n"
+               COLOR_RESET, DUE_SOON_KM);
+        for (int i = 0; i < count; i++) {
+            if (fleet[i].status == STATUS_DUE_SOON) {
+                printf("  - Bus %d [%s] (driver: %s), km left: %.1f\n",
+                       fleet[i].bus_no,
+                       fleet[i].bus_code,
+                       fleet[i].driver_name,
+                       fleet[i].km_left);
+            }
+        }
+    }
+
+    printf("\n");
+}
+
+/* ---------- Live dashboard (differential redraw) ---------- */
+
+#define DASH_MAX_WIDTH  160
+#define DASH_TOP_LINES  4      /* title, counts, heading, rule */
+
+/* One screen row as it was last sent to the terminal. Text is kept
+   without colour codes and space-padded to the screen width so two
+   frames can be compared byte by byte. */
+typedef struct {
+    char   text[DASH_MAX_WIDTH + 1];
+    int    status_col;          /* -1 for rows without a status cell */
+    Status status;
+    int    valid;
+} DashRow;
+
+static volatile sig_atomic_t dash_stop = 0;
+
+static void dash_on_signal(int sig) {
+    (void)sig;
+    dash_stop = 1;
+}
+
+/* Waits up to ms milliseconds; returns 1 if a key/line is waiting. */
+static int wait_for_input(int ms) {
+#ifdef _WIN32
+    for (int waited = 0; waited < ms; waited += 50) {
+        if (_kbhit()) return 1;
+        Sleep(50);
+    }
+    return _kbhit();
+#else
+    fd_set fds;
+    struct timeval tv;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+#endif
+}
+
+static void dash_set_row(DashRow *r, const char *text, int width,
+                         int status_col, Status status) {
+    size_t n = strlen(text);
+    if ((int)n > width) n = (size_t)width;
+    memcpy(r->text, text, n);
+    memset(r->text + n, ' ', (size_t)width - n);
+    r->text[width] = '\0';
+    r->status_col = (status_col < width) ? status_col : -1;
+    r->status = status;
+    r->valid = 1;
+}
+
+/* Appends the escape sequences that turn `old` into `cur` on screen row
+   `y`: only the span between the first and last differing byte is
+   rewritten, plus the status cell when its colour has to change. */
+static void dash_diff_row(TextBuf *out, const DashRow *old, const DashRow *cur,
+                          int y, int width) {
+    char seq[32];
+    int first, last;
+
+    if (old->valid) {
+        first = 0;
+        while (first < width && old->text[first] == cur->text[first]) first++;
+        last = width - 1;
+        while (last >= first && old->text[last] == cur->text[last]) last--;
+        if (first > last && old->status == cur->status) return;
+    } else {
+        first = 0;
+        last = width - 1;
+    }
+
+    int plain_end = (cur->status_col >= 0) ? cur->status_col - 1 : width - 1;
+    if (first <= plain_end && first <= last) {
+        int end = (last < plain_end) ? last : plain_end;
+        snprintf(seq, sizeof seq, "\033[%d;%dH", y + 1, first + 1);
+        tb_puts(out, seq);
+        tb_append(out, cur->text + first, (size_t)(end - first + 1));
+    }
+
+    if (cur->status_col >= 0 &&
+        (last >= cur->status_col || !old->valid || old->status != cur->status)) {
+        snprintf(seq, sizeof seq, "\033[%d;%dH", y + 1, cur->status_col + 1);
+        tb_puts(out, seq);
+        tb_puts(out, status_color(cur->status));
+        tb_append(out, cur->text + cur->status_col,
+                  (size_t)(width - cur->status_col));
+        tb_puts(out, COLOR_RESET);
+    }
+}
+
+/* Formats the frame for the current fleet state into `rows`. */
+static void dash_build_frame(DashRow *rows, int nrows, int width,
+                             Bus *fleet, int count, Date today) {
+    char line[DASH_MAX_WIDTH + 64];
+    int ok = 0, due = 0, overdue = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (fleet[i].status == STATUS_OVERDUE) overdue++;
+        else if (fleet[i].status == STATUS_DUE_SOON) due++;
+        else ok++;
+    }
+
+    time_t now = time(NULL);
+    struct tm *lt = localtime(&now);
+    char clock_buf[16] = "--:--:--";
+    if (lt) strftime(clock_buf, sizeof clock_buf, "%H:%M:%S", lt);
+
+    snprintf(line, sizeof line,
+             "FleetGuardian live dashboard   ref %02d-%02d-%04d   %s   (q + Enter to leave)",
+             today.day, today.month, today.year, clock_buf);
+    dash_set_row(&rows[0], line, width, -1, STATUS_OK);
+    snprintf(line, sizeof line,
+             "Buses: %d   OK: %d   Due soon: %d   Overdue: %d",
+             count, ok, due, overdue);
+    dash_set_row(&rows[1], line, width, -1, STATUS_OK);
+    dash_set_row(&rows[2],
+                 "Bus  | Code      | Driver        | KmLeft    | Health | Status",
+                 width, -1, STATUS_OK);
+    dash_set_row(&rows[3],
+                 "-----+-----------+---------------+-----------+--------+---------",
+                 width, -1, STATUS_OK);
+
+    for (int y = DASH_TOP_LINES; y < nrows; y++) {
+        int i = y - DASH_TOP_LINES;
+        if (i >= count) {
+            dash_set_row(&rows[y], "", width, -1, STATUS_OK);
+            continue;
+        }
+        Bus *b = &fleet[i];
+        int col = snprintf(line, sizeof line,
+                           "%-4d | %-9.9s | %-13.13s | %9.1f | %6d | ",
+                           b->bus_no, b->bus_code, b->driver_name,
+                           b->km_left, b->health_score);
+        snprintf(line + col, sizeof line - (size_t)col, "%-9s",
+                 status_label(b->status));
+        dash_set_row(&rows[y], line, width, col, b->status);
+    }
+}
+
+/* Full-screen view that refreshes once a second. When `filename` is set
+   the data file is re-read whenever another process rewrites it; only the
+   bytes that changed since the previous frame are sent to the terminal. */
+void run_dashboard(Bus **fleet_ptr, int *count, int *capacity, Date today,
+                   const char *filename) {
+    int nrows = 0, width = 0;
+    DashRow *shadow = NULL;
+    DashRow *frame = NULL;
+    TextBuf out = {0};
+    struct stat st;
+    time_t seen_mtime = 0;
+    off_t seen_size = -1;
+    int stdin_open = 1;
+
+    if (filename && stat(filename, &st) == 0) {
+        seen_mtime = st.st_mtime;
+        seen_size = st.st_size;
+    }
+
+    dash_stop = 0;
+    void (*prev_handler)(int) = signal(SIGINT, dash_on_signal);
+
+    write_block("\033[?1049h\033[?25l", strlen("\033[?1049h\033[?25l"));
+
+    while (!dash_stop) {
+        if (filename && stat(filename, &st) == 0 &&
+            (st.st_mtime != seen_mtime || st.st_size != seen_size)) {
+            int corrupted;
+            seen_mtime = st.st_mtime;
+            seen_size = st.st_size;
+            load_fleet_quiet(fleet_ptr, count, capacity, filename, &corrupted);
+        }
+        /* From the menu the fleet's statuses are already current for today,
+           so the dashboard only reads it, without the fleet lock. */
+        if (filename) {
+            for (int i = 0; i < *count; i++) {
+                update_maintenance_status(&(*fleet_ptr)[i], today);
+            }
+        }
+        uint64_t seen = fleet_read_begin(count);
+
+        int r, c;
+        terminal_size(&r, &c);
+        if (c > DASH_MAX_WIDTH) c = DASH_MAX_WIDTH;
+        if (r < DASH_TOP_LINES + 1) r = DASH_TOP_LINES + 1;
+        if (r != nrows || c != width) {
+            /* Resized: start again from a blank screen. */
+            free(shadow);
+            free(frame);
+            nrows = r;
+            width = c;
+            shadow = calloc((size_t)nrows, sizeof(DashRow));
+            frame = calloc((size_t)nrows, sizeof(DashRow));
+            if (!shadow || !frame) break;
+            write_block("\033[2J", 4);
+        }
+
+        dash_build_frame(frame, nrows, width - 1, *fleet_ptr, *count, today);
+        if (fleet_read_changed(seen)) continue;     /* torn read: build it again */
+
+        out.len = 0;
+        for (int y = 0; y < nrows; y++) {
+            dash_diff_row(&out, &shadow[y], &frame[y], y, width - 1);
+        }
+        if (out.len > 0) {
+            write_block(out.data, out.len);
+            memcpy(shadow, frame, (size_t)nrows * sizeof(DashRow));
+        }
+
+        if (stdin_open && wait_for_input(1000)) {
+#ifdef _WIN32
+            int ch = _getch();
+            if (ch == 'q' || ch == 'Q') break;
+#else
+            char buf[64];
+            if (!read_line_stdin(buf, sizeof buf)) {
+                stdin_open = 0;     /* detached: run until Ctrl+C */
+            } else if (tolower((unsigned char)buf[0]) == 'q') {
+                break;
+            }
+#endif
+        } else if (!stdin_open) {
+#ifdef _WIN32
+            Sleep(1000);
+#else
+            sleep(1);
+#endif
+        }
+    }
+
+    write_block("\033[?25h\033[?1049l", strlen("\033[?25h\033[?1049l"));
+    signal(SIGINT, prev_handler);
+    tb_free(&out);
+    free(shadow);
+    free(frame);
+}
+
+/* ---------- CSV export ---------- */
+
+#define REPORT_HEADER \
+    "BusNo,BusCode,DriverName,LastServiceDate,NextDueDate," \
+    "CurrentKm,KmLeft,HealthScore,Status,ServiceHistoryCount\n"
+#define REPORT_FLUSH_BYTES (64 * 1024)
+
+/* Appends s as a quoted CSV field, doubling any embedded quotes. */
+static void csv_append_quoted(TextBuf *tb, const char *s) {
+    const char *q;
+    tb_append(tb, "\"", 1);
+    while ((q = strchr(s, '"')) != NULL) {
+        tb_append(tb, s, (size_t)(q - s) + 1);
+        tb_append(tb, "\"", 1);
+        s = q + 1;
+    }
+    tb_puts(tb, s);
+    tb_append(tb, "\"", 1);
+}
+
+void format_report_row(TextBuf *tb, Bus *b) {
+    char last_buf[16];
+    char next_buf[16];
+
+    format_date_fixed(last_buf, b->last_service);
+    if (b->next_due.year > 0)
+        format_date_fixed(next_buf, b->next_due);
+    else
+        next_buf[0] = '\0';
+
+    if (!tb_reserve(tb, 256)) return;
+    int n = snprintf(tb->data + tb->len, tb->cap - tb->len, "%d,", b->bus_no);
+    if (n > 0) tb->len += (size_t)n;
+    csv_append_quoted(tb, b->bus_code);
+    tb_append(tb, ",", 1);
+    csv_append_quoted(tb, b->driver_name);
+
+    if (!tb_reserve(tb, 256)) return;
+    n = snprintf(tb->data + tb->len, tb->cap - tb->len,
+                 ",\"%s\",\"%s\",%.1f,%.1f,%d,\"%s\",%d\n",
+                 last_buf,
+                 next_buf,
+                 b->current_mileage,
+                 b->km_left,
+                 b->health_score,
+                 status_label(b->status),
+                 b->service_history_count);
+    if (n > 0) tb->len += (size_t)n;
+}
+
+void export_report(Bus *fleet, int count, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf(COLOR_RED "Could not open report file.\n" COLOR_RESET);
+        return;
+    }
+
+    TextBuf tb = {0};
+    tb_puts(&tb, REPORT_HEADER);
+    for (int i = 0; i < count; i++) {
+        format_report_row(&tb, &fleet[i]);
+        if (tb.len >= REPORT_FLUSH_BYTES) {
+            fwrite(tb.data, 1, tb.len, fp);
+            tb.len = 0;
+        }
+    }
+    if (tb.len > 0) fwrite(tb.data, 1, tb.len, fp);
+    tb_free(&tb);
+
+    fclose(fp);
+    printf(COLOR_GREEN "CSV report exported to %s\n" COLOR_RESET, filename);
+}
+
+/* ---------- JSON Lines export ---------- */
+
+/* One JSON object per bus per line, flushed in REPORT_FLUSH_BYTES chunks.
+   Strings are scanned 16 bytes at a time for characters JSON needs
+   escaped, so ordinary names are copied in one piece. */
+
+/* Index of the first byte in s[0..n) that must be escaped, or n. */
+static size_t json_escape_scan(const char *s, size_t n) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                   _mm_cmpeq_epi8(v, backslash));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(_mm_min_epu8(v, ctrl), v));
+        int mask = _mm_movemask_epi8(hit);
+        if (mask) return i + (size_t)__builtin_ctz((unsigned)mask);
+    }
+#endif
+    for (; i < n; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\' || c < 0x20) break;
+    }
+    return i;
+}
+
+static void json_append_string(TextBuf *tb, const char *s) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n = strlen(s);
+
+    tb_append(tb, "\"", 1);
+    while (n > 0) {
+        size_t run = json_escape_scan(s, n);
+        tb_append(tb, s, run);
+        if (run == n) break;
+
+        unsigned char c = (unsigned char)s[run];
+        char esc[6] = {'\\', (char)c, 0, 0, 0, 0};
+        size_t len = 2;
+        if (c == '\n') esc[1] = 'n';
+        else if (c == '\r') esc[1] = 'r';
+        else if (c == '\t') esc[1] = 't';
+        else if (c < 0x20) {
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xF];
+            len = 6;
+        }
+        tb_append(tb, esc, len);
+        s += run + 1;
+        n -= run + 1;
+    }
+    tb_append(tb, "\"", 1);
+}
+
+/* ISO "yyyy-mm-dd", or null when the date is unset. */
+static void json_append_date(TextBuf *tb, Date d) {
+    char buf[48];
+    if (d.year <= 0 || !is_valid_date(d)) {
+        tb_append(tb, "null", 4);
+        return;
+    }
+    int n = snprintf(buf, sizeof buf, "\"%04d-%02d-%02d\"", d.year, d.month, d.day);
+    if (n > 0) tb_append(tb, buf, (size_t)n);
+}
+
+/* Numbers in JSON must be finite. */
+static char *json_put_number(char *p, float v) {
+    if (!isfinite(v)) return put_text(p, "null");
+    return put_fixed2(p, v);
+}
+
+void format_json_row(TextBuf *tb, Bus *b) {
+    if (!tb_reserve(tb, 64)) return;
+    char *p = put_text(tb->data + tb->len, "{\"bus_no\":");
+    p = put_int(p, b->bus_no);
+    p = put_text(p, ",\"bus_code\":");
+    tb->len = (size_t)(p - tb->data);
+    json_append_string(tb, b->bus_code);
+    tb_puts(tb, ",\"driver_name\":");
+    json_append_string(tb, b->driver_name);
+    tb_puts(tb, ",\"last_service\":");
+    json_append_date(tb, b->last_service);
+    tb_puts(tb, ",\"next_due\":");
+    json_append_date(tb, b->next_due);
+
+    if (!tb_reserve(tb, 512)) return;
+    p = tb->data + tb->len;
+    p = put_text(p, ",\"current_mileage\":");
+    p = json_put_number(p, b->current_mileage);
+    p = put_text(p, ",\"last_service_mileage\":");
+    p = json_put_number(p, b->last_service_mileage);
+    p = put_text(p, ",\"service_interval_km\":");
+    p = json_put_number(p, b->service_interval_km);
+    p = put_text(p, ",\"service_interval_days\":");
+    p = put_int(p, b->service_interval_days);
+    p = put_text(p, ",\"service_history_count\":");
+    p = put_int(p, b->service_history_count);
+    p = put_text(p, ",\"status\":\"");
+    p = put_text(p, status_label(b->status));
+    p = put_text(p, "\",\"km_left\":");
+    p = json_put_number(p, b->km_left);
+    p = put_text(p, ",\"health_score\":");
+    p = put_int(p, b->health_score);
+    p = put_text(p, ",\"avg_daily_km\":");
+    p = json_put_number(p, b->avg_daily_km);
+    p = put_text(p, ",\"fuel_efficiency\":");
+    p = json_put_number(p, b->fuel_efficiency);
+    p = put_text(p, ",\"change_seq\":");
+    p = put_int(p, b->change_seq);
+    p = put_text(p, "}\n");
+    tb->len = (size_t)(p - tb->data);
+    tb->data[tb->len] = '\0';
+}
+
+int export_json(Bus *fleet, int count, const char *filename) {
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+
+    TextBuf tb = {0};
+    int failed = 0;
+    for (int i = 0; i < count && !failed; i++) {
+        format_json_row(&tb, &fleet[i]);
+        if (tb.len >= REPORT_FLUSH_BYTES) {
+            failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+            tb.len = 0;
+        }
+    }
+    if (!failed && tb.len > 0) failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+    tb_free(&tb);
+
+    if (fclose(fp) != 0) failed = 1;
+    if (failed) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+    printf(COLOR_GREEN "JSON Lines export of %d buses written to %s\n" COLOR_RESET,
+           count, filename);
+    return 0;
+}
+
+/* ---------- Downtime & availability ---------- */
+
+/* DOWNTIME_FILE holds one workshop visit per line:
+       bus_no|S or R|start dd|mm|yyyy|end dd|mm|yyyy
+   S = scheduled service, R = repair; the end day is inclusive and
+   0|0|0 means the bus is still in the workshop. For every bus the
+   visits of each kind, and all visits together, are merged into sorted
+   disjoint day ranges with a running total of downtime before each
+   range. Downtime inside any window is then two binary searches per
+   series, and the per-bus work for a report runs on all cores. */
+#define DOWNTIME_FILE     "bus_downtime.txt"
+#define AVAILABILITY_FILE "availability.csv"
+#define DOWNTIME_FIELDS   8
+#define DT_SERVICE 0
+#define DT_REPAIR  1
+#define DT_ALL     2
+#define DT_SERIES  3
+#define AVAIL_CHUNK 2048
+
+typedef struct {
+    int bus_no;
+    int kind;
+    int start;               /* civil days, end exclusive */
+    int end;
+} DowntimeEvent;
+
+typedef struct {
+    int off;                 /* into the index's start/end/before pools */
+    int n;
+} DowntimeSeries;
+
+typedef struct {
+    int             nbus;
+    int            *bus_no;  /* ascending */
+    DowntimeSeries *series;  /* DT_SERIES per bus */
+    int            *start;
+    int            *end;
+    int            *before;  /* downtime days in earlier ranges of the series */
+    int             nevents;
+} DowntimeIndex;
+
+static int compare_downtime(const void *a, const void *b) {
+    const DowntimeEvent *x = a, *y = b;
+    if (x->bus_no != y->bus_no) return (x->bus_no > y->bus_no) - (x->bus_no < y->bus_no);
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+int parse_downtime_line(char *line, DowntimeEvent *e) {
+    char *f[DOWNTIME_FIELDS];
+    Date s, t;
+    if (split_fields(line, '|', f, DOWNTIME_FIELDS) != DOWNTIME_FIELDS) return 0;
+    if (!parse_int_field(f[0], &e->bus_no) || e->bus_no <= 0) return 0;
+    if (strcmp(f[1], "S") == 0) e->kind = DT_SERVICE;
+    else if (strcmp(f[1], "R") == 0) e->kind = DT_REPAIR;
+    else return 0;
+    if (!parse_int_field(f[2], &s.day) || !parse_int_field(f[3], &s.month) ||
+        !parse_int_field(f[4], &s.year) || !is_calendar_date(s) ||
+        !parse_int_field(f[5], &t.day) || !parse_int_field(f[6], &t.month) ||
+        !parse_int_field(f[7], &t.year)) return 0;
+    e->start = date_to_civil_days(s);
+    if (t.day == 0 && t.month == 0 && t.year == 0) {
+        Date open_end = {31, 12, CAL_LAST_YEAR};
+        e->end = date_to_civil_days(open_end) + 1;
+    } else if (is_calendar_date(t)) {
+        e->end = date_to_civil_days(t) + 1;
+    } else {
+        return 0;
+    }
+    return e->end > e->start;
+}
+
+int append_downtime_event(const char *filename, int bus_no, char kind,
+                          Date start, Date end) {
+    FILE *fp = fopen(filename, "a");
+    if (!fp) return -1;
+    fprintf(fp, "%d|%c|%d|%d|%d|%d|%d|%d\n", bus_no, kind,
+            start.day, start.month, start.year, end.day, end.month, end.year);
+    int failed = flush_to_disk(fp) != 0;
+    if (fclose(fp) != 0) failed = 1;
+    return failed ? -1 : 0;
+}
+
+void downtime_free(DowntimeIndex *ix) {
+    free(ix->bus_no);
+    free(ix->series);
+    free(ix->start);
+    free(ix->end);
+    free(ix->before);
+    memset(ix, 0, sizeof *ix);
+}
+
+/* Loads and indexes DOWNTIME_FILE. A missing file is an empty index;
+   returns -1 only on allocation failure. Bad lines are counted. */
+int downtime_load(const char *filename, DowntimeIndex *ix, int *bad) {
+    LineReader lr;
+    DowntimeEvent *ev = NULL;
+    int n = 0, cap = 0;
+    char *line;
+    size_t len;
+
+    memset(ix, 0, sizeof *ix);
+    *bad = 0;
+    if (lr_open(&lr, filename)) {
+        while ((line = lr_next(&lr, &len)) != NULL) {
+            if (len > 0 && line[len - 1] == '\r') line[--len] = '\0';
+            if (len == 0 || line[0] == '#') continue;
+            if (n >= cap) {
+                int new_cap = (cap == 0) ? 1024 : cap * 2;
+                DowntimeEvent *tmp = realloc(ev, (size_t)new_cap * sizeof *tmp);
+                if (!tmp) {
+                    lr_close(&lr);
+                    free(ev);
+                    return -1;
+                }
+                ev = tmp;
+                cap = new_cap;
+            }
+            if (parse_downtime_line(line, &ev[n])) n++;
+            else (*bad)++;
+        }
+        lr_close(&lr);
+    }
+    qsort(ev, (size_t)n, sizeof *ev, compare_downtime);
+
+    int nbus = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || ev[i].bus_no != ev[i - 1].bus_no) nbus++;
+    }
+    size_t pool = (size_t)n * 2 + 1;   /* each event lands in its kind and in ALL */
+    ix->bus_no = malloc(((size_t)nbus + 1) * sizeof *ix->bus_no);
+    ix->series = malloc(((size_t)nbus * DT_SERIES + 1) * sizeof *ix->series);
+    ix->start = malloc(pool * sizeof *ix->start);
+    ix->end = malloc(pool * sizeof *ix->end);
+    ix->before = malloc(pool * sizeof *ix->before);
+    if (!ix->bus_no || !ix->series || !ix->start || !ix->end || !ix->before) {
+        free(ev);
+        downtime_free(ix);
+        return -1;
+    }
+
+    int used = 0;
+    for (int g0 = 0; g0 < n;) {
+        int g1 = g0;
+        while (g1 < n && ev[g1].bus_no == ev[g0].bus_no) g1++;
+        int b = ix->nbus++;
+        ix->bus_no[b] = ev[g0].bus_no;
+        for (int kind = 0; kind < DT_SERIES; kind++) {
+            DowntimeSeries *s = &ix->series[b * DT_SERIES + kind];
+            int total = 0;
+            s->off = used;
+            s->n = 0;
+            /* events are in start order, so merging only looks at the last range */
+            for (int i = g0; i < g1; i++) {
+                if (kind != DT_ALL && ev[i].kind != kind) continue;
+                int last = s->off + s->n - 1;
+                if (s->n > 0 && ev[i].start <= ix->end[last]) {
+                    if (ev[i].end > ix->end[last]) {
+                        total += ev[i].end - ix->end[last];
+                        ix->end[last] = ev[i].end;
+                    }
+                    continue;
+                }
+                ix->start[used] = ev[i].start;
+                ix->end[used] = ev[i].end;
+                ix->before[used] = total;
+                total += ev[i].end - ev[i].start;
+                used++;
+                s->n++;
+            }
+        }
+        g0 = g1;
+    }
+    ix->nevents = n;
+    free(ev);
+    return 0;
+}
+
+/* Downtime days of one series before civil day x. */
+static int downtime_before(const DowntimeIndex *ix, DowntimeSeries s, int x) {
+    const int *st = ix->start + s.off;
+    int lo = 0, hi = s.n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (st[mid] < x) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0) return 0;
+    int i = s.off + lo - 1;
+    int part = x - ix->start[i], len = ix->end[i] - ix->start[i];
+    return ix->before[i] + (part < len ? part : len);
+}
+
+/* Downtime days of one series in [from, to). */
+int downtime_in(const DowntimeIndex *ix, DowntimeSeries s, int from, int to) {
+    if (s.n == 0 || from >= to) return 0;
+    return downtime_before(ix, s, to) - downtime_before(ix, s, from);
+}
+
+typedef struct {
+    const Bus           *fleet;
+    int                  count;
+    const DowntimeIndex *ix;
+    const int           *period_start;   /* nperiods + 1 boundaries */
+    int                  nperiods;
+    int                 *down;           /* [bus][period][DT_SERIES] */
+} AvailabilityJob;
+
+static void availability_task(void *ctx, int task) {
+    AvailabilityJob *job = ctx;
+    int lo = task * AVAIL_CHUNK;
+    int hi = (lo + AVAIL_CHUNK < job->count) ? lo + AVAIL_CHUNK : job->count;
+    for (int i = lo; i < hi; i++) {
+        int *out = job->down + (size_t)i * job->nperiods * DT_SERIES;
+        const int *hit = bsearch(&job->fleet[i].bus_no, job->ix->bus_no,
+                                 (size_t)job->ix->nbus, sizeof(int), compare_int);
+        if (!hit) {
+            memset(out, 0, (size_t)job->nperiods * DT_SERIES * sizeof *out);
+            continue;
+        }
+        const DowntimeSeries *s = &job->ix->series[(hit - job->ix->bus_no) * DT_SERIES];
+        for (int p = 0; p < job->nperiods; p++) {
+            for (int k = 0; k < DT_SERIES; k++) {
+                out[p * DT_SERIES + k] = downtime_in(job->ix, s[k], job->period_start[p],
+                                                     job->period_start[p + 1]);
+            }
+        }
+    }
+}
+
+/* Availability per bus and calendar month in [from, to] (clipped to the
+   range), written to filename, plus a per-depot summary on screen. */
+int availability_report(const Bus *fleet, int count, Date from, Date to,
+                        const char *downtime_file, const char *filename) {
+    DowntimeIndex ix;
+    int bad;
+    double t0 = now_seconds();
+
+    if (!is_calendar_date(from) || !is_calendar_date(to) ||
+        date_to_civil_days(to) < date_to_civil_days(from)) {
+        printf(COLOR_RED "The period must run forward between real dates.\n" COLOR_RESET);
+        return -1;
+    }
+    if (downtime_load(downtime_file, &ix, &bad) != 0) {
+        printf(COLOR_RED "Memory error loading %s.\n" COLOR_RESET, downtime_file);
+        return -1;
+    }
+    if (bad > 0) {
+        printf(COLOR_YELLOW "Skipped %d malformed line(s) in %s.\n" COLOR_RESET,
+               bad, downtime_file);
+    }
+
+    /* month boundaries, clipped to [from, to] */
+    int nperiods = (to.year - from.year) * 12 + (to.month - from.month) + 1;
+    int *bounds = malloc(((size_t)nperiods + 1) * sizeof *bounds);
+    int *down = malloc(((size_t)count * nperiods * DT_SERIES + 1) * sizeof *down);
+    int *depot = malloc(((size_t)count + 1) * sizeof *depot);
+    if (!bounds || !down || !depot) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+        free(bounds);
+        free(down);
+        free(depot);
+        downtime_free(&ix);
+        return -1;
+    }
+    bounds[0] = date_to_civil_days(from);
+    for (int p = 1; p < nperiods; p++) {
+        Date m = {1, (from.month - 1 + p) % 12 + 1, from.year + (from.month - 1 + p) / 12};
+        bounds[p] = date_to_civil_days(m);
+    }
+    bounds[nperiods] = date_to_civil_days(to) + 1;
+
+    AvailabilityJob job = {fleet, count, &ix, bounds, nperiods, down};
+    run_parallel((count + AVAIL_CHUNK - 1) / AVAIL_CHUNK, availability_task, &job,
+                 cpu_count());
+    for (int i = 0; i < count; i++) depot[i] = depot_id(fleet[i].bus_code);
+    double elapsed = now_seconds() - t0;
+
+    FILE *fp = fopen(filename, "w");
+    int failed = !fp;
+    TextBuf tb = {0};
+    if (fp) {
+        tb_puts(&tb, "Period,Depot,BusNo,Days,ServiceDays,RepairDays,DownDays,Availability\n");
+        for (int p = 0; p < nperiods && !failed; p++) {
+            char period[16], line[160];
+            Date m = date_from_civil_days(bounds[p]);
+            snprintf(period, sizeof period, "%04d-%02d", m.year % 10000, m.month % 100);
+            int days = bounds[p + 1] - bounds[p];
+            for (int i = 0; i < count; i++) {
+                const int *d = down + ((size_t)i * nperiods + p) * DT_SERIES;
+                char *q = line;
+                q = put_text(q, period);
+                *q++ = ',';
+                q = put_text(q, depot[i] >= 0 ? depot_label(depot[i]) : "-");
+                *q++ = ',';
+                q = put_int(q, fleet[i].bus_no);
+                *q++ = ',';
+                q = put_int(q, days);
+                *q++ = ',';
+                q = put_int(q, d[DT_SERVICE]);
+                *q++ = ',';
+                q = put_int(q, d[DT_REPAIR]);
+                *q++ = ',';
+                q = put_int(q, d[DT_ALL]);
+                *q++ = ',';
+                q = put_fixed2(q, (float)(100.0 * (days - d[DT_ALL]) / days));
+                *q++ = '\n';
+                tb_append(&tb, line, (size_t)(q - line));
+                if (tb.len >= REPORT_FLUSH_BYTES) {
+                    failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+                    tb.len = 0;
+                }
+            }
+        }
+        if (!failed && tb.len > 0) failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+        if (fclose(fp) != 0) failed = 1;
+    }
+    tb_free(&tb);
+    if (failed) printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, filename);
+
+    /* per depot over the whole range: bus-days available / bus-days */
+    int ndep = depot_table.ndepots;
+    long long *dep_down = calloc((size_t)ndep * DT_SERIES + 1, sizeof *dep_down);
+    long long *dep_buses = calloc((size_t)ndep + 1, sizeof *dep_buses);
+    long long range_days = bounds[nperiods] - bounds[0];
+    if (dep_down && dep_buses) {
+        long long fleet_down[DT_SERIES] = {0};
+        for (int i = 0; i < count; i++) {
+            if (depot[i] < 0) continue;
+            dep_buses[depot[i]]++;
+            for (int p = 0; p < nperiods; p++) {
+                const int *d = down + ((size_t)i * nperiods + p) * DT_SERIES;
+                for (int k = 0; k < DT_SERIES; k++) {
+                    dep_down[depot[i] * DT_SERIES + k] += d[k];
+                    fleet_down[k] += d[k];
+                }
+            }
+        }
+        printf(COLOR_BOLD "\n=== Availability " COLOR_RESET);
+        print_date(from);
+        printf(COLOR_BOLD " to " COLOR_RESET);
+        print_date(to);
+        printf(COLOR_BOLD " (%lld days) ===\n" COLOR_RESET, range_days);
+        printf("%-10s %8s %12s %12s %12s %9s\n", "Depot", "Buses", "Service d",
+               "Repair d", "Workshop d", "Avail %");
+        for (int id = 0; id < ndep; id++) {
+            if (dep_buses[id] == 0) continue;
+            const long long *d = &dep_down[id * DT_SERIES];
+            printf("%-10s %8lld %12lld %12lld %12lld %8.2f%%\n",
+                   depot_label(id), dep_buses[id], d[DT_SERVICE],
+                   d[DT_REPAIR], d[DT_ALL],
+                   100.0 * (1.0 - (double)d[DT_ALL] / (double)(dep_buses[id] * range_days)));
+        }
+        if (count > 0) {
+            printf(COLOR_BOLD "%-10s %8d %12lld %12lld %12lld %8.2f%%\n" COLOR_RESET,
+                   "FLEET", count, fleet_down[DT_SERVICE], fleet_down[DT_REPAIR],
+                   fleet_down[DT_ALL],
+                   100.0 * (1.0 - (double)fleet_down[DT_ALL] / ((double)count * range_days)));
+        }
+    }
+    free(dep_down);
+    free(dep_buses);
+    if (!failed) {
+        printf(COLOR_GREEN "%d events for %d buses indexed and summarized in %.2f s; "
+               "monthly rows per bus written to %s\n" COLOR_RESET,
+               ix.nevents, ix.nbus, elapsed, filename);
+    }
+
+    free(bounds);
+    free(down);
+    free(depot);
+    downtime_free(&ix);
+    return failed ? -1 : 0;
+}
+
+void record_downtime_menu(Bus *fleet, int count) {
+    char buf[16];
+    int bus_no = read_int_strict("Enter bus number: ", 1, 9999999);
+    if (find_bus_index(fleet, count, bus_no) < 0) {
+        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+        return;
+    }
+    char kind = 0;
+    while (!kind) {
+        printf("Scheduled service or repair? (s/r): ");
+        if (!read_line_stdin(buf, sizeof buf)) continue;
+        if (tolower((unsigned char)buf[0]) == 's') kind = 'S';
+        else if (tolower((unsigned char)buf[0]) == 'r') kind = 'R';
+    }
+    Date start, end = {0, 0, 0};
+    do {
+        start = read_date("Date the bus went into the workshop (dd/mm/yyyy): ");
+    } while (!is_calendar_date(start));
+    while (1) {
+        printf("Date it came back (dd/mm/yyyy, empty if still in): ");
+        if (!read_line_stdin(buf, sizeof buf)) continue;
+        if (buf[0] == '\0') break;
+        if (parse_date_arg(buf, &end) && is_calendar_date(end) &&
+            date_to_civil_days(end) >= date_to_civil_days(start)) break;
+        printf(COLOR_RED "Invalid date, or before the start.\n" COLOR_RESET);
+        end.day = end.month = end.year = 0;
+    }
+    if (append_downtime_event(DOWNTIME_FILE, bus_no, kind, start, end) != 0) {
+        printf(COLOR_RED "Could not append to %s.\n" COLOR_RESET, DOWNTIME_FILE);
+        return;
+    }
+    printf(COLOR_GREEN "Downtime recorded in %s.\n" COLOR_RESET, DOWNTIME_FILE);
+}
+
+void availability_menu(Bus *fleet, int count) {
+    Date from = read_date("Period start (dd/mm/yyyy): ");
+    Date to = read_date("Period end (dd/mm/yyyy): ");
+    availability_report(fleet, count, from, to, DOWNTIME_FILE, AVAILABILITY_FILE);
+}
+
+/* ---------- Cost projection ---------- */
+
+/* COST_MODEL_FILE lists service types, one per line:
+       NAME FIXED PER_KM [every N]
+   A type is charged at every service whose number (service_history_count
+   + 1, + 2, ...) is a multiple of N (default 1); the per-km part applies
+   to the km driven since the previous service. Each bus's services over
+   the next COST_MONTHS calendar months are forecast from its due date,
+   then repeat every interval (days, or km at avg_daily_km, whichever
+   comes first), and their cost is added to the month and depot they
+   fall in. Results are cached for the reference date: asking again after
+   a few edits only re-projects buses whose change_seq moved. */
+#define COST_MODEL_FILE "cost_model.txt"
+#define COST_FILE       "cost_projection.csv"
+#define COST_MONTHS     12
+#define COST_MAX_TYPES  16
+#define COST_CHUNK      4096
+
+typedef struct {
+    char   name[24];
+    double fixed;
+    double per_km;
+    int    every;
+} ServiceCost;
+
+typedef struct {
+    ServiceCost types[COST_MAX_TYPES];
+    int         ntypes;
+    time_t      mtime;
+} CostModel;
+
+typedef struct {
+    int           bus_no;
+    int           change_seq;
+    int           depot;
+    float         cost[COST_MONTHS];
+    unsigned char services[COST_MONTHS];
+} BusCost;
+
+typedef struct {
+    int       valid;
+    Date      today;
+    CostModel model;
+    int       bounds[COST_MONTHS + 1];   /* civil day each month starts */
+    BusCost  *bus;                       /* sorted by bus_no */
+    int       nbus;
+    int       cap;
+    double   *depot_cost;                /* [depot][month] */
+    long     *depot_services;
+    int       ndepots;
+} CostCache;
+
+static CostCache cost_cache;
+
+/* Returns 1 if a model with at least one type was read. */
+int cost_model_load(const char *filename, CostModel *m) {
+    struct stat st;
+    char line[256];
+    int line_no = 0;
+    FILE *fp = fopen(filename, "r");
+    memset(m, 0, sizeof *m);
+    if (!fp) return 0;
+    if (stat(filename, &st) == 0) m->mtime = st.st_mtime;
+    while (fgets(line, sizeof line, fp)) {
+        ServiceCost c = {"", 0.0, 0.0, 1};
+        char every_kw[16] = "";
+        line_no++;
+        int n = sscanf(line, "%23s %lf %lf %15s %d", c.name, &c.fixed, &c.per_km,
+                       every_kw, &c.every);
+        if (n <= 0 || c.name[0] == '#') continue;
+        if ((n != 3 && !(n == 5 && strcmp(every_kw, "every") == 0)) ||
+            c.fixed < 0.0 || c.per_km < 0.0 || c.every < 1 ||
+            m->ntypes == COST_MAX_TYPES) {
+            printf(COLOR_YELLOW "%s:%d: ignoring '%.*s'\n" COLOR_RESET, filename,
+                   line_no, (int)strcspn(line, "\r\n"), line);
+            continue;
+        }
+        m->types[m->ntypes++] = c;
+    }
+    fclose(fp);
+    return m->ntypes > 0;
+}
+
+/* Month (0-based) that civil day `day` falls in, or -1 past the horizon. */
+static int cost_month(const int *bounds, int day) {
+    if (day < bounds[0]) return 0;
+    for (int m = 0; m < COST_MONTHS; m++) {
+        if (day < bounds[m + 1]) return m;
+    }
+    return -1;
+}
+
+void project_bus_cost(const Bus *b, Date today, const int *bounds,
+                      const CostModel *model, BusCost *out) {
+    memset(out->cost, 0, sizeof out->cost);
+    memset(out->services, 0, sizeof out->services);
+    out->bus_no = b->bus_no;
+    out->change_seq = b->change_seq;
+
+    int offset = forecast_due_day(b, today);
+    if (offset == DUE_NEVER) return;
+    if (offset < 0) offset = 0;            /* overdue: due now */
+    int base = date_to_civil_days(today);
+    int day = base + offset;
+    double prev_km = b->last_service_mileage;
+    double avg = b->avg_daily_km > 0.0f ? b->avg_daily_km : 0.0;
+    int km_period = (avg > 0.0 && b->service_interval_km > 0.0f)
+                        ? ceil_div_days(b->service_interval_km, avg) : 0;
+    if (km_period == DUE_NEVER) km_period = 0;
+
+    for (int n = b->service_history_count + 1;; n++) {
+        int m = cost_month(bounds, day);
+        if (m < 0) break;
+        double km = b->current_mileage + avg * (day - base);
+        double driven = km > prev_km ? km - prev_km : 0.0;
+        double cost = 0.0;
+        for (int t = 0; t < model->ntypes; t++) {
+            if (n % model->types[t].every == 0)
+                cost += model->types[t].fixed + model->types[t].per_km * driven;
+        }
+        out->cost[m] += (float)cost;
+        if (out->services[m] < 255) out->services[m]++;
+        prev_km = km;
+
+        /* next service: the earlier of the day and km intervals */
+        int next = INT_MAX;
+        if (b->service_interval_days > 0) {
+            next = workshop.loaded
+                ? date_to_civil_days(add_working_days(date_from_civil_days(day),
+                                                      b->service_interval_days))
+                : day + b->service_interval_days;
+        }
+        if (km_period > 0 && day + km_period < next) next = day + km_period;
+        if (next == INT_MAX || next <= day) break;
+        day = next;
+    }
+}
+
+static int compare_bus_cost(const void *a, const void *b) {
+    int x = ((const BusCost *)a)->bus_no, y = ((const BusCost *)b)->bus_no;
+    return (x > y) - (x < y);
+}
+
+static void cost_account(const BusCost *c, int sign) {
+    if (c->depot < 0 || c->depot >= cost_cache.ndepots) return;
+    for (int m = 0; m < COST_MONTHS; m++) {
+        cost_cache.depot_cost[c->depot * COST_MONTHS + m] += sign * (double)c->cost[m];
+        cost_cache.depot_services[c->depot * COST_MONTHS + m] += sign * c->services[m];
+    }
+}
+
+/* Sizes the per-depot totals for every depot interned so far. */
+static int cost_depots_grow(void) {
+    int n = depot_table.ndepots;
+    if (n <= cost_cache.ndepots) return 1;
+    double *dc = realloc(cost_cache.depot_cost, (size_t)n * COST_MONTHS * sizeof *dc);
+    if (!dc) return 0;
+    cost_cache.depot_cost = dc;
+    long *ds = realloc(cost_cache.depot_services, (size_t)n * COST_MONTHS * sizeof *ds);
+    if (!ds) return 0;
+    cost_cache.depot_services = ds;
+    memset(dc + (size_t)cost_cache.ndepots * COST_MONTHS, 0,
+           (size_t)(n - cost_cache.ndepots) * COST_MONTHS * sizeof *dc);
+    memset(ds + (size_t)cost_cache.ndepots * COST_MONTHS, 0,
+           (size_t)(n - cost_cache.ndepots) * COST_MONTHS * sizeof *ds);
+    cost_cache.ndepots = n;
+    return 1;
+}
+
+typedef struct {
+    const Bus *fleet;
+    int        count;
+} CostJob;
+
+static void cost_task(void *ctx, int task) {
+    CostJob *job = ctx;
+    int lo = task * COST_CHUNK;
+    int hi = (lo + COST_CHUNK < job->count) ? lo + COST_CHUNK : job->count;
+    for (int i = lo; i < hi; i++) {
+        project_bus_cost(&job->fleet[i], cost_cache.today, cost_cache.bounds,
+                         &cost_cache.model, &cost_cache.bus[i]);
+    }
+}
+
+/* Only buses whose change_seq differs from the cached one are projected
+   again; returns 0 if the cache cannot be patched (a bus was added or
+   removed) and needs a full run. */
+static int cost_update(const Bus *fleet, int count, int *recomputed) {
+    if (count != cost_cache.nbus) return 0;
+    BusCost key;
+    for (int i = 0; i < count; i++) {
+        key.bus_no = fleet[i].bus_no;
+        BusCost *c = bsearch(&key, cost_cache.bus, (size_t)cost_cache.nbus,
+                             sizeof key, compare_bus_cost);
+        if (!c) return 0;
+        if (c->change_seq == fleet[i].change_seq) continue;
+        int depot = depot_id(fleet[i].bus_code);
+        if (!cost_depots_grow()) return 0;
+        cost_account(c, -1);
+        project_bus_cost(&fleet[i], cost_cache.today, cost_cache.bounds,
+                         &cost_cache.model, c);
+        c->depot = depot;
+        cost_account(c, +1);
+        (*recomputed)++;
+    }
+    return 1;
+}
+
+/* Brings the cache up to date for today; returns -1 if there is no cost
+   model or memory runs out. *recomputed = buses projected this time. */
+int cost_projection(const Bus *fleet, int count, Date today, int *recomputed) {
+    struct stat st;
+    *recomputed = 0;
+    if (cost_cache.valid && cost_cache.today.day == today.day &&
+        cost_cache.today.month == today.month && cost_cache.today.year == today.year &&
+        stat(COST_MODEL_FILE, &st) == 0 && st.st_mtime == cost_cache.model.mtime &&
+        cost_update(fleet, count, recomputed)) {
+        return 0;
+    }
+
+    cost_cache.valid = 0;
+    *recomputed = 0;
+    if (!cost_model_load(COST_MODEL_FILE, &cost_cache.model)) {
+        printf(COLOR_RED "No cost model. Create %s with lines like:\n" COLOR_RESET
+               "  # type    fixed   per_km  [every N]\n"
+               "  service   4500    0.35\n"
+               "  major     18000   0.00    every 4\n", COST_MODEL_FILE);
+        return -1;
+    }
+    if (count > cost_cache.cap) {
+        BusCost *tmp = realloc(cost_cache.bus, (size_t)count * sizeof *tmp);
+        if (!tmp) return -1;
+        cost_cache.bus = tmp;
+        cost_cache.cap = count;
+    }
+    cost_cache.today = today;
+    cost_cache.nbus = count;
+    Date first = {1, today.month, today.year};
+    if (!is_calendar_date(first)) return -1;
+    cost_cache.bounds[0] = date_to_civil_days(today);
+    for (int m = 1; m <= COST_MONTHS; m++) {
+        Date d = {1, (today.month - 1 + m) % 12 + 1, today.year + (today.month - 1 + m) / 12};
+        cost_cache.bounds[m] = date_to_civil_days(d);
+    }
+
+    CostJob job = {fleet, count};
+    run_parallel((count + COST_CHUNK - 1) / COST_CHUNK, cost_task, &job, cpu_count());
+    for (int i = 0; i < count; i++) cost_cache.bus[i].depot = depot_id(fleet[i].bus_code);
+    if (!cost_depots_grow()) return -1;
+    memset(cost_cache.depot_cost, 0,
+           (size_t)cost_cache.ndepots * COST_MONTHS * sizeof *cost_cache.depot_cost);
+    memset(cost_cache.depot_services, 0,
+           (size_t)cost_cache.ndepots * COST_MONTHS * sizeof *cost_cache.depot_services);
+    for (int i = 0; i < count; i++) cost_account(&cost_cache.bus[i], +1);
+    qsort(cost_cache.bus, (size_t)count, sizeof *cost_cache.bus, compare_bus_cost);
+    cost_cache.valid = 1;
+    *recomputed = count;
+    return 0;
+}
+
+int export_cost_projection(const Bus *fleet, int count, Date today,
+                           const char *filename) {
+    int recomputed;
+    double t0 = now_seconds();
+    if (cost_projection(fleet, count, today, &recomputed) != 0) return -1;
+    double elapsed = now_seconds() - t0;
+
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+    double month_cost[COST_MONTHS] = {0};
+    long month_services[COST_MONTHS] = {0};
+    char month[COST_MONTHS][16];
+    fprintf(fp, "Month,Depot,Services,Cost\n");
+    for (int m = 0; m < COST_MONTHS; m++) {
+        Date d = date_from_civil_days(cost_cache.bounds[m]);
+        snprintf(month[m], sizeof month[m], "%04d-%02d", d.year % 10000, d.month % 100);
+        for (int id = 0; id < cost_cache.ndepots; id++) {
+            long services = cost_cache.depot_services[id * COST_MONTHS + m];
+            double cost = cost_cache.depot_cost[id * COST_MONTHS + m];
+            if (services == 0) continue;
+            fprintf(fp, "%s,%s,%ld,%.2f\n", month[m], depot_label(id),
+                    services, cost);
+            month_cost[m] += cost;
+            month_services[m] += services;
+        }
+    }
+    int failed = fclose(fp) != 0;
+    if (failed) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+
+    double total = 0.0;
+    printf(COLOR_BOLD "\n=== Maintenance cost projection from " COLOR_RESET);
+    print_date(today);
+    printf(COLOR_BOLD " ===\n" COLOR_RESET);
+    printf("%-8s %10s %16s\n", "Month", "Services", "Cost");
+    for (int m = 0; m < COST_MONTHS; m++) {
+        printf("%-8s %10ld %16.2f\n", month[m], month_services[m], month_cost[m]);
+        total += month_cost[m];
+    }
+    printf(COLOR_BOLD "%-8s %10s %16.2f\n" COLOR_RESET, "Total", "", total);
+    printf(COLOR_GREEN "%d of %d buses projected in %.3f s; per-depot months in %s\n"
+           COLOR_RESET, recomputed, count, elapsed, filename);
+    return 0;
+}
+
+/* ---------- Streaming report pipeline ---------- */
+
+/* --report never holds the whole fleet: records flow through a fixed set
+   of batches, parse -> status -> format -> write, one thread per stage,
+   so memory is REPORT_BATCHES * REPORT_BATCH_SIZE records whatever the
+   size of the data file. */
+#define REPORT_BATCH_SIZE 4096
+#define REPORT_BATCHES    4
+
+typedef struct {
+    Bus     recs[REPORT_BATCH_SIZE];
+    int     n;
+    int     last;       /* end-of-stream marker */
+    TextBuf out;
+} ReportBatch;
+
+typedef struct {
+    LineReader  reader;
+    Date        today;
+    WorkQueue   free_q;
+    WorkQueue   parsed_q;
+    WorkQueue   formatted_q;
+    long        bad_lines;
+} ReportPipeline;
+
+static void *report_parse_stage(void *arg) {
+    ReportPipeline *p = arg;
+    char *line;
+    size_t len;
+    int done = 0;
+
+    while (!done) {
+        ReportBatch *batch = wq_pop(&p->free_q);
+        batch->n = 0;
+        batch->last = 0;
+        while (batch->n < REPORT_BATCH_SIZE) {
+            line = lr_next(&p->reader, &len);
+            if (!line) {
+                done = 1;
+                break;
+            }
+            if (len == 0) continue;
+            if (p->reader.line_no == 1 && !memchr(line, '|', len)) {
+                continue;               /* record-count header */
+            }
+            if (parse_bus_line(line, &batch->recs[batch->n])) {
+                batch->n++;
+            } else {
+                p->bad_lines++;
+            }
+        }
+        batch->last = done;
+        wq_push(&p->parsed_q, batch);
+    }
+    return NULL;
+}
+
+static void *report_format_stage(void *arg) {
+    ReportPipeline *p = arg;
+    int last = 0;
+
+    while (!last) {
+        ReportBatch *batch = wq_pop(&p->parsed_q);
+        batch->out.len = 0;
+        for (int i = 0; i < batch->n; i++) {
+            update_maintenance_status(&batch->recs[i], p->today);
+            format_report_row(&batch->out, &batch->recs[i]);
+        }
+        last = batch->last;
+        wq_push(&p->formatted_q, batch);
+    }
+    return NULL;
+}
+
+/* Returns 0 on success. The calling thread is the writer stage. */
+int stream_report(const char *in_file, const char *out_file, Date today) {
+    ReportPipeline p;
+    ReportBatch *batches[REPORT_BATCHES] = {0};
+    fg_thread parse_thread, format_thread;
+    long rows = 0;
+    int rc = 0;
+
+    memset(&p, 0, sizeof p);
+    p.today = today;
+    if (!lr_open(&p.reader, in_file)) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, in_file);
+        return 1;
+    }
+    FILE *fp = fopen(out_file, "wb");
+    if (!fp) {
+        printf(COLOR_RED "Could not open report file.\n" COLOR_RESET);
+        lr_close(&p.reader);
+        return 1;
+    }
+
+    wq_init(&p.free_q, REPORT_BATCHES);
+    wq_init(&p.parsed_q, REPORT_BATCHES);
+    wq_init(&p.formatted_q, REPORT_BATCHES);
+    for (int i = 0; i < REPORT_BATCHES; i++) {
+        batches[i] = calloc(1, sizeof(ReportBatch));
+        if (!batches[i]) {
+            printf(COLOR_RED "Memory allocation failed.\n" COLOR_RESET);
+            rc = 1;
+            goto cleanup;
+        }
+        wq_push(&p.free_q, batches[i]);
+    }
+
+    fputs(REPORT_HEADER, fp);
+
+    if (!fg_thread_start(&format_thread, report_format_stage, &p)) {
+        printf(COLOR_RED "Could not start worker thread.\n" COLOR_RESET);
+        rc = 1;
+        goto cleanup;
+    }
+    if (!fg_thread_start(&parse_thread, report_parse_stage, &p)) {
+        /* Let the formatter see an empty end-of-stream batch and exit. */
+        ReportBatch *batch = wq_pop(&p.free_q);
+        batch->n = 0;
+        batch->last = 1;
+        wq_push(&p.parsed_q, batch);
+        fg_thread_join(format_thread);
+        printf(COLOR_RED "Could not start worker thread.\n" COLOR_RESET);
+        rc = 1;
+        goto cleanup;
+    }
+
+    int last = 0;
+    while (!last) {
+        ReportBatch *batch = wq_pop(&p.formatted_q);
+        if (batch->out.len > 0 &&
+            fwrite(batch->out.data, 1, batch->out.len, fp) != batch->out.len) {
+            rc = 1;
+        }
+        rows += batch->n;
+        last = batch->last;
+        if (!last) wq_push(&p.free_q, batch);
+    }
+
+    fg_thread_join(parse_thread);
+    fg_thread_join(format_thread);
+
+cleanup:
+    if (fclose(fp) != 0) rc = 1;
+    lr_close(&p.reader);
+    for (int i = 0; i < REPORT_BATCHES; i++) {
+        if (batches[i]) {
+            tb_free(&batches[i]->out);
+            free(batches[i]);
+        }
+    }
+    wq_destroy(&p.free_q);
+    wq_destroy(&p.parsed_q);
+    wq_destroy(&p.formatted_q);
+
+    if (rc == 0) {
+        printf(COLOR_GREEN "CSV report exported to %s (%ld buses)\n" COLOR_RESET,
+               out_file, rows);
+        if (p.bad_lines > 0) {
+            printf(COLOR_YELLOW "Warning: skipped %ld corrupted line(s).\n"
+                   COLOR_RESET, p.bad_lines);
+        }
+    }
+    return rc;
+}
+
+/* ---------- Arrow IPC export ---------- */
+
+/* Writes the fleet as an Arrow IPC file (Feather v2), readable directly by
+   pyarrow, pandas, polars, DuckDB and friends. Layout:
+     "ARROW1\0\0", Schema message, one RecordBatch message per
+     ARROW_BATCH_ROWS buses, end-of-stream marker, Footer, footer length,
+     "ARROW1".
+   Message metadata is flatbuffers, built back to front by the small
+   builder below. Each batch body is one column after another, gathered
+   straight out of the Bus array; only the dates are converted (to Date32
+   days since 1970) and the status is written as its label. Like the
+   snapshot, this assumes a little-endian host. */
+#define ARROW_MAGIC        "ARROW1"
+#define ARROW_BATCH_ROWS   65536
+#define ARROW_METADATA_V5  4
+
+enum { ARROW_HEADER_SCHEMA = 1, ARROW_HEADER_RECORD_BATCH = 3 };
+enum { ARROW_TYPE_INT = 2, ARROW_TYPE_FLOAT = 3, ARROW_TYPE_UTF8 = 5,
+       ARROW_TYPE_DATE = 8 };
+
+typedef struct {
+    uint8_t *buf;
+    size_t   cap;
+    size_t   head;          /* bytes used, counted back from buf + cap */
+    size_t   minalign;
+    size_t   table_start;
+    size_t   slots[8];      /* per field id: head after writing it, 0 = absent */
+    int      nslots;
+    int      failed;
+} FbBuilder;
+
+static void fb_reset(FbBuilder *b) {
+    b->head = 0;
+    b->minalign = 1;
+    b->failed = 0;
+}
+
+static int fb_grow(FbBuilder *b, size_t need) {
+    if (b->cap - b->head >= need) return 1;
+    size_t new_cap = b->cap ? b->cap : 1024;
+    while (new_cap - b->head < need) new_cap *= 2;
+    uint8_t *nb = malloc(new_cap);
+    if (!nb) {
+        b->failed = 1;
+        return 0;
+    }
+    if (b->head > 0) memcpy(nb + new_cap - b->head, b->buf + b->cap - b->head, b->head);
+    free(b->buf);
+    b->buf = nb;
+    b->cap = new_cap;
+    return 1;
+}
+
+static void fb_push(FbBuilder *b, const void *p, size_t n) {
+    if (n == 0 || !fb_grow(b, n)) return;
+    b->head += n;
+    memcpy(b->buf + b->cap - b->head, p, n);
+}
+
+/* Pads so that after `extra` more bytes the head sits on `align`. */
+static void fb_prep(FbBuilder *b, size_t align, size_t extra) {
+    static const uint8_t zeros[8] = {0};
+    if (align > b->minalign) b->minalign = align;
+    fb_push(b, zeros, (0 - (b->head + extra)) & (align - 1));
+}
+
+static void fb_uoffset(FbBuilder *b, size_t target) {
+    fb_prep(b, 4, 0);
+    uint32_t v = (uint32_t)(b->head + 4 - target);
+    fb_push(b, &v, 4);
+}
+
+static void fb_start_table(FbBuilder *b) {
+    b->table_start = b->head;
+    b->nslots = 0;
+    memset(b->slots, 0, sizeof b->slots);
+}
+
+static void fb_slot(FbBuilder *b, int id) {
+    b->slots[id] = b->head;
+    if (id >= b->nslots) b->nslots = id + 1;
+}
+
+static void fb_field_u8(FbBuilder *b, int id, uint8_t v) {
+    fb_push(b, &v, 1);
+    fb_slot(b, id);
+}
+
+static void fb_field_i16(FbBuilder *b, int id, int16_t v) {
+    fb_prep(b, 2, 0);
+    fb_push(b, &v, 2);
+    fb_slot(b, id);
+}
+
+static void fb_field_i32(FbBuilder *b, int id, int32_t v) {
+    fb_prep(b, 4, 0);
+    fb_push(b, &v, 4);
+    fb_slot(b, id);
+}
+
+static void fb_field_i64(FbBuilder *b, int id, int64_t v) {
+    fb_prep(b, 8, 0);
+    fb_push(b, &v, 8);
+    fb_slot(b, id);
+}
+
+static void fb_field_offset(FbBuilder *b, int id, size_t target) {
+    fb_uoffset(b, target);
+    fb_slot(b, id);
+}
+
+/* Closes the table: soffset to a vtable written just in front of it. */
+static size_t fb_end_table(FbBuilder *b) {
+    int32_t soffset = 0;
+    fb_prep(b, 4, 0);
+    fb_push(b, &soffset, 4);
+    size_t table = b->head;
+
+    for (int i = b->nslots - 1; i >= 0; i--) {
+        uint16_t at = b->slots[i] ? (uint16_t)(table - b->slots[i]) : 0;
+        fb_push(b, &at, 2);
+    }
+    uint16_t table_size = (uint16_t)(table - b->table_start);
+    uint16_t vtable_size = (uint16_t)(4 + 2 * b->nslots);
+    fb_push(b, &table_size, 2);
+    fb_push(b, &vtable_size, 2);
+
+    if (!b->failed) {
+        soffset = (int32_t)(b->head - table);
+        memcpy(b->buf + b->cap - table, &soffset, 4);
+    }
+    return table;
+}
+
+static size_t fb_string(FbBuilder *b, const char *s) {
+    uint32_t len = (uint32_t)strlen(s);
+    fb_prep(b, 4, len + 1);
+    fb_push(b, "", 1);
+    fb_push(b, s, len);
+    fb_push(b, &len, 4);
+    return b->head;
+}
+
+static size_t fb_offset_vector(FbBuilder *b, const size_t *items, int n) {
+    uint32_t len = (uint32_t)n;
+    fb_prep(b, 4, 4 * (size_t)n);
+    for (int i = n - 1; i >= 0; i--) fb_uoffset(b, items[i]);
+    fb_push(b, &len, 4);
+    return b->head;
+}
+
+/* Vector of 8-byte-aligned structs already laid out in `items`. */
+static size_t fb_struct_vector(FbBuilder *b, const void *items, int n, size_t size) {
+    uint32_t len = (uint32_t)n;
+    fb_prep(b, 4, size * (size_t)n);
+    fb_prep(b, 8, size * (size_t)n);
+    fb_push(b, items, size * (size_t)n);
+    fb_push(b, &len, 4);
+    return b->head;
+}
+
+static const uint8_t *fb_finish(FbBuilder *b, size_t root, size_t *size) {
+    fb_prep(b, b->minalign, 4);
+    fb_uoffset(b, root);
+    *size = b->head;
+    return b->failed ? NULL : b->buf + b->cap - b->head;
+}
+
+typedef enum {
+    ARROW_INT32,
+    ARROW_FLOAT32,
+    ARROW_DATE32,
+    ARROW_UTF8,
+    ARROW_STATUS
+} ArrowKind;
+
+typedef struct {
+    const char *name;
+    ArrowKind   kind;
+    size_t      offset;
+} ArrowColumn;
+
+static const ArrowColumn arrow_columns[] = {
+    {"bus_no",                ARROW_INT32,   offsetof(Bus, bus_no)},
+    {"bus_code",              ARROW_UTF8,    offsetof(Bus, bus_code)},
+    {"driver_name",           ARROW_UTF8,    offsetof(Bus, driver_name)},
+    {"last_service",          ARROW_DATE32,  offsetof(Bus, last_service)},
+    {"next_due",              ARROW_DATE32,  offsetof(Bus, next_due)},
+    {"current_mileage",       ARROW_FLOAT32, offsetof(Bus, current_mileage)},
+    {"last_service_mileage",  ARROW_FLOAT32, offsetof(Bus, last_service_mileage)},
+    {"service_interval_km",   ARROW_FLOAT32, offsetof(Bus, service_interval_km)},
+    {"service_interval_days", ARROW_INT32,   offsetof(Bus, service_interval_days)},
+    {"service_history_count", ARROW_INT32,   offsetof(Bus, service_history_count)},
+    {"status",                ARROW_STATUS,  offsetof(Bus, status)},
+    {"km_left",               ARROW_FLOAT32, offsetof(Bus, km_left)},
+    {"health_score",          ARROW_INT32,   offsetof(Bus, health_score)},
+    {"avg_daily_km",          ARROW_FLOAT32, offsetof(Bus, avg_daily_km)},
+    {"fuel_efficiency",       ARROW_FLOAT32, offsetof(Bus, fuel_efficiency)},
+    {"change_seq",            ARROW_INT32,   offsetof(Bus, change_seq)},
+};
+#define ARROW_NCOLS ((int)(sizeof arrow_columns / sizeof arrow_columns[0]))
+
+typedef struct { int64_t length, null_count; } ArrowFieldNode;
+typedef struct { int64_t offset, length; } ArrowBuffer;
+typedef struct {
+    int64_t offset;
+    int32_t meta_len;
+    int32_t pad;
+    int64_t body_len;
+} ArrowBlock;
+
+static size_t arrow_build_schema(FbBuilder *b) {
+    size_t fields[sizeof arrow_columns / sizeof arrow_columns[0]];
+
+    for (int c = 0; c < ARROW_NCOLS; c++) {
+        const ArrowColumn *col = &arrow_columns[c];
+        uint8_t type_type = ARROW_TYPE_UTF8;
+        size_t name = fb_string(b, col->name);
+        size_t children = fb_offset_vector(b, NULL, 0);
+
+        fb_start_table(b);
+        switch (col->kind) {
+            case ARROW_INT32:
+                fb_field_i32(b, 0, 32);          /* bitWidth */
+                fb_field_u8(b, 1, 1);            /* is_signed */
+                type_type = ARROW_TYPE_INT;
+                break;
+            case ARROW_FLOAT32:
+                fb_field_i16(b, 0, 1);           /* precision SINGLE */
+                type_type = ARROW_TYPE_FLOAT;
+                break;
+            case ARROW_DATE32:
+                fb_field_i16(b, 0, 0);           /* unit DAY */
+                type_type = ARROW_TYPE_DATE;
+                break;
+            default:
+                break;
+        }
+        size_t type = fb_end_table(b);
+
+        fb_start_table(b);
+        fb_field_offset(b, 0, name);
+        fb_field_offset(b, 3, type);
+        fb_field_offset(b, 5, children);
+        fb_field_u8(b, 1, col->kind == ARROW_DATE32);   /* nullable */
+        fb_field_u8(b, 2, type_type);
+        fields[c] = fb_end_table(b);
+    }
+
+    size_t vec = fb_offset_vector(b, fields, ARROW_NCOLS);
+    fb_start_table(b);
+    fb_field_offset(b, 1, vec);
+    fb_field_i16(b, 0, 0);                       /* little-endian */
+    return fb_end_table(b);
+}
+
+static size_t arrow_message(FbBuilder *b, uint8_t header_type, size_t header,
+                            int64_t body_len) {
+    fb_start_table(b);
+    fb_field_i64(b, 3, body_len);
+    fb_field_offset(b, 2, header);
+    fb_field_i16(b, 0, ARROW_METADATA_V5);
+    fb_field_u8(b, 1, header_type);
+    return fb_end_table(b);
+}
+
+/* Continuation marker, metadata length, flatbuffer padded to 8 bytes. */
+static int arrow_write_message(FILE *fp, FbBuilder *b, size_t root, int32_t *meta_len) {
+    static const uint8_t zeros[8] = {0};
+    size_t n;
+    const uint8_t *p = fb_finish(b, root, &n);
+    if (!p) return -1;
+    size_t padded = (n + 7) & ~(size_t)7;
+    uint32_t prefix[2] = {0xFFFFFFFFu, (uint32_t)padded};
+    if (fwrite(prefix, sizeof prefix, 1, fp) != 1 ||
+        fwrite(p, 1, n, fp) != n ||
+        fwrite(zeros, 1, padded - n, fp) != padded - n) {
+        return -1;
+    }
+    *meta_len = (int32_t)(sizeof prefix + padded);
+    return 0;
+}
+
+/* Reserves an 8-byte-aligned body buffer of n bytes and records it. */
+static uint8_t *arrow_body_alloc(TextBuf *body, ArrowBuffer *out, size_t n) {
+    size_t padded = (n + 7) & ~(size_t)7;
+    if (!tb_reserve(body, padded)) return NULL;
+    uint8_t *p = (uint8_t *)body->data + body->len;
+    memset(p + n, 0, padded - n);
+    out->offset = (int64_t)body->len;
+    out->length = (int64_t)n;
+    body->len += padded;
+    return p;
+}
+
+static const char *arrow_text(const ArrowColumn *col, const Bus *b) {
+    if (col->kind == ARROW_STATUS) return status_label(b->status);
+    return (const char *)b + col->offset;
+}
+
+static int arrow_date_valid(const Bus *b, size_t offset) {
+    Date d;
+    memcpy(&d, (const char *)b + offset, sizeof d);
+    return d.year > 0 && is_valid_date(d);
+}
+
+/* Appends one column of a batch; returns the number of buffers used. */
+static int arrow_gather_column(TextBuf *body, const ArrowColumn *col,
+                               const Bus *rows, int n,
+                               ArrowFieldNode *node, ArrowBuffer *bufs) {
+    int64_t nulls = 0;
+    if (col->kind == ARROW_DATE32) {
+        for (int i = 0; i < n; i++) nulls += !arrow_date_valid(&rows[i], col->offset);
+    }
+    node->length = n;
+    node->null_count = nulls;
+
+    bufs[0].offset = (int64_t)body->len;
+    bufs[0].length = 0;
+    if (nulls > 0) {
+        uint8_t *bits = arrow_body_alloc(body, &bufs[0], ((size_t)n + 7) / 8);
+        if (!bits) return -1;
+        memset(bits, 0, ((size_t)n + 7) / 8);
+        for (int i = 0; i < n; i++) {
+            if (arrow_date_valid(&rows[i], col->offset))
+                bits[i >> 3] |= (uint8_t)(1u << (i & 7));
+        }
+    }
+
+    if (col->kind == ARROW_UTF8 || col->kind == ARROW_STATUS) {
+        int32_t *offs = (int32_t *)arrow_body_alloc(body, &bufs[1], 4 * ((size_t)n + 1));
+        if (!offs) return -1;
+        int32_t total = 0;
+        offs[0] = 0;
+        for (int i = 0; i < n; i++) {
+            total += (int32_t)strlen(arrow_text(col, &rows[i]));
+            offs[i + 1] = total;
+        }
+        uint8_t *dst = arrow_body_alloc(body, &bufs[2], (size_t)total);
+        if (!dst) return -1;
+        offs = (int32_t *)(body->data + bufs[1].offset);
+        for (int i = 0; i < n; i++) {
+            memcpy(dst + offs[i], arrow_text(col, &rows[i]),
+                   (size_t)(offs[i + 1] - offs[i]));
+        }
+        return 3;
+    }
+
+    uint8_t *dst = arrow_body_alloc(body, &bufs[1], 4 * (size_t)n);
+    if (!dst) return -1;
+    const char *src = (const char *)rows + col->offset;
+    if (col->kind == ARROW_DATE32) {
+        for (int i = 0; i < n; i++, src += sizeof(Bus)) {
+            Date d;
+            memcpy(&d, src, sizeof d);
+            int32_t days = arrow_date_valid(&rows[i], col->offset)
+                           ? date_to_civil_days(d) : 0;
+            memcpy(dst + 4 * (size_t)i, &days, 4);
+        }
+    } else {
+        for (int i = 0; i < n; i++, src += sizeof(Bus)) {
+            memcpy(dst + 4 * (size_t)i, src, 4);
+        }
+    }
+    return 2;
+}
+
+int write_arrow_file(const char *filename, Bus *fleet, int count) {
+    static const char magic[8] = ARROW_MAGIC;
+    static const uint32_t eos[2] = {0xFFFFFFFFu, 0};
+    char tmp_name[512];
+    FbBuilder fb = {0};
+    TextBuf body = {0};
+    ArrowFieldNode nodes[sizeof arrow_columns / sizeof arrow_columns[0]];
+    ArrowBuffer bufs[3 * (sizeof arrow_columns / sizeof arrow_columns[0])];
+    int nbatches = (count + ARROW_BATCH_ROWS - 1) / ARROW_BATCH_ROWS;
+    ArrowBlock *blocks = calloc((size_t)nbatches + 1, sizeof *blocks);
+    long long pos = sizeof magic;
+    int32_t meta_len;
+
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+    FILE *fp = blocks ? fopen(tmp_name, "wb") : NULL;
+    if (!fp) {
+        free(blocks);
+        return -1;
+    }
+
+    fb_reset(&fb);
+    size_t schema = arrow_build_schema(&fb);
+    int failed = fwrite(magic, sizeof magic, 1, fp) != 1 ||
+                 arrow_write_message(fp, &fb, arrow_message(&fb, ARROW_HEADER_SCHEMA,
+                                                            schema, 0), &meta_len) != 0;
+    pos += meta_len;
+
+    for (int batch = 0; !failed && batch < nbatches; batch++) {
+        Bus *rows = &fleet[batch * ARROW_BATCH_ROWS];
+        int n = count - batch * ARROW_BATCH_ROWS;
+        if (n > ARROW_BATCH_ROWS) n = ARROW_BATCH_ROWS;
+
+        int nbufs = 0;
+        body.len = 0;
+        for (int c = 0; !failed && c < ARROW_NCOLS; c++) {
+            int used = arrow_gather_column(&body, &arrow_columns[c], rows, n,
+                                           &nodes[c], &bufs[nbufs]);
+            if (used < 0) failed = 1;
+            else nbufs += used;
+        }
+        if (failed) break;
+
+        fb_reset(&fb);
+        size_t buf_vec = fb_struct_vector(&fb, bufs, nbufs, sizeof bufs[0]);
+        size_t node_vec = fb_struct_vector(&fb, nodes, ARROW_NCOLS, sizeof nodes[0]);
+        fb_start_table(&fb);
+        fb_field_i64(&fb, 0, n);
+        fb_field_offset(&fb, 1, node_vec);
+        fb_field_offset(&fb, 2, buf_vec);
+        size_t rb = fb_end_table(&fb);
+
+        blocks[batch].offset = pos;
+        blocks[batch].body_len = (int64_t)body.len;
+        failed = arrow_write_message(fp, &fb, arrow_message(&fb, ARROW_HEADER_RECORD_BATCH,
+                                                            rb, (int64_t)body.len),
+                                     &blocks[batch].meta_len) != 0 ||
+                 fwrite(body.data, 1, body.len, fp) != body.len;
+        pos += blocks[batch].meta_len + (long long)body.len;
+    }
+
+    if (!failed) {
+        fb_reset(&fb);
+        size_t footer_schema = arrow_build_schema(&fb);
+        size_t batch_vec = fb_struct_vector(&fb, blocks, nbatches, sizeof blocks[0]);
+        size_t dict_vec = fb_struct_vector(&fb, NULL, 0, sizeof blocks[0]);
+        fb_start_table(&fb);
+        fb_field_offset(&fb, 1, footer_schema);
+        fb_field_offset(&fb, 2, dict_vec);
+        fb_field_offset(&fb, 3, batch_vec);
+        fb_field_i16(&fb, 0, ARROW_METADATA_V5);
+        size_t n;
+        const uint8_t *footer = fb_finish(&fb, fb_end_table(&fb), &n);
+        int32_t footer_len = (int32_t)n;
+        failed = !footer ||
+                 fwrite(eos, sizeof eos, 1, fp) != 1 ||
+                 fwrite(footer, 1, n, fp) != n ||
+                 fwrite(&footer_len, sizeof footer_len, 1, fp) != 1 ||
+                 fwrite(magic, 6, 1, fp) != 1;
+    }
+
+    free(fb.buf);
+    tb_free(&body);
+    free(blocks);
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+int export_arrow(Bus *fleet, int count, const char *filename) {
+    if (write_arrow_file(filename, fleet, count) != 0) {
+        printf(COLOR_RED "Could not write %s.\n" COLOR_RESET, filename);
+        return -1;
+    }
+    printf(COLOR_GREEN "Arrow file with %d buses exported to %s\n" COLOR_RESET,
+           count, filename);
+    return 0;
+}
+
+/* ---------- Positioned file I/O ---------- */
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* pread/pwrite equivalents; return bytes transferred or -1. */
+long long file_pread(int fd, void *buf, size_t n, long long off) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    DWORD done = 0;
+    memset(&ov, 0, sizeof ov);
+    ov.Offset = (DWORD)(off & 0xFFFFFFFF);
+    ov.OffsetHigh = (DWORD)(off >> 32);
+    if (!ReadFile((HANDLE)_get_osfhandle(fd), buf, (DWORD)n, &done, &ov)) {
+        return (GetLastError() == ERROR_HANDLE_EOF) ? 0 : -1;
+    }
+    return (long long)done;
+#else
+    ssize_t r;
+    do {
+        r = pread(fd, buf, n, (off_t)off);
+    } while (r < 0 && errno == EINTR);
+    return (long long)r;
+#endif
+}
+
+long long file_pwrite(int fd, const void *buf, size_t n, long long off) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    DWORD done = 0;
+    memset(&ov, 0, sizeof ov);
+    ov.Offset = (DWORD)(off & 0xFFFFFFFF);
+    ov.OffsetHigh = (DWORD)(off >> 32);
+    if (!WriteFile((HANDLE)_get_osfhandle(fd), buf, (DWORD)n, &done, &ov)) {
+        return -1;
+    }
+    return (long long)done;
+#else
+    ssize_t r;
+    do {
+        r = pwrite(fd, buf, n, (off_t)off);
+    } while (r < 0 && errno == EINTR);
+    return (long long)r;
+#endif
+}
+
+int compare_bus_no(const void *a, const void *b) {
+    int x = ((const Bus *)a)->bus_no;
+    int y = ((const Bus *)b)->bus_no;
+    return (x > y) - (x < y);
+}
+
+/* ---------- Indexed record file (.fgx) ---------- */
+
+/* Layout: one 4 KB header page followed by fixed-size Bus records sorted
+   by bus_no (native byte order, record_size = sizeof(Bus) when written).
+   The header page also carries up to FGX_FENCES "fence" keys sampled at
+   even record intervals, so a lookup reads the header, narrows to one
+   fence interval and interpolation-searches that interval by reading
+   only the 4-byte keys. An update rewrites just the changed field. */
+#define FGX_MAGIC       "FGIDX1"
+#define FGX_HEADER_SIZE 4096
+#define FGX_FENCES      1000
+
+typedef struct {
+    char     magic[8];
+    uint32_t record_size;
+    uint32_t fence_count;
+    uint64_t count;
+    uint64_t fence_stride;       /* records between fence keys */
+    int32_t  fences[FGX_FENCES]; /* bus_no of record i * fence_stride */
+} FgxHeader;
+
+typedef struct {
+    int       fd;
+    FgxHeader hdr;
+} FgxFile;
+
+static long long fgx_record_offset(uint64_t i) {
+    return (long long)FGX_HEADER_SIZE + (long long)i * (long long)sizeof(Bus);
+}
+
+/* Writes `count` buses (any order) as a new indexed file. */
+int fgx_write(const char *filename, Bus *fleet, int count) {
+    Bus *sorted = malloc((size_t)(count > 0 ? count : 1) * sizeof(Bus));
+    if (!sorted) return -1;
+    memcpy(sorted, fleet, (size_t)count * sizeof(Bus));
+    qsort(sorted, (size_t)count, sizeof(Bus), compare_bus_no);
+
+    char page[FGX_HEADER_SIZE];
+    FgxHeader *h = (FgxHeader *)page;
+    memset(page, 0, sizeof page);
+    memcpy(h->magic, FGX_MAGIC, sizeof FGX_MAGIC);
+    h->record_size = (uint32_t)sizeof(Bus);
+    h->count = (uint64_t)count;
+    h->fence_stride = (uint64_t)count / FGX_FENCES + 1;
+    for (uint64_t i = 0; i < (uint64_t)count && h->fence_count < FGX_FENCES;
+         i += h->fence_stride) {
+        h->fences[h->fence_count++] = sorted[i].bus_no;
+    }
+
+    char tmp_name[512];
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+    FILE *fp = fopen(tmp_name, "wb");
+    if (!fp) {
+        free(sorted);
+        return -1;
+    }
+    int failed = fwrite(page, 1, sizeof page, fp) != sizeof page ||
+                 fwrite(sorted, sizeof(Bus), (size_t)count, fp) != (size_t)count;
+    free(sorted);
+    if (flush_to_disk(fp) != 0) failed = 1;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+int fgx_open(FgxFile *f, const char *filename, int writable) {
+    f->fd = open(filename, (writable ? O_RDWR : O_RDONLY) | O_BINARY);
+    if (f->fd < 0) return 0;
+    if (file_pread(f->fd, &f->hdr, sizeof f->hdr, 0) != (long long)sizeof f->hdr ||
+        memcmp(f->hdr.magic, FGX_MAGIC, sizeof FGX_MAGIC) != 0 ||
+        f->hdr.record_size != sizeof(Bus) ||
+        f->hdr.fence_count > FGX_FENCES) {
+        close(f->fd);
+        f->fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void fgx_close(FgxFile *f) {
+    if (f->fd >= 0) close(f->fd);
+    f->fd = -1;
+}
+
+static int fgx_key_at(FgxFile *f, uint64_t i, int *key) {
+    int32_t k;
+    if (file_pread(f->fd, &k, sizeof k,
+                   fgx_record_offset(i) + (long long)offsetof(Bus, bus_no))
+        != (long long)sizeof k) {
+        return 0;
+    }
+    *key = k;
+    return 1;
+}
+
+/* Returns the record slot holding bus_no, or -1. */
+long long fgx_find(FgxFile *f, int bus_no) {
+    const FgxHeader *h = &f->hdr;
+    if (h->count == 0 || h->fence_count == 0 || bus_no < h->fences[0]) return -1;
+
+    /* Narrow to one fence interval using the header we already hold. */
+    uint32_t lo_f = 0, hi_f = h->fence_count;
+    while (hi_f - lo_f > 1) {
+        uint32_t mid = (lo_f + hi_f) / 2;
+        if (h->fences[mid] <= bus_no) lo_f = mid; else hi_f = mid;
+    }
+    uint64_t lo = (uint64_t)lo_f * h->fence_stride;
+    uint64_t hi = (hi_f < h->fence_count) ? (uint64_t)hi_f * h->fence_stride
+                                          : h->count;
+    if (hi > h->count) hi = h->count;
+    int lo_key = h->fences[lo_f];
+    int hi_key = (hi_f < h->fence_count) ? h->fences[hi_f] : 0;
+    int have_hi = (hi_f < h->fence_count);
+
+    /* Interpolation search on [lo, hi), alternating with plain bisection
+       so skewed key distributions still finish in O(log n) reads. */
+    int step = 0;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if ((step++ & 1) == 0 && have_hi && hi_key > lo_key) {
+            double frac = ((double)bus_no - lo_key) / ((double)hi_key - lo_key);
+            if (frac >= 0.0 && frac < 1.0) {
+                mid = lo + (uint64_t)(frac * (double)(hi - lo));
+            }
+        }
+        int key;
+        if (!fgx_key_at(f, mid, &key)) return -1;
+        if (key == bus_no) return (long long)mid;
+        if (key < bus_no) {
+            lo = mid + 1;
+            lo_key = key;
+        } else {
+            hi = mid;
+            hi_key = key;
+            have_hi = 1;
+        }
+    }
+    return -1;
+}
+
+int fgx_read(FgxFile *f, long long slot, Bus *out) {
+    return file_pread(f->fd, out, sizeof *out, fgx_record_offset((uint64_t)slot))
+           == (long long)sizeof *out;
+}
+
+/* Read-modify-write of one record: new odometer reading and the
+   date-independent km_left. Status is left for the next status pass. */
+int fgx_update_mileage(FgxFile *f, long long slot, float km) {
+    Bus b;
+    if (!fgx_read(f, slot, &b)) return 0;
+    b.current_mileage = km;
+    b.km_left = b.last_service_mileage + b.service_interval_km - km;
+    return file_pwrite(f->fd, &b, sizeof b, fgx_record_offset((uint64_t)slot))
+           == (long long)sizeof b;
+}
+
+/* ---------- On-disk B+tree store (.fgt) ---------- */
+
+/* Page-structured B+tree keyed by bus_no for fleets larger than RAM.
+   Page 0 holds BtMeta; every other page is a node. Leaves store whole
+   Bus records sorted by bus_no and are chained left-to-right for ordered
+   scans; internal nodes store separator keys and child page numbers.
+   Pages are accessed through a fixed-size LRU cache, so memory use is
+   cache_pages * 4 KB regardless of the file size.
+
+   Deletes remove the record from its leaf without merging underfull
+   nodes (separators stay valid bounds); the tree is not crash-atomic,
+   so keep bus_data.txt as the durable copy. */
+#define BT_MAGIC          "FGBT1"
+#define BT_PAGE_SIZE      4096
+#define BT_NODE_HDR       8
+#define BT_LEAF           1
+#define BT_INTERNAL       2
+#define BT_LEAF_MAX       ((BT_PAGE_SIZE - BT_NODE_HDR) / (int)sizeof(Bus))
+#define BT_INNER_MAX      ((BT_PAGE_SIZE - BT_NODE_HDR - 4) / 8)
+#define BT_MAX_HEIGHT     16
+#define BT_MIN_CACHE      (2 * BT_MAX_HEIGHT)
+#define BT_DEFAULT_CACHE  256
+#define BT_NO_PAGE        0xFFFFFFFFu
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  pad;
+    uint16_t nkeys;
+    uint32_t next;            /* right sibling of a leaf, 0 = none */
+} BtNode;
+
+typedef struct {
+    char     magic[8];
+    uint32_t page_size;
+    uint32_t record_size;
+    uint32_t root;
+    uint32_t page_count;
+    uint32_t height;          /* 1 = the root is a leaf */
+    uint32_t first_leaf;
+    uint64_t records;
+} BtMeta;
+
+typedef struct BtFrame {
+    uint32_t        page_no;  /* BT_NO_PAGE when unused */
+    int             dirty;
+    int             pins;
+    struct BtFrame *lru_prev; /* towards most recently used */
+    struct BtFrame *lru_next;
+    struct BtFrame *hash_next;
+    unsigned char  *data;
+} BtFrame;
+
+typedef struct {
+    int            fd;
+    BtMeta         meta;
+    BtFrame       *frames;
+    int            nframes;
+    BtFrame      **buckets;
+    int            nbuckets;
+    BtFrame       *lru_head;
+    BtFrame       *lru_tail;
+    unsigned char *pool;
+    unsigned long  hits;
+    unsigned long  misses;
+    int            io_error;
+} BTree;
+
+#define BT_HDR(f)      ((BtNode *)(f)->data)
+#define BT_RECS(f)     ((Bus *)((f)->data + BT_NODE_HDR))
+#define BT_KEYS(f)     ((int32_t *)((f)->data + BT_NODE_HDR))
+#define BT_CHILDREN(f) ((uint32_t *)((f)->data + BT_NODE_HDR + 4 * BT_INNER_MAX))
+
+static void bt_lru_unlink(BTree *bt, BtFrame *f) {
+    if (f->lru_prev) f->lru_prev->lru_next = f->lru_next;
+    else bt->lru_head = f->lru_next;
+    if (f->lru_next) f->lru_next->lru_prev = f->lru_prev;
+    else bt->lru_tail = f->lru_prev;
+    f->lru_prev = f->lru_next = NULL;
+}
+
+static void bt_lru_push_front(BTree *bt, BtFrame *f) {
+    f->lru_prev = NULL;
+    f->lru_next = bt->lru_head;
+    if (bt->lru_head) bt->lru_head->lru_prev = f;
+    bt->lru_head = f;
+    if (!bt->lru_tail) bt->lru_tail = f;
+}
+
+static BtFrame **bt_bucket(BTree *bt, uint32_t page_no) {
+    return &bt->buckets[(page_no * 2654435761u) % (uint32_t)bt->nbuckets];
+}
+
+static void bt_hash_remove(BTree *bt, BtFrame *f) {
+    BtFrame **pp = bt_bucket(bt, f->page_no);
+    while (*pp && *pp != f) pp = &(*pp)->hash_next;
+    if (*pp) *pp = f->hash_next;
+    f->hash_next = NULL;
+}
+
+static int bt_write_frame(BTree *bt, BtFrame *f) {
+    if (file_pwrite(bt->fd, f->data, BT_PAGE_SIZE,
+                    (long long)f->page_no * BT_PAGE_SIZE) != BT_PAGE_SIZE) {
+        bt->io_error = 1;
+        return 0;
+    }
+    f->dirty = 0;
+    return 1;
+}
+
+/* Pins page_no in the cache, reading it (or zero-filling a fresh page)
+   on a miss. Returns NULL if every frame is pinned or on I/O error. */
+static BtFrame *bt_fetch(BTree *bt, uint32_t page_no, int fresh) {
+    BtFrame *f = *bt_bucket(bt, page_no);
+    while (f && f->page_no != page_no) f = f->hash_next;
+    if (f) {
+        bt->hits++;
+        bt_lru_unlink(bt, f);
+        bt_lru_push_front(bt, f);
+        f->pins++;
+        return f;
+    }
+
+    bt->misses++;
+    for (f = bt->lru_tail; f && f->pins > 0; f = f->lru_prev) { }
+    if (!f) return NULL;
+    if (f->page_no != BT_NO_PAGE) {
+        if (f->dirty && !bt_write_frame(bt, f)) return NULL;
+        bt_hash_remove(bt, f);
+    }
+
+    if (fresh) {
+        memset(f->data, 0, BT_PAGE_SIZE);
+    } else if (file_pread(bt->fd, f->data, BT_PAGE_SIZE,
+                          (long long)page_no * BT_PAGE_SIZE) != BT_PAGE_SIZE) {
+        bt->io_error = 1;
+        f->page_no = BT_NO_PAGE;
+        return NULL;
+    }
+    f->page_no = page_no;
+    f->dirty = fresh;
+    f->pins = 1;
+    BtFrame **bucket = bt_bucket(bt, page_no);
+    f->hash_next = *bucket;
+    *bucket = f;
+    bt_lru_unlink(bt, f);
+    bt_lru_push_front(bt, f);
+    return f;
+}
+
+static void bt_unpin(BtFrame *f) {
+    if (f && f->pins > 0) f->pins--;
+}
+
+static BtFrame *bt_new_node(BTree *bt, int type) {
+    BtFrame *f = bt_fetch(bt, bt->meta.page_count, 1);
+    if (!f) return NULL;
+    bt->meta.page_count++;
+    BT_HDR(f)->type = (uint8_t)type;
+    return f;
+}
+
+void bt_close(BTree *bt);
+
+/* Opens (or with `create`, initialises) a tree with a cache of
+   cache_pages frames. Returns 1 on success. */
+int bt_open(BTree *bt, const char *filename, int cache_pages, int create) {
+    memset(bt, 0, sizeof *bt);
+    bt->fd = -1;
+    if (cache_pages < BT_MIN_CACHE) cache_pages = BT_MIN_CACHE;
+
+    bt->fd = open(filename, O_RDWR | O_BINARY | (create ? O_CREAT | O_TRUNC : 0),
+                  0644);
+    if (bt->fd < 0) return 0;
+
+    bt->nframes = cache_pages;
+    bt->nbuckets = cache_pages * 2 + 1;
+    bt->frames = calloc((size_t)cache_pages, sizeof(BtFrame));
+    bt->buckets = calloc((size_t)bt->nbuckets, sizeof(BtFrame *));
+    bt->pool = malloc((size_t)cache_pages * BT_PAGE_SIZE);
+    if (!bt->frames || !bt->buckets || !bt->pool) {
+        bt_close(bt);
+        return 0;
+    }
+    for (int i = 0; i < cache_pages; i++) {
+        bt->frames[i].page_no = BT_NO_PAGE;
+        bt->frames[i].data = bt->pool + (size_t)i * BT_PAGE_SIZE;
+        bt_lru_push_front(bt, &bt->frames[i]);
+    }
+
+    if (create) {
+        memcpy(bt->meta.magic, BT_MAGIC, sizeof BT_MAGIC);
+        bt->meta.page_size = BT_PAGE_SIZE;
+        bt->meta.record_size = (uint32_t)sizeof(Bus);
+        bt->meta.page_count = 1;
+        BtFrame *root = bt_new_node(bt, BT_LEAF);
+        if (!root) {
+            bt_close(bt);
+            return 0;
+        }
+        bt->meta.root = bt->meta.first_leaf = root->page_no;
+        bt->meta.height = 1;
+        bt_unpin(root);
+        return 1;
+    }
+
+    if (file_pread(bt->fd, &bt->meta, sizeof bt->meta, 0) != (long long)sizeof bt->meta ||
+        memcmp(bt->meta.magic, BT_MAGIC, sizeof BT_MAGIC) != 0 ||
+        bt->meta.page_size != BT_PAGE_SIZE ||
+        bt->meta.record_size != sizeof(Bus) ||
+        bt->meta.height == 0 || bt->meta.height > BT_MAX_HEIGHT) {
+        bt->meta.page_count = 0;   /* do not write a bogus header back */
+        bt_close(bt);
+        return 0;
+    }
+    return 1;
+}
+
+/* Writes back dirty pages and the meta page. Returns 0 on success. */
+int bt_flush(BTree *bt) {
+    unsigned char page[BT_PAGE_SIZE];
+    for (int i = 0; i < bt->nframes; i++) {
+        BtFrame *f = &bt->frames[i];
+        if (f->page_no != BT_NO_PAGE && f->dirty) bt_write_frame(bt, f);
+    }
+    memset(page, 0, sizeof page);
+    memcpy(page, &bt->meta, sizeof bt->meta);
+    if (file_pwrite(bt->fd, page, sizeof page, 0) != (long long)sizeof page) {
+        bt->io_error = 1;
+    }
+    return bt->io_error ? -1 : 0;
+}
+
+void bt_close(BTree *bt) {
+    if (bt->fd >= 0) {
+        if (bt->pool && bt->meta.page_count > 0) bt_flush(bt);
+        close(bt->fd);
+    }
+    free(bt->frames);
+    free(bt->buckets);
+    free(bt->pool);
+    bt->fd = -1;
+    bt->frames = NULL;
+    bt->buckets = NULL;
+    bt->pool = NULL;
+}
+
+/* Index of the child of an internal node that covers `key`. */
+static int bt_child_index(BtFrame *f, int key) {
+    int lo = 0, hi = BT_HDR(f)->nkeys;
+    int32_t *keys = BT_KEYS(f);
+    while (lo < hi) {                 /* number of keys <= key */
+        int mid = (lo + hi) / 2;
+        if (keys[mid] <= key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* First slot in a leaf whose key is >= key. */
+static int bt_leaf_slot(BtFrame *f, int key) {
+    int lo = 0, hi = BT_HDR(f)->nkeys;
+    Bus *recs = BT_RECS(f);
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (recs[mid].bus_no < key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+/* Walks from the root to the leaf covering key, recording the internal
+   pages visited in path[0 .. height-2]. Returns the pinned leaf. */
+static BtFrame *bt_descend(BTree *bt, int key, uint32_t *path) {
+    uint32_t pg = bt->meta.root;
+    for (uint32_t level = 0; level + 1 < bt->meta.height; level++) {
+        BtFrame *f = bt_fetch(bt, pg, 0);
+        if (!f) return NULL;
+        if (path) path[level] = pg;
+        pg = BT_CHILDREN(f)[bt_child_index(f, key)];
+        bt_unpin(f);
+    }
+    return bt_fetch(bt, pg, 0);
+}
+
+int bt_get(BTree *bt, int bus_no, Bus *out) {
+    BtFrame *leaf = bt_descend(bt, bus_no, NULL);
+    if (!leaf) return 0;
+    int i = bt_leaf_slot(leaf, bus_no);
+    int found = (i < BT_HDR(leaf)->nkeys && BT_RECS(leaf)[i].bus_no == bus_no);
+    if (found && out) *out = BT_RECS(leaf)[i];
+    bt_unpin(leaf);
+    return found;
+}
+
+/* Inserts separator `key` with right child `right` into the ancestors
+   listed in path, splitting upwards (and growing a new root) as needed. */
+static int bt_insert_parent(BTree *bt, uint32_t *path, int level,
+                            int key, uint32_t right) {
+    int32_t  keys[BT_INNER_MAX + 1];
+    uint32_t kids[BT_INNER_MAX + 2];
+
+    for (; level >= 0; level--) {
+        BtFrame *f = bt_fetch(bt, path[level], 0);
+        if (!f) return 0;
+        int n = BT_HDR(f)->nkeys;
+        int pos = bt_child_index(f, key);
+
+        if (n < BT_INNER_MAX) {
+            memmove(&BT_KEYS(f)[pos + 1], &BT_KEYS(f)[pos],
+                    (size_t)(n - pos) * sizeof(int32_t));
+            memmove(&BT_CHILDREN(f)[pos + 2], &BT_CHILDREN(f)[pos + 1],
+                    (size_t)(n - pos) * sizeof(uint32_t));
+            BT_KEYS(f)[pos] = key;
+            BT_CHILDREN(f)[pos + 1] = right;
+            BT_HDR(f)->nkeys++;
+            f->dirty = 1;
+            bt_unpin(f);
+            return 1;
+        }
+
+        memcpy(keys, BT_KEYS(f), (size_t)pos * sizeof(int32_t));
+        keys[pos] = key;
+        memcpy(&keys[pos + 1], &BT_KEYS(f)[pos], (size_t)(n - pos) * sizeof(int32_t));
+        memcpy(kids, BT_CHILDREN(f), (size_t)(pos + 1) * sizeof(uint32_t));
+        kids[pos + 1] = right;
+        memcpy(&kids[pos + 2], &BT_CHILDREN(f)[pos + 1],
+               (size_t)(n - pos) * sizeof(uint32_t));
+
+        BtFrame *nf = bt_new_node(bt, BT_INTERNAL);
+        if (!nf) {
+            bt_unpin(f);
+            return 0;
+        }
+        int total = n + 1;
+        int mid = total / 2;
+        BT_HDR(f)->nkeys = (uint16_t)mid;
+        memcpy(BT_KEYS(f), keys, (size_t)mid * sizeof(int32_t));
+        memcpy(BT_CHILDREN(f), kids, (size_t)(mid + 1) * sizeof(uint32_t));
+        BT_HDR(nf)->nkeys = (uint16_t)(total - mid - 1);
+        memcpy(BT_KEYS(nf), &keys[mid + 1],
+               (size_t)(total - mid - 1) * sizeof(int32_t));
+        memcpy(BT_CHILDREN(nf), &kids[mid + 1],
+               (size_t)(total - mid) * sizeof(uint32_t));
+        f->dirty = 1;
+
+        key = keys[mid];
+        right = nf->page_no;
+        bt_unpin(nf);
+        bt_unpin(f);
+    }
+
+    BtFrame *root = bt_new_node(bt, BT_INTERNAL);
+    if (!root) return 0;
+    BT_HDR(root)->nkeys = 1;
+    BT_KEYS(root)[0] = key;
+    BT_CHILDREN(root)[0] = bt->meta.root;
+    BT_CHILDREN(root)[1] = right;
+    bt->meta.root = root->page_no;
+    bt->meta.height++;
+    bt_unpin(root);
+    return 1;
+}
+
+/* Inserts a new bus or replaces the record with the same bus_no.
+   Returns 1 on success. */
+int bt_put(BTree *bt, const Bus *rec) {
+    uint32_t path[BT_MAX_HEIGHT];
+    Bus tmp[BT_LEAF_MAX + 1];
+
+    if (bt->meta.height >= BT_MAX_HEIGHT) return 0;
+    BtFrame *leaf = bt_descend(bt, rec->bus_no, path);
+    if (!leaf) return 0;
+
+    int n = BT_HDR(leaf)->nkeys;
+    int pos = bt_leaf_slot(leaf, rec->bus_no);
+    Bus *recs = BT_RECS(leaf);
+
+    if (pos < n && recs[pos].bus_no == rec->bus_no) {
+        recs[pos] = *rec;
+        leaf->dirty = 1;
+        bt_unpin(leaf);
+        return 1;
+    }
+    bt->meta.records++;
+
+    if (n < BT_LEAF_MAX) {
+        memmove(&recs[pos + 1], &recs[pos], (size_t)(n - pos) * sizeof(Bus));
+        recs[pos] = *rec;
+        BT_HDR(leaf)->nkeys++;
+        leaf->dirty = 1;
+        bt_unpin(leaf);
+        return 1;
+    }
+
+    memcpy(tmp, recs, (size_t)pos * sizeof(Bus));
+    tmp[pos] = *rec;
+    memcpy(&tmp[pos + 1], &recs[pos], (size_t)(n - pos) * sizeof(Bus));
+
+    BtFrame *nf = bt_new_node(bt, BT_LEAF);
+    if (!nf) {
+        bt_unpin(leaf);
+        return 0;
+    }
+    int total = n + 1;
+    int left = total / 2;
+    memcpy(recs, tmp, (size_t)left * sizeof(Bus));
+    memcpy(BT_RECS(nf), &tmp[left], (size_t)(total - left) * sizeof(Bus));
+    BT_HDR(leaf)->nkeys = (uint16_t)left;
+    BT_HDR(nf)->nkeys = (uint16_t)(total - left);
+    BT_HDR(nf)->next = BT_HDR(leaf)->next;
+    BT_HDR(leaf)->next = nf->page_no;
+    leaf->dirty = 1;
+
+    int sep = tmp[left].bus_no;
+    uint32_t right = nf->page_no;
+    bt_unpin(nf);
+    bt_unpin(leaf);
+    return bt_insert_parent(bt, path, (int)bt->meta.height - 2, sep, right);
+}
+
+/* In-place odometer update; touches only the leaf page. */
+int bt_update_mileage(BTree *bt, int bus_no, float km) {
+    BtFrame *leaf = bt_descend(bt, bus_no, NULL);
+    if (!leaf) return 0;
+    int i = bt_leaf_slot(leaf, bus_no);
+    int found = (i < BT_HDR(leaf)->nkeys && BT_RECS(leaf)[i].bus_no == bus_no);
+    if (found) {
+        Bus *b = &BT_RECS(leaf)[i];
+        b->current_mileage = km;
+        b->km_left = b->last_service_mileage + b->service_interval_km - km;
+        leaf->dirty = 1;
+    }
+    bt_unpin(leaf);
+    return found;
+}
+
+int bt_delete(BTree *bt, int bus_no) {
+    BtFrame *leaf = bt_descend(bt, bus_no, NULL);
+    if (!leaf) return 0;
+    int n = BT_HDR(leaf)->nkeys;
+    int i = bt_leaf_slot(leaf, bus_no);
+    int found = (i < n && BT_RECS(leaf)[i].bus_no == bus_no);
+    if (found) {
+        memmove(&BT_RECS(leaf)[i], &BT_RECS(leaf)[i + 1],
+                (size_t)(n - i - 1) * sizeof(Bus));
+        BT_HDR(leaf)->nkeys--;
+        leaf->dirty = 1;
+        bt->meta.records--;
+    }
+    bt_unpin(leaf);
+    return found;
+}
+
+/* Calls fn for every bus in bus_no order; stops early if fn returns 0. */
+int bt_scan(BTree *bt, int (*fn)(Bus *b, void *ctx), void *ctx) {
+    uint32_t pg = bt->meta.first_leaf;
+    while (pg != 0) {
+        BtFrame *f = bt_fetch(bt, pg, 0);
+        if (!f) return 0;
+        int n = BT_HDR(f)->nkeys;
+        for (int i = 0; i < n; i++) {
+            if (!fn(&BT_RECS(f)[i], ctx)) {
+                bt_unpin(f);
+                return 1;
+            }
+        }
+        pg = BT_HDR(f)->next;
+        bt_unpin(f);
+    }
+    return 1;
+}
+
+/* ---------- Sharded data files ---------- */
+
+/* With --shards K the fleet is stored as K text files in the usual
+   bus_data.txt format, bus i going to shard hash(bus_no) % K. Each save
+   writes a new generation of shard files in parallel and then commits
+   it by atomically replacing SHARD_MANIFEST, which lists the shard files
+   and their record counts; a crash mid-save leaves the previous
+   generation in force. Loading parses all shards in parallel straight
+   into their slice of one fleet array. */
+typedef struct {
+    char name[256];
+    int  count;
+} ShardEntry;
+
+typedef struct {
+    int        generation;
+    int        nshards;
+    ShardEntry shards[MAX_SHARDS];
+} ShardManifest;
+
+int shard_of(int bus_no, int nshards) {
+    uint32_t h = (uint32_t)bus_no;     /* murmur3 finaliser */
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return (int)(h % (uint32_t)nshards);
+}
+
+static void shard_file_name(char *out, size_t size, int generation, int shard) {
+    snprintf(out, size, "bus_data.g%d.s%03d.txt", generation, shard);
+}
+
+int read_shard_manifest(const char *filename, ShardManifest *m) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return 0;
+    int ok = fscanf(fp, "FGSHARDS 1\ngeneration %d\nshards %d\n",
+                    &m->generation, &m->nshards) == 2 &&
+             m->nshards > 0 && m->nshards <= MAX_SHARDS;
+    for (int i = 0; ok && i < m->nshards; i++) {
+        ok = fscanf(fp, "%255s %d\n", m->shards[i].name, &m->shards[i].count) == 2 &&
+             m->shards[i].count >= 0;
+    }
+    fclose(fp);
+    return ok;
+}
+
+static int write_shard_manifest(const char *filename, const ShardManifest *m) {
+    char tmp_name[512];
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+    FILE *fp = fopen(tmp_name, "w");
+    if (!fp) return -1;
+    fprintf(fp, "FGSHARDS 1\ngeneration %d\nshards %d\n",
+            m->generation, m->nshards);
+    for (int i = 0; i < m->nshards; i++) {
+        fprintf(fp, "%s %d\n", m->shards[i].name, m->shards[i].count);
+    }
+    int failed = ferror(fp) || flush_to_disk(fp) != 0;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    Bus           *fleet;
+    int           *order;     /* bus indices grouped by shard */
+    int           *start;     /* first entry of shard s in order[] */
+    ShardManifest *m;
+    int            failed;
+    fg_mutex       lock;
+} ShardJob;
+
+static void save_shard_task(void *ctx, int s) {
+    ShardJob *job = ctx;
+    ShardEntry *e = &job->m->shards[s];
+    FILE *fp = fopen(e->name, "w");
+    int failed = (fp == NULL);
+
+    if (fp) {
+        fprintf(fp, "%d\n", e->count);
+        for (int k = job->start[s]; k < job->start[s] + e->count; k++) {
+            write_bus_record(fp, &job->fleet[job->order[k]]);
+        }
+        if (ferror(fp) || flush_to_disk(fp) != 0) failed = 1;
+        if (fclose(fp) != 0) failed = 1;
+    }
+    if (failed) {
+        fg_mutex_lock(&job->lock);
+        job->failed = 1;
+        fg_mutex_unlock(&job->lock);
+    }
+}
+
+/* Saves the fleet as a new shard generation. Returns 0 on success. */
+int save_fleet_sharded(Bus *fleet, int count, int nshards,
+                       const char *manifest_file) {
+    ShardManifest old_m, new_m;
+    ShardJob job;
+    int have_old = read_shard_manifest(manifest_file, &old_m);
+
+    memset(&new_m, 0, sizeof new_m);
+    new_m.generation = have_old ? old_m.generation + 1 : 1;
+    new_m.nshards = nshards;
+
+    /* Counting sort of bus indices by shard. */
+    int *order = malloc((size_t)(count > 0 ? count : 1) * sizeof(int));
+    int *start = calloc((size_t)nshards + 1, sizeof(int));
+    int *fill = calloc((size_t)nshards, sizeof(int));
+    if (!order || !start || !fill) {
+        free(order);
+        free(start);
+        free(fill);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        new_m.shards[shard_of(fleet[i].bus_no, nshards)].count++;
+    }
+    for (int s = 0; s < nshards; s++) {
+        start[s + 1] = start[s] + new_m.shards[s].count;
+        shard_file_name(new_m.shards[s].name, sizeof new_m.shards[s].name,
+                        new_m.generation, s);
+    }
+    for (int i = 0; i < count; i++) {
+        int s = shard_of(fleet[i].bus_no, nshards);
+        order[start[s] + fill[s]++] = i;
+    }
+
+    job.fleet = fleet;
+    job.order = order;
+    job.start = start;
+    job.m = &new_m;
+    job.failed = 0;
+    fg_mutex_init(&job.lock);
+    run_parallel(nshards, save_shard_task, &job, cpu_count());
+    fg_mutex_destroy(&job.lock);
+    free(order);
+    free(start);
+    free(fill);
+
+    if (job.failed || write_shard_manifest(manifest_file, &new_m) != 0) {
+        for (int s = 0; s < nshards; s++) remove(new_m.shards[s].name);
+        return -1;
+    }
+    if (have_old) {
+        for (int s = 0; s < old_m.nshards; s++) remove(old_m.shards[s].name);
+    }
+    return 0;
+}
+
+typedef struct {
+    Bus           *fleet;
+    int           *start;
+    int           *got;       /* records parsed per shard */
+    ShardManifest *m;
+    int            bad;       /* shards that failed to parse completely */
+    fg_mutex       lock;
+} ShardLoadJob;
+
+static void load_shard_task(void *ctx, int s) {
+    ShardLoadJob *job = ctx;
+    ShardEntry *e = &job->m->shards[s];
+    LineReader lr;
+    char *line;
+    size_t len;
+    int got = 0, ok = lr_open(&lr, e->name);
+
+    if (ok) {
+        while (got < e->count && (line = lr_next(&lr, &len)) != NULL) {
+            if (lr.line_no == 1) continue;         /* count header */
+            if (!parse_bus_line(line, &job->fleet[job->start[s] + got])) {
+                ok = 0;
+                break;
+            }
+            got++;
+        }
+        lr_close(&lr);
+    }
+    job->got[s] = got;
+    if (!ok || got != e->count) {
+        fg_mutex_lock(&job->lock);
+        job->bad++;
+        fg_mutex_unlock(&job->lock);
+    }
+}
+
+/* Loads every shard listed in the manifest in parallel; the fleet is
+   returned in bus_no order. */
+LoadResult load_fleet_sharded(Bus **fleet_ptr, int *count, int *capacity,
+                              const char *manifest_file, int *bad_shards) {
+    ShardManifest m;
+    ShardLoadJob job;
+    int total = 0;
+
+    *bad_shards = 0;
+    if (!read_shard_manifest(manifest_file, &m)) {
+        *count = 0;
+        return LOAD_NO_FILE;
+    }
+    int *start = malloc(((size_t)m.nshards + 1) * sizeof(int));
+    int *got = calloc((size_t)m.nshards, sizeof(int));
+    if (!start || !got) {
+        free(start);
+        free(got);
+        *count = 0;
+        return LOAD_NO_MEMORY;
+    }
+    for (int s = 0; s < m.nshards; s++) {
+        start[s] = total;
+        total += m.shards[s].count;
+    }
+    start[m.nshards] = total;
+    if (total == 0) {
+        free(start);
+        free(got);
+        *count = 0;
+        return LOAD_EMPTY;
+    }
+    if (total > *capacity) {
+        Bus *tmp = realloc(*fleet_ptr, (size_t)total * sizeof(Bus));
+        if (!tmp) {
+            free(start);
+            free(got);
+            *count = 0;
+            return LOAD_NO_MEMORY;
+        }
+        *fleet_ptr = tmp;
+        *capacity = total;
+    }
+
+    job.fleet = *fleet_ptr;
+    job.start = start;
+    job.got = got;
+    job.m = &m;
+    job.bad = 0;
+    fg_mutex_init(&job.lock);
+    run_parallel(m.nshards, load_shard_task, &job, cpu_count());
+    fg_mutex_destroy(&job.lock);
+
+    /* Close the gaps left by shards that came up short. */
+    int loaded = 0;
+    for (int s = 0; s < m.nshards; s++) {
+        if (loaded != start[s]) {
+            memmove(&(*fleet_ptr)[loaded], &(*fleet_ptr)[start[s]],
+                    (size_t)got[s] * sizeof(Bus));
+        }
+        loaded += got[s];
+    }
+    free(start);
+    free(got);
+
+    qsort(*fleet_ptr, (size_t)loaded, sizeof(Bus), compare_bus_no);
+    *count = loaded;
+    *bad_shards = job.bad;
+    return LOAD_OK;
+}
+
+int save_fleet_to_shards(Bus *fleet, int count, int nshards) {
+    double t0 = now_seconds();
+    if (save_fleet_sharded(fleet, count, nshards, SHARD_MANIFEST) != 0) {
+        printf(COLOR_RED "Error writing shard files.\n" COLOR_RESET);
+        return -1;
+    }
+    printf(COLOR_GREEN "Fleet saved to %d shards (%s) in %.1f ms\n" COLOR_RESET,
+           nshards, SHARD_MANIFEST, (now_seconds() - t0) * 1000.0);
+    return 0;
+}
+
+/* Returns 1 if a shard manifest was found and loaded. */
+int load_fleet_from_shards(Bus **fleet_ptr, int *count, int *capacity) {
+    int bad;
+    double t0 = now_seconds();
+    LoadResult r = load_fleet_sharded(fleet_ptr, count, capacity,
+                                      SHARD_MANIFEST, &bad);
+    if (r == LOAD_NO_FILE) return 0;
+    if (r == LOAD_NO_MEMORY) {
+        printf(COLOR_RED "Memory allocation failed while loading shards.\n"
+               COLOR_RESET);
+        return 1;
+    }
+    if (bad > 0) {
+        printf(COLOR_YELLOW "Warning: %d shard file(s) missing or corrupted.\n"
+               COLOR_RESET, bad);
+    }
+    printf(COLOR_GREEN "Loaded %d buses from %s in %.1f ms\n" COLOR_RESET,
+           *count, SHARD_MANIFEST, (now_seconds() - t0) * 1000.0);
+    return 1;
+}
+
+/* ---------- CRC32C ---------- */
+
+/* CRC-32C (Castagnoli). Uses the SSE4.2 crc32 instruction when the CPU
+   has it (checked once at run time), otherwise slicing-by-8 tables. */
+static uint32_t crc32c_table[8][256];
+static int crc32c_ready = 0;
+static int crc32c_hw = 0;
+
+static void crc32c_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1u)));
+        crc32c_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t c = crc32c_table[t - 1][i];
+            crc32c_table[t][i] = (c >> 8) ^ crc32c_table[0][c & 0xFF];
+        }
+    }
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+    crc32c_ready = 1;
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t n) {
+    while (n >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;                       /* little-endian hosts */
+        crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^
+              crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+              crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^
+              crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+        p += 8;
+        n -= 8;
+    }
+    while (n--) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xFF];
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw_x64(uint32_t crc, const unsigned char *p, size_t n) {
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __builtin_ia32_crc32di(c, v);
+        p += 8;
+        n -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (n--) c32 = __builtin_ia32_crc32qi(c32, *p++);
+    return c32;
+}
+#endif
+
+uint32_t crc32c(const void *data, size_t n) {
+    if (!crc32c_ready) crc32c_init();
+    uint32_t crc = 0xFFFFFFFFu;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (crc32c_hw) return ~crc32c_hw_x64(crc, data, n);
+#endif
+    return ~crc32c_sw(crc, data, n);
+}
+
+/* ---------- Checksummed block snapshot (.fgs) ---------- */
+
+/* Binary snapshot: a 64-byte file header, then fixed-size blocks of up to
+   SNAP_BLOCK_RECORDS Bus records, each preceded by its own header with a
+   CRC32C of the payload. Block b always starts at a computable offset,
+   so blocks are verified (and loaded) independently on a worker pool and
+   a damaged block costs only its own records. */
+#define SNAP_MAGIC          "FGSNAP1"
+#define SNAP_BLOCK_MAGIC    0x4B424746u   /* "FGBK" */
+#define SNAP_BLOCK_RECORDS  4096
+
+typedef struct {
+    char     magic[8];
+    uint32_t record_size;
+    uint32_t block_records;
+    uint64_t records;
+    uint64_t blocks;
+    char     reserved[32];
+} SnapHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t block_no;
+    uint32_t records;
+    uint32_t crc;
+} SnapBlockHeader;
+
+static long long snap_block_offset(uint64_t b) {
+    return (long long)sizeof(SnapHeader) +
+           (long long)b * (long long)(sizeof(SnapBlockHeader) +
+                                      SNAP_BLOCK_RECORDS * sizeof(Bus));
+}
+
+int write_snapshot(const char *filename, Bus *fleet, int count) {
+    SnapHeader h;
+    char tmp_name[512];
+
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, SNAP_MAGIC, sizeof SNAP_MAGIC);
+    h.record_size = (uint32_t)sizeof(Bus);
+    h.block_records = SNAP_BLOCK_RECORDS;
+    h.records = (uint64_t)count;
+    h.blocks = ((uint64_t)count + SNAP_BLOCK_RECORDS - 1) / SNAP_BLOCK_RECORDS;
+
+    snprintf(tmp_name, sizeof tmp_name, "%s.tmp", filename);
+    FILE *fp = fopen(tmp_name, "wb");
+    if (!fp) return -1;
+    int failed = fwrite(&h, sizeof h, 1, fp) != 1;
+
+    for (uint64_t b = 0; !failed && b < h.blocks; b++) {
+        SnapBlockHeader bh;
+        Bus *first = &fleet[b * SNAP_BLOCK_RECORDS];
+        uint64_t left = (uint64_t)count - b * SNAP_BLOCK_RECORDS;
+        bh.magic = SNAP_BLOCK_MAGIC;
+        bh.block_no = (uint32_t)b;
+        bh.records = (uint32_t)(left < SNAP_BLOCK_RECORDS ? left : SNAP_BLOCK_RECORDS);
+        bh.crc = crc32c(first, bh.records * sizeof(Bus));
+        failed = fwrite(&bh, sizeof bh, 1, fp) != 1 ||
+                 fwrite(first, sizeof(Bus), bh.records, fp) != bh.records;
+    }
+
+    if (flush_to_disk(fp) != 0) failed = 1;
+    if (fclose(fp) != 0) failed = 1;
+    if (failed || replace_file(tmp_name, filename) != 0) {
+        remove(tmp_name);
+        return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int         fd;
+    SnapHeader  h;
+    Bus        *dest;       /* load target, or NULL to verify only */
+    uint8_t    *ok;         /* per block: 1 = checksum matched */
+    uint32_t   *got;        /* per block record count */
+} SnapJob;
+
+static void snap_block_task(void *ctx, int task) {
+    SnapJob *job = ctx;
+    uint64_t b = (uint64_t)task;
+    SnapBlockHeader bh;
+    uint64_t expect = job->h.records - b * SNAP_BLOCK_RECORDS;
+    if (expect > SNAP_BLOCK_RECORDS) expect = SNAP_BLOCK_RECORDS;
+
+    job->ok[b] = 0;
+    job->got[b] = 0;
+    if (file_pread(job->fd, &bh, sizeof bh, snap_block_offset(b)) != (long long)sizeof bh ||
+        bh.magic != SNAP_BLOCK_MAGIC || bh.block_no != (uint32_t)b ||
+        bh.records != expect) {
+        return;
+    }
+
+    size_t bytes = bh.records * sizeof(Bus);
+    Bus *buf = job->dest ? &job->dest[b * SNAP_BLOCK_RECORDS] : malloc(bytes);
+    if (!buf) return;
+    if (file_pread(job->fd, buf, bytes,
+                   snap_block_offset(b) + (long long)sizeof bh) == (long long)bytes &&
+        crc32c(buf, bytes) == bh.crc) {
+        job->ok[b] = 1;
+        job->got[b] = bh.records;
+    }
+    if (!job->dest) free(buf);
+}
+
+/* Verifies (dest == NULL) or loads every block in parallel. Returns the
+   number of bad blocks, or -1 if the file is not a usable snapshot. */
+static long long snap_process(const char *filename, SnapJob *job, Bus *dest) {
+    memset(job, 0, sizeof *job);
+    job->fd = open(filename, O_RDONLY | O_BINARY);
+    if (job->fd < 0) return -1;
+    if (file_pread(job->fd, &job->h, sizeof job->h, 0) != (long long)sizeof job->h ||
+        memcmp(job->h.magic, SNAP_MAGIC, sizeof SNAP_MAGIC) != 0 ||
+        job->h.record_size != sizeof(Bus) ||
+        job->h.block_records != SNAP_BLOCK_RECORDS ||
+        job->h.blocks != (job->h.records + SNAP_BLOCK_RECORDS - 1) / SNAP_BLOCK_RECORDS ||
+        job->h.blocks > 0x7FFFFFFF) {
+        close(job->fd);
+        return -1;
+    }
+    job->dest = dest;
+    job->ok = calloc((size_t)job->h.blocks + 1, 1);
+    job->got = calloc((size_t)job->h.blocks + 1, sizeof(uint32_t));
+    if (!job->ok || !job->got) {
+        close(job->fd);
+        return -1;
+    }
+    /* Build the tables here: the lazy init in crc32c() is not thread-safe. */
+    if (!crc32c_ready) crc32c_init();
+    run_parallel((int)job->h.blocks, snap_block_task, job, cpu_count());
+    close(job->fd);
+
+    long long bad = 0;
+    for (uint64_t b = 0; b < job->h.blocks; b++) {
+        if (!job->ok[b]) bad++;
+    }
+    return bad;
+}
+
+static void snap_job_free(SnapJob *job) {
+    free(job->ok);
+    free(job->got);
+}
+
+/* Copies every damaged block verbatim to "<filename>.quarantine" so it
+   can be inspected or repaired by hand. */
+static void quarantine_snapshot_blocks(const char *filename, SnapJob *job) {
+    char qname[512];
+    size_t block_bytes = sizeof(SnapBlockHeader) + SNAP_BLOCK_RECORDS * sizeof(Bus);
+    unsigned char *buf = malloc(block_bytes);
+    snprintf(qname, sizeof qname, "%s.quarantine", filename);
+    FILE *out = fopen(qname, "ab");
+    int fd = open(filename, O_RDONLY | O_BINARY);
+
+    if (buf && out && fd >= 0) {
+        for (uint64_t b = 0; b < job->h.blocks; b++) {
+            if (job->ok[b]) continue;
+            long long n = file_pread(fd, buf, block_bytes, snap_block_offset(b));
+            if (n > 0) fwrite(buf, 1, (size_t)n, out);
+        }
+    }
+    if (fd >= 0) close(fd);
+    if (out) fclose(out);
+    free(buf);
+}
+
+/* Loads a snapshot, dropping records of blocks that fail their CRC.
+   *bad_blocks receives the number of quarantined blocks. */
+LoadResult load_fleet_snapshot(Bus **fleet_ptr, int *count, int *capacity,
+                               const char *filename, long long *bad_blocks) {
+    SnapHeader h;
+    SnapJob job;
+
+    *bad_blocks = 0;
+    int fd = open(filename, O_RDONLY | O_BINARY);
+    if (fd < 0) return LOAD_NO_FILE;
+    long long n = file_pread(fd, &h, sizeof h, 0);
+    close(fd);
+    if (n != (long long)sizeof h || memcmp(h.magic, SNAP_MAGIC, sizeof SNAP_MAGIC) != 0 ||
+        h.records == 0 || h.records > 0x7FFFFFFF) {
+        *count = 0;
+        return LOAD_EMPTY;
+    }
+    if ((int)h.records > *capacity) {
+        Bus *tmp = realloc(*fleet_ptr, (size_t)h.records * sizeof(Bus));
+        if (!tmp) {
+            *count = 0;
+            return LOAD_NO_MEMORY;
+        }
+        *fleet_ptr = tmp;
+        *capacity = (int)h.records;
+    }
+
+    long long bad = snap_process(filename, &job, *fleet_ptr);
+    if (bad < 0) {
+        snap_job_free(&job);
+        *count = 0;
+        return LOAD_EMPTY;
+    }
+    int loaded = 0;
+    for (uint64_t b = 0; b < job.h.blocks; b++) {
+        if (!job.ok[b]) continue;
+        Bus *src = &(*fleet_ptr)[b * SNAP_BLOCK_RECORDS];
+        if (src != &(*fleet_ptr)[loaded]) {
+            memmove(&(*fleet_ptr)[loaded], src, job.got[b] * sizeof(Bus));
+        }
+        loaded += (int)job.got[b];
+    }
+    if (bad > 0) quarantine_snapshot_blocks(filename, &job);
+    snap_job_free(&job);
+
+    *count = loaded;
+    *bad_blocks = bad;
+    return LOAD_OK;
+}
+
+/* Integrity check without parsing: returns 0 if every block is intact. */
+int fsck_snapshot(const char *filename) {
+    SnapJob job;
+    struct stat st;
+    double t0 = now_seconds();
+    long long bad = snap_process(filename, &job, NULL);
+    double elapsed = now_seconds() - t0;
+
+    if (bad < 0) {
+        printf(COLOR_RED "%s is missing or not a FleetGuardian snapshot.\n"
+               COLOR_RESET, filename);
+        snap_job_free(&job);
+        return 2;
+    }
+    for (uint64_t b = 0; b < job.h.blocks; b++) {
+        if (!job.ok[b]) {
+            uint64_t first = b * SNAP_BLOCK_RECORDS;
+            printf(COLOR_RED "  block %llu (records %llu-%llu): BAD\n" COLOR_RESET,
+                   (unsigned long long)b, (unsigned long long)first + 1,
+                   (unsigned long long)(first + SNAP_BLOCK_RECORDS < job.h.records
+                                        ? first + SNAP_BLOCK_RECORDS : job.h.records));
+        }
+    }
+    double mb = (stat(filename, &st) == 0) ? st.st_size / (1024.0 * 1024.0) : 0.0;
+    printf("%s: %llu records in %llu blocks, %lld bad; %.1f MB in %.1f ms (%.0f MB/s, CRC32C %s)\n",
+           filename, (unsigned long long)job.h.records,
+           (unsigned long long)job.h.blocks, bad, mb, elapsed * 1000.0,
+           elapsed > 0 ? mb / elapsed : 0.0, crc32c_hw ? "hardware" : "software");
+    snap_job_free(&job);
+    return bad == 0 ? 0 : 1;
+}
+
+/* ---------- Format-detecting loader ---------- */
+
+/* load_fleet_quiet() opens any fleet file this program or NIMBUS.c
+   writes. The first bytes pick the format, then a format-specific
+   tokenizer fills the same Bus array:
+     FGSNAP1 / FGIDX1 / FGBT1 magic   snapshot, indexed file, B+tree store
+     "FGSHARDS"                       shard manifest
+     '{'                              JSON Lines (--export-json, --since)
+     "BusNo,"                         CSV report (export_report, --report)
+     first record contains '|'        bus_data.txt
+     first record has 8 ',' fields    NIMBUS fleet_data.csv
+   Arrow files are export-only. Formats that do not carry every Bus field
+   (the CSV report, NIMBUS) get the same defaults the migrator uses, and
+   statuses are refreshed by the caller as usual. */
+typedef enum {
+    FORMAT_UNKNOWN = 0,
+    FORMAT_TEXT,
+    FORMAT_NIMBUS_CSV,
+    FORMAT_REPORT_CSV,
+    FORMAT_JSON_LINES,
+    FORMAT_INDEXED,
+    FORMAT_BTREE,
+    FORMAT_SNAPSHOT,
+    FORMAT_SHARDS
+} FleetFormat;
+
+const char *fleet_format_name(FleetFormat f) {
+    switch (f) {
+        case FORMAT_TEXT:        return "bus_data text";
+        case FORMAT_NIMBUS_CSV:  return "NIMBUS CSV";
+        case FORMAT_REPORT_CSV:  return "CSV report";
+        case FORMAT_JSON_LINES:  return "JSON Lines";
+        case FORMAT_INDEXED:     return "indexed record file";
+        case FORMAT_BTREE:       return "B+tree store";
+        case FORMAT_SNAPSHOT:    return "block snapshot";
+        case FORMAT_SHARDS:      return "shard manifest";
+        default:                 return "unknown";
+    }
+}
+
+FleetFormat detect_fleet_format(const char *filename) {
+    char head[512];
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) return FORMAT_UNKNOWN;
+    size_t n = fread(head, 1, sizeof head - 1, fp);
+    fclose(fp);
+    head[n] = '\0';
+
+    if (n >= sizeof SNAP_MAGIC && memcmp(head, SNAP_MAGIC, sizeof SNAP_MAGIC) == 0)
+        return FORMAT_SNAPSHOT;
+    if (n >= sizeof FGX_MAGIC && memcmp(head, FGX_MAGIC, sizeof FGX_MAGIC) == 0)
+        return FORMAT_INDEXED;
+    if (n >= sizeof BT_MAGIC && memcmp(head, BT_MAGIC, sizeof BT_MAGIC) == 0)
+        return FORMAT_BTREE;
+    if (strncmp(head, "FGSHARDS", 8) == 0) return FORMAT_SHARDS;
+
+    /* Text formats: look at the first record, past a UTF-8 BOM, blank
+       lines and the optional count line. */
+    char *p = head;
+    if (strncmp(p, "\xEF\xBB\xBF", 3) == 0) p += 3;
+    while (*p == '\r' || *p == '\n' || *p == ' ' || *p == '\t') p++;
+    if (*p == '{') return FORMAT_JSON_LINES;
+    if (strncmp(p, "BusNo,", 6) == 0) return FORMAT_REPORT_CSV;
+    char *eol = strchr(p, '\n');
+    if (eol && strspn(p, "0123456789\r") == (size_t)(eol - p)) p = eol + 1;
+    eol = strchr(p, '\n');
+    if (!eol) eol = p + strlen(p);
+    if (memchr(p, '|', (size_t)(eol - p))) return FORMAT_TEXT;
+
+    int commas = 0;
+    for (char *q = p; q < eol; q++) commas += (*q == ',');
+    if (commas == NIMBUS_FIELDS - 1) return FORMAT_NIMBUS_CSV;
+    return (*p == '\0') ? FORMAT_TEXT : FORMAT_UNKNOWN;
+}
+
+int status_from_label(const char *s, Status *out) {
+    for (int st = STATUS_OK; st <= STATUS_OVERDUE; st++) {
+        if (strcmp(s, status_label((Status)st)) == 0) {
+            *out = (Status)st;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Splits one CSV line in place, unquoting "..." fields and "" escapes.
+   Returns the number of fields (only max_fields are stored). */
+static int split_csv_fields(char *line, char **fields, int max_fields) {
+    int n = 0;
+    char *p = line;
+    while (1) {
+        char *out = p;
+        if (n < max_fields) fields[n] = out;
+        n++;
+        if (*p == '"') {
+            p++;
+            while (*p) {
+                if (*p == '"' && p[1] == '"') {
+                    *out++ = '"';
+                    p += 2;
+                } else if (*p == '"') {
+                    p++;
+                    break;
+                } else {
+                    *out++ = *p++;
+                }
+            }
+            while (*p && *p != ',') p++;
+        } else {
+            while (*p && *p != ',') *out++ = *p++;
+        }
+        int more = (*p == ',');
+        *out = '\0';
+        if (!more) break;
+        p++;
+    }
+    return n;
+}
+
+/* BusNo,BusCode,DriverName,LastServiceDate,NextDueDate,CurrentKm,KmLeft,
+   HealthScore,Status,ServiceHistoryCount. The report has no interval
+   fields, so the interval is taken as NIMBUS_INTERVAL_KM and the last
+   service mileage is back-computed from KmLeft. */
+#define REPORT_FIELDS 10
+
+int parse_report_line(char *line, Bus *b) {
+    char *f[REPORT_FIELDS];
+    Bus t;
+
+    if (split_csv_fields(line, f, REPORT_FIELDS) != REPORT_FIELDS) return 0;
+    if (f[1][0] == '\0' || strlen(f[1]) >= sizeof t.bus_code) return 0;
+
+    memset(&t, 0, sizeof t);
+    strncpy(t.bus_code, f[1], sizeof t.bus_code - 1);
+    strncpy(t.driver_name, f[2], sizeof t.driver_name - 1);
+    if (!parse_int_field(f[0], &t.bus_no) ||
+        !parse_ddmmyyyy(f[3], &t.last_service) ||
+        (f[4][0] != '\0' && !parse_ddmmyyyy(f[4], &t.next_due)) ||
+        !parse_float_field(f[5], &t.current_mileage) ||
+        !parse_float_field(f[6], &t.km_left) ||
+        !parse_int_field(f[7], &t.health_score) ||
+        !status_from_label(f[8], &t.status) ||
+        !parse_int_field(f[9], &t.service_history_count)) {
+        return 0;
+    }
+    t.service_interval_km = NIMBUS_INTERVAL_KM;
+    t.last_service_mileage = t.current_mileage + t.km_left - t.service_interval_km;
+    if (t.last_service_mileage < 0.0f) t.last_service_mileage = 0.0f;
+    if (t.next_due.year > 0)
+        t.service_interval_days = date_to_days(t.next_due) - date_to_days(t.last_service);
+
+    *b = t;
+    return 1;
+}
+
+/* JSON Lines: one flat object per line with the keys format_json_row
+   writes. Unknown keys are ignored; tombstones ({"deleted":true}) are
+   skipped. */
+typedef enum { JF_INT, JF_FLOAT, JF_DATE, JF_TEXT, JF_STATUS } JsonFieldKind;
+
+typedef struct {
+    const char   *key;
+    JsonFieldKind kind;
+    size_t        offset;
+    size_t        size;     /* JF_TEXT buffer size */
+} JsonField;
+
+static const JsonField json_fields[] = {
+    {"bus_no",                JF_INT,    offsetof(Bus, bus_no), 0},
+    {"bus_code",              JF_TEXT,   offsetof(Bus, bus_code), sizeof(((Bus *)0)->bus_code)},
+    {"driver_name",           JF_TEXT,   offsetof(Bus, driver_name), sizeof(((Bus *)0)->driver_name)},
+    {"last_service",          JF_DATE,   offsetof(Bus, last_service), 0},
+    {"next_due",              JF_DATE,   offsetof(Bus, next_due), 0},
+    {"current_mileage",       JF_FLOAT,  offsetof(Bus, current_mileage), 0},
+    {"last_service_mileage",  JF_FLOAT,  offsetof(Bus, last_service_mileage), 0},
+    {"service_interval_km",   JF_FLOAT,  offsetof(Bus, service_interval_km), 0},
+    {"service_interval_days", JF_INT,    offsetof(Bus, service_interval_days), 0},
+    {"service_history_count", JF_INT,    offsetof(Bus, service_history_count), 0},
+    {"status",                JF_STATUS, offsetof(Bus, status), 0},
+    {"km_left",               JF_FLOAT,  offsetof(Bus, km_left), 0},
+    {"health_score",          JF_INT,    offsetof(Bus, health_score), 0},
+    {"avg_daily_km",          JF_FLOAT,  offsetof(Bus, avg_daily_km), 0},
+    {"fuel_efficiency",       JF_FLOAT,  offsetof(Bus, fuel_efficiency), 0},
+    {"change_seq",            JF_INT,    offsetof(Bus, change_seq), 0},
+};
+
+static const char *json_skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+/* Reads a string body (p is just past the opening quote) into out,
+   truncating to size - 1 bytes; returns the position after the closing
+   quote, or NULL if the string is malformed. */
+static const char *json_read_string(const char *p, char *out, size_t size) {
+    size_t n = 0;
+    while (*p && *p != '"') {
+        unsigned c = (unsigned char)*p++;
+        if (c == '\\') {
+            switch (*p++) {
+                case '"':  c = '"'; break;
+                case '\\': c = '\\'; break;
+                case '/':  c = '/'; break;
+                case 'b':  c = '\b'; break;
+                case 'f':  c = '\f'; break;
+                case 'n':  c = '\n'; break;
+                case 'r':  c = '\r'; break;
+                case 't':  c = '\t'; break;
+                case 'u': {
+                    char hex[5] = {0};
+                    char *end;
+                    for (int i = 0; i < 4; i++) {
+                        if (!isxdigit((unsigned char)p[i])) return NULL;
+                        hex[i] = p[i];
+                    }
+                    p += 4;
+                    c = (unsigned)strtoul(hex, &end, 16);
+                    if (c >= 0x80) {
+                        /* UTF-8 for the BMP; surrogates are not paired up. */
+                        char u[3];
+                        int k = 0;
+                        if (c < 0x800) {
+                            u[k++] = (char)(0xC0 | (c >> 6));
+                        } else {
+                            u[k++] = (char)(0xE0 | (c >> 12));
+                            u[k++] = (char)(0x80 | ((c >> 6) & 0x3F));
+                        }
+                        u[k++] = (char)(0x80 | (c & 0x3F));
+                        for (int i = 0; i < k; i++) {
+                            if (n + 1 < size) out[n++] = u[i];
+                        }
+                        continue;
+                    }
+                    break;
+                }
+                default:
+                    return NULL;
+            }
+        }
+        if (n + 1 < size) out[n++] = (char)c;
+    }
+    if (size > 0) out[n] = '\0';
+    return (*p == '"') ? p + 1 : NULL;
+}
+
+/* Skips a scalar value (string, number, true/false/null). */
+static const char *json_skip_value(const char *p) {
+    if (*p == '"') return json_read_string(p + 1, NULL, 0);
+    if (strncmp(p, "true", 4) == 0 || strncmp(p, "null", 4) == 0) return p + 4;
+    if (strncmp(p, "false", 5) == 0) return p + 5;
+    char *end;
+    strtod(p, &end);
+    return (end == p) ? NULL : end;
+}
+
+int parse_json_line(char *line, Bus *b) {
+    Bus t;
+    int have_no = 0;
+    const char *p = json_skip_ws(line);
+
+    if (*p++ != '{') return 0;
+    memset(&t, 0, sizeof t);
+    while (1) {
+        char key[32];
+        p = json_skip_ws(p);
+        if (*p == '}') break;
+        if (*p != '"' || !(p = json_read_string(p + 1, key, sizeof key))) return 0;
+        p = json_skip_ws(p);
+        if (*p++ != ':') return 0;
+        p = json_skip_ws(p);
+
+        const JsonField *jf = NULL;
+        for (size_t i = 0; i < sizeof json_fields / sizeof json_fields[0]; i++) {
+            if (strcmp(key, json_fields[i].key) == 0) {
+                jf = &json_fields[i];
+                break;
+            }
+        }
+        char *dst = (char *)&t + (jf ? jf->offset : 0);
+        char *end;
+        if (!jf) {
+            if (strcmp(key, "deleted") == 0 && strncmp(p, "true", 4) == 0) return -1;
+            p = json_skip_value(p);
+        } else if (jf->kind == JF_TEXT) {
+            p = (*p == '"') ? json_read_string(p + 1, dst, jf->size) : NULL;
+        } else if (jf->kind == JF_STATUS || jf->kind == JF_DATE) {
+            char text[32];
+            if (strncmp(p, "null", 4) == 0 && jf->kind == JF_DATE) {
+                p += 4;
+            } else if (*p != '"' || !(p = json_read_string(p + 1, text, sizeof text))) {
+                return 0;
+            } else if (jf->kind == JF_STATUS) {
+                if (!status_from_label(text, &t.status)) return 0;
+            } else {
+                Date d;
+                if (sscanf(text, "%4d-%2d-%2d", &d.year, &d.month, &d.day) != 3 ||
+                    !is_valid_date(d)) {
+                    return 0;
+                }
+                memcpy(dst, &d, sizeof d);
+            }
+        } else if (jf->kind == JF_INT) {
+            long v = strtol(p, &end, 10);
+            if (end == p) return 0;
+            int iv = (int)v;
+            memcpy(dst, &iv, sizeof iv);
+            if (jf->offset == offsetof(Bus, bus_no)) have_no = 1;
+            p = end;
+        } else {
+            float v = 0.0f;
+            if (strncmp(p, "null", 4) == 0) {
+                end = (char *)p + 4;
+            } else {
+                v = strtof(p, &end);
+                if (end == p) return 0;
+            }
+            memcpy(dst, &v, sizeof v);
+            p = end;
+        }
+        if (!p) return 0;
+
+        p = json_skip_ws(p);
+        if (*p == ',') {
+            p++;
+        } else if (*p != '}') {
+            return 0;
+        }
+    }
+    if (!have_no || t.bus_code[0] == '\0') return 0;
+    *b = t;
+    return 1;
+}
+
+static LoadResult load_fleet_indexed(Bus **fleet_ptr, int *count, int *capacity,
+                                     const char *filename) {
+    FgxFile f;
+    if (!fgx_open(&f, filename, 0)) return LOAD_EMPTY;
+    if (f.hdr.count == 0 || f.hdr.count > 0x7FFFFFFF) {
+        fgx_close(&f);
+        return LOAD_EMPTY;
+    }
+    int n = (int)f.hdr.count;
+    if (n > *capacity) {
+        Bus *tmp = realloc(*fleet_ptr, (size_t)n * sizeof(Bus));
+        if (!tmp) {
+            fgx_close(&f);
+            return LOAD_NO_MEMORY;
+        }
+        *fleet_ptr = tmp;
+        *capacity = n;
+    }
+    long long bytes = (long long)n * (long long)sizeof(Bus);
+    int ok = file_pread(f.fd, *fleet_ptr, (size_t)bytes, fgx_record_offset(0)) == bytes;
+    fgx_close(&f);
+    if (!ok) return LOAD_EMPTY;
+    *count = n;
+    return LOAD_OK;
+}
+
+typedef struct {
+    Bus **fleet_ptr;
+    int  *count;
+    int  *capacity;
+    int   failed;
+} BtLoad;
+
+static int bt_load_row(Bus *b, void *ctx) {
+    BtLoad *ld = ctx;
+    if (*ld->count >= *ld->capacity) {
+        int new_cap = (*ld->capacity == 0) ? 64 : *ld->capacity * 2;
+        Bus *tmp = realloc(*ld->fleet_ptr, (size_t)new_cap * sizeof(Bus));
+        if (!tmp) {
+            ld->failed = 1;
+            return 0;
+        }
+        *ld->fleet_ptr = tmp;
+        *ld->capacity = new_cap;
+    }
+    (*ld->fleet_ptr)[(*ld->count)++] = *b;
+    return 1;
+}
+
+static LoadResult load_fleet_btree(Bus **fleet_ptr, int *count, int *capacity,
+                                   const char *filename) {
+    BTree bt;
+    if (!bt_open(&bt, filename, BT_DEFAULT_CACHE, 0)) return LOAD_EMPTY;
+    BtLoad ld = {fleet_ptr, count, capacity, 0};
+    if (bt.meta.records > (uint64_t)*capacity && bt.meta.records < 0x7FFFFFFF) {
+        Bus *tmp = realloc(*fleet_ptr, (size_t)bt.meta.records * sizeof(Bus));
+        if (tmp) {
+            *fleet_ptr = tmp;
+            *capacity = (int)bt.meta.records;
+        }
+    }
+    int ok = bt_scan(&bt, bt_load_row, &ld);
+    bt_close(&bt);
+    if (ld.failed) return LOAD_NO_MEMORY;
+    if (!ok || *count == 0) return LOAD_EMPTY;
+    return LOAD_OK;
+}
+
+LoadResult load_fleet_quiet(Bus **fleet_ptr, int *count, int *capacity,
+                            const char *filename, int *corrupted) {
+    long long bad_blocks;
+    int bad_shards;
+    LoadResult r;
+
+    *corrupted = 0;
+    *count = 0;
+    switch (detect_fleet_format(filename)) {
+        case FORMAT_NIMBUS_CSV:
+            return load_fleet_lines(fleet_ptr, count, capacity, filename,
+                                    corrupted, parse_nimbus_line);
+        case FORMAT_REPORT_CSV:
+            return load_fleet_lines(fleet_ptr, count, capacity, filename,
+                                    corrupted, parse_report_line);
+        case FORMAT_JSON_LINES:
+            return load_fleet_lines(fleet_ptr, count, capacity, filename,
+                                    corrupted, parse_json_line);
+        case FORMAT_INDEXED:
+            return load_fleet_indexed(fleet_ptr, count, capacity, filename);
+        case FORMAT_BTREE:
+            return load_fleet_btree(fleet_ptr, count, capacity, filename);
+        case FORMAT_SNAPSHOT:
+            r = load_fleet_snapshot(fleet_ptr, count, capacity, filename, &bad_blocks);
+            *corrupted = (int)bad_blocks;
+            return r;
+        case FORMAT_SHARDS:
+            r = load_fleet_sharded(fleet_ptr, count, capacity, filename, &bad_shards);
+            *corrupted = bad_shards;
+            return r;
+        case FORMAT_TEXT:
+        case FORMAT_UNKNOWN:
+        default:
+            /* Unknown files go through the text parser so their lines end
+               up in the quarantine file rather than vanishing. */
+            return load_fleet_lines(fleet_ptr, count, capacity, filename,
+                                    corrupted, parse_bus_line);
+    }
+}
+
+/* ---------- Delta export (--since) ---------- */
+
+/* Writes the buses changed after sequence `since` as JSON Lines, oldest
+   change first, plus a tombstone for each bus deleted since then. The
+   changed set comes from the change log; the data file is only used to
+   fetch the current rows. */
+static int compare_change_bus(const void *a, const void *b) {
+    const ChangeEntry *x = a;
+    const ChangeEntry *y = b;
+    if (x->bus_no != y->bus_no) return (x->bus_no > y->bus_no) - (x->bus_no < y->bus_no);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static int compare_change_seq(const void *a, const void *b) {
+    int x = ((const ChangeEntry *)a)->seq;
+    int y = ((const ChangeEntry *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+/* Entries newer than `since`, found by binary search over the log.
+   Returns how many were read into *out (free it), or -1 on error. */
+static int read_changes_since(const char *log_file, int since, ChangeEntry **out) {
+    ChangeEntry e;
+    *out = NULL;
+    FILE *fp = fopen(log_file, "rb");
+    if (!fp) return 0;
+    if (fseek(fp, 0, SEEK_END) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    long n = ftell(fp) / (long)sizeof e;
+    long lo = 0, hi = n;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        if (fseek(fp, mid * (long)sizeof e, SEEK_SET) != 0 ||
+            fread(&e, sizeof e, 1, fp) != 1) {
+            fclose(fp);
+            return -1;
+        }
+        if (e.seq <= since) lo = mid + 1;
+        else hi = mid;
+    }
+
+    long k = n - lo;
+    *out = malloc((size_t)(k > 0 ? k : 1) * sizeof e);
+    if (!*out || fseek(fp, lo * (long)sizeof e, SEEK_SET) != 0 ||
+        fread(*out, sizeof e, (size_t)k, fp) != (size_t)k) {
+        free(*out);
+        *out = NULL;
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return (int)k;
+}
+
+int export_changes_since(int since, const char *data_file, const char *log_file,
+                         const char *out_file) {
+    ChangeEntry *ch;
+    int n = read_changes_since(log_file, since, &ch);
+    if (n < 0) {
+        printf(COLOR_RED "Could not read change log %s.\n" COLOR_RESET, log_file);
+        return 1;
+    }
+
+    /* Newest entry per bus, then back into change order. */
+    qsort(ch, (size_t)n, sizeof *ch, compare_change_bus);
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (i + 1 < n && ch[i + 1].bus_no == ch[i].bus_no) continue;
+        ch[m++] = ch[i];
+    }
+    qsort(ch, (size_t)m, sizeof *ch, compare_change_seq);
+
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+    LoadResult lr = load_fleet_quiet(&fleet, &count, &capacity, data_file, &corrupted);
+    if (lr == LOAD_NO_MEMORY || (lr == LOAD_NO_FILE && m > 0)) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, data_file);
+        free(ch);
+        free(fleet);
+        return 1;
+    }
+    qsort(fleet, (size_t)count, sizeof(Bus), compare_bus_no);
+
+    FILE *fp = fopen(out_file, "w");
+    if (!fp) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, out_file);
+        free(ch);
+        free(fleet);
+        return 1;
+    }
+
+    TextBuf tb = {0};
+    int rows = 0, deleted = 0, failed = 0;
+    for (int i = 0; i < m && !failed; i++) {
+        Bus key;
+        key.bus_no = ch[i].bus_no;
+        Bus *b = bsearch(&key, fleet, (size_t)count, sizeof(Bus), compare_bus_no);
+        if (b) {
+            format_json_row(&tb, b);
+            rows++;
+        } else if (tb_reserve(&tb, 96)) {
+            char *p = put_text(tb.data + tb.len, "{\"bus_no\":");
+            p = put_int(p, ch[i].bus_no);
+            p = put_text(p, ",\"deleted\":true,\"change_seq\":");
+            p = put_int(p, ch[i].seq);
+            p = put_text(p, "}\n");
+            tb.len = (size_t)(p - tb.data);
+            deleted++;
+        }
+        if (tb.len >= REPORT_FLUSH_BYTES) {
+            failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+            tb.len = 0;
+        }
+    }
+    if (!failed && tb.len > 0) failed = fwrite(tb.data, 1, tb.len, fp) != tb.len;
+    if (fclose(fp) != 0) failed = 1;
+    tb_free(&tb);
+    free(ch);
+    free(fleet);
+
+    if (failed) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, out_file);
+        return 1;
+    }
+    printf(COLOR_GREEN "%d changed and %d deleted bus(es) since seq %d written to %s\n"
+           COLOR_RESET, rows, deleted, since, out_file);
+    printf("Latest change seq: %d (pass it to --since next time)\n",
+           change_log_last_seq(log_file));
+    return 0;
+}
+
+/* ---------- Background autosave ---------- */
+
+/* The UI thread holds `lock` while it changes the fleet; the autosave
+   thread only takes it long enough to memcpy the records into its own
+   snapshot, then writes the snapshot to AUTOSAVE_FILE with the lock
+   released. A change is therefore on disk at most `interval` seconds
+   after it was made, and the menu never waits for file I/O. */
+typedef struct {
+    Bus       **fleet_ptr;
+    int        *count;
+    const char *filename;
+    int         interval;       /* seconds; 0 = disabled */
+
+    fg_mutex    lock;
+    fg_cond     wake;
+    fg_thread   thread;
+    int         running;
+    int         stop;
+    int         dirty;
+
+    Bus        *snapshot;
+    int         snap_cap;
+    time_t      last_saved;     /* 0 until the first autosave */
+    int         last_failed;
+} AutoSaver;
+
+static void *autosave_thread(void *arg) {
+    AutoSaver *as = arg;
+
+    fg_mutex_lock(&as->lock);
+    while (!as->stop) {
+        fg_cond_timedwait(&as->wake, &as->lock, as->interval * 1000);
+        if (as->stop || !as->dirty) continue;
+
+        int n = *as->count;
+        if (n > as->snap_cap) {
+            Bus *tmp = realloc(as->snapshot, (size_t)n * sizeof(Bus));
+            if (!tmp) {
+                as->last_failed = 1;
+                continue;
+            }
+            as->snapshot = tmp;
+            as->snap_cap = n;
+        }
+        if (n > 0) memcpy(as->snapshot, *as->fleet_ptr, (size_t)n * sizeof(Bus));
+        as->dirty = 0;
+        fg_mutex_unlock(&as->lock);
+
+        int rc = save_fleet_atomic(as->snapshot, n, as->filename);
+
+        fg_mutex_lock(&as->lock);
+        as->last_failed = (rc != 0);
+        if (rc != 0) {
+            as->dirty = 1;              /* retry on the next tick */
+        } else {
+            as->last_saved = time(NULL);
+        }
+    }
+    fg_mutex_unlock(&as->lock);
+    return NULL;
+}
+
+void autosave_start(AutoSaver *as, Bus **fleet_ptr, int *count,
+                    const char *filename, int interval) {
+    memset(as, 0, sizeof *as);
+    as->fleet_ptr = fleet_ptr;
+    as->count = count;
+    as->filename = filename;
+    as->interval = interval;
+    fg_mutex_init(&as->lock);
+    fg_cond_init(&as->wake);
+    if (interval > 0) {
+        as->running = fg_thread_start(&as->thread, autosave_thread, as);
+        if (!as->running) {
+            printf(COLOR_YELLOW "Warning: autosave could not be started.\n"
+                   COLOR_RESET);
+        }
+    }
+}
+
+void autosave_lock(AutoSaver *as)   { fg_mutex_lock(&as->lock); }
+void autosave_unlock(AutoSaver *as) { fg_mutex_unlock(&as->lock); }
+
+/* Call with the lock held after changing the fleet. */
+void autosave_mark_dirty(AutoSaver *as) {
+    as->dirty = 1;
+}
+
+/* Stops the thread; the recovery file is removed when `discard` is set
+   (the caller has just saved the real data file). */
+void autosave_stop(AutoSaver *as, int discard) {
+    if (as->running) {
+        fg_mutex_lock(&as->lock);
+        as->stop = 1;
+        fg_cond_broadcast(&as->wake);
+        fg_mutex_unlock(&as->lock);
+        fg_thread_join(as->thread);
+        as->running = 0;
+    }
+    if (discard) remove(as->filename);
+    fg_cond_destroy(&as->wake);
+    fg_mutex_destroy(&as->lock);
+    free(as->snapshot);
+    as->snapshot = NULL;
+}
+
+void print_autosave_status(AutoSaver *as) {
+    if (!as->running) return;
+    fg_mutex_lock(&as->lock);
+    if (as->last_failed) {
+        printf(COLOR_RED "Autosave: last attempt FAILED (%s)\n" COLOR_RESET,
+               as->filename);
+    } else if (as->last_saved != 0) {
+        char buf[16] = "";
+        struct tm *lt = localtime(&as->last_saved);
+        if (lt) strftime(buf, sizeof buf, "%H:%M:%S", lt);
+        printf("Autosave: every %d s, last at %s\n", as->interval, buf);
+    } else {
+        printf("Autosave: every %d s\n", as->interval);
+    }
+    fg_mutex_unlock(&as->lock);
+}
+
+/* Offers to continue from a recovery file left by a session that ended
+   without "Save & exit". Returns 1 if the fleet was replaced. */
+int offer_autosave_recovery(Bus **fleet_ptr, int *count, int *capacity,
+                            const char *filename) {
+    struct stat st;
+    char buf[16];
+
+    if (stat(filename, &st) != 0) return 0;
+    printf(COLOR_YELLOW
+           "Found unsaved work from a previous session (%s).\n"
+           COLOR_RESET, filename);
+    /* Only an explicit "n" discards it; EOF leaves it for next time. */
+    for (;;) {
+        printf("Recover it? (y/n): ");
+        if (!read_line_stdin(buf, sizeof buf)) return 0;
+        char c = (char)tolower((unsigned char)buf[0]);
+        if (c == 'y') break;
+        if (c == 'n') {
+            remove(filename);
+            return 0;
+        }
+        printf(COLOR_RED "Please answer y or n.\n" COLOR_RESET);
+    }
+    load_fleet_from_file(fleet_ptr, count, capacity, filename);
+    return 1;
+}
+
+/* ---------- Shared fleet segment ---------- */
+
+/* With --shared the fleet lives in the POSIX shared-memory object
+   SHARED_NAME, so every terminal started that way works on one copy of
+   it. The first one creates the segment from the data file, with room
+   for twice the fleet (at least SHARED_MIN_CAPACITY buses); later ones
+   map it as it is and also share its reference date.
+
+   Commands that change the fleet hold the segment's process-shared mutex
+   while they apply the change (their prompts come first, see the fleet
+   lock) and keep `seq` odd meanwhile. Commands that only read take no lock: they
+   wait for an even seq, read the buses in place, and compare seq again
+   afterwards (a seqlock), so readers never block writers or each other.
+   Writers also refresh every bus's status before they release the lock,
+   which keeps the derived fields readers see in step with the shared
+   date, and keep change sequence numbers unique across processes. They
+   also append their change entries to CHANGE_LOG before unlocking, so
+   the log stays in seq order however the terminals interleave; a
+   terminal's Save & exit would be too late for that.
+
+   Each terminal holds a pid slot in the segment. Slots of terminals that
+   died without closing it (killed at a prompt, say) are freed whenever
+   the slots are looked at; the last terminal out removes the segment,
+   and one that finds only dead pids starts it afresh from the data file. */
+#define SHARED_NAME          "/fleetguardian"
+#define SHARED_MAGIC         0x32534746u         /* "FGS2" */
+#define SHARED_MIN_CAPACITY  1024
+#define SHARED_MAX_TERMINALS 64
+
+#ifndef _WIN32
+struct SharedFleet {
+    uint32_t        magic;         /* set last, once the segment is usable */
+    uint32_t        bus_size;      /* sizeof(Bus) of the creating binary */
+    int             capacity;
+    int             count;
+    int             attached;      /* live entries in pids */
+    int             pids[SHARED_MAX_TERMINALS];  /* 0 = free slot */
+    int             writer_pid;    /* current or most recent writer */
+    int             last_seq;      /* newest change sequence number */
+    Date            today;         /* year 0 until someone enters one */
+    uint64_t        seq;           /* odd while a writer is changing buses */
+    pthread_mutex_t lock;
+    Bus             buses[];
+};
+typedef struct SharedFleet SharedFleet;
+
+static SharedFleet *shared_fleet;
+static size_t       shared_size;
+
+static void shared_sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    nanosleep(&ts, NULL);
+}
+
+/* A writer that died mid-command leaves the mutex owner-dead; the next
+   locker marks it consistent and closes the odd seq it left behind. */
+static void shared_lock(void) {
+    SharedFleet *s = shared_fleet;
+    if (pthread_mutex_lock(&s->lock) == EOWNERDEAD) {
+        printf(COLOR_YELLOW "Terminal %d exited during a change; its last "
+               "command may be incomplete.\n" COLOR_RESET, s->writer_pid);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) & 1)
+            __atomic_add_fetch(&s->seq, 1, __ATOMIC_RELEASE);
+        pthread_mutex_consistent(&s->lock);     /* its slot goes in shared_prune */
+    }
+}
+
+static int shared_map(int fd, size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 0;
+    shared_fleet = p;
+    shared_size = size;
+    return 1;
+}
+
+/* Frees the slots of terminals that are gone and returns how many are
+   still attached. Call with the mutex held. */
+static int shared_prune(void) {
+    SharedFleet *s = shared_fleet;
+    int live = 0;
+    for (int k = 0; k < SHARED_MAX_TERMINALS; k++) {
+        if (s->pids[k] == 0) continue;
+        if (kill(s->pids[k], 0) != 0 && errno == ESRCH) s->pids[k] = 0;
+        else live++;
+    }
+    s->attached = live;
+    return live;
+}
+
+/* Removes the segment's name and marks it unusable, so a terminal that
+   mapped it meanwhile does not join it. Call with the mutex held. */
+static void shared_retire(void) {
+    __atomic_store_n(&shared_fleet->magic, 0, __ATOMIC_RELEASE);
+    shm_unlink(SHARED_NAME);
+}
+
+/* Takes a pid slot. A segment (other than a `fresh` one) with no live
+   terminal left is stale: it is retired and this returns 0, so the
+   caller loads the data file instead. Returns -1 if the segment was
+   retired meanwhile or has no free slot. */
+static int shared_attach(Bus **fleet_ptr, int *count, int *capacity, int fresh) {
+    SharedFleet *s = shared_fleet;
+    shared_lock();
+    if (__atomic_load_n(&s->magic, __ATOMIC_RELAXED) != SHARED_MAGIC) {
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    int live = shared_prune();
+    if (live == 0 && !fresh) {
+        shared_retire();
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+    int k = 0;
+    while (k < SHARED_MAX_TERMINALS && s->pids[k] != 0) k++;
+    if (k == SHARED_MAX_TERMINALS) {
+        pthread_mutex_unlock(&s->lock);
+        printf(COLOR_RED "Shared fleet %s already has %d terminals.\n" COLOR_RESET,
+               SHARED_NAME, SHARED_MAX_TERMINALS);
+        return -1;
+    }
+    s->pids[k] = (int)getpid();
+    s->attached = live + 1;
+    *count = s->count;
+    pthread_mutex_unlock(&s->lock);
+    *fleet_ptr = s->buses;
+    *capacity = s->capacity;
+    fleet_capacity_fixed = 1;
+    return 1;
+}
+
+/* Maps an existing segment in place of the fleet. Returns 0 if there is
+   none (or it cannot be used), leaving the fleet untouched. */
+int shared_open(Bus **fleet_ptr, int *count, int *capacity) {
+    struct stat st;
+    int fd = shm_open(SHARED_NAME, O_RDWR, 0);
+    if (fd < 0) return 0;
+
+    /* The creator may still be filling it in. */
+    for (int tries = 0; fstat(fd, &st) == 0 && st.st_size == 0; tries++) {
+        if (tries == 500) break;
+        shared_sleep_ms(10);
+    }
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SharedFleet) ||
+        !shared_map(fd, (size_t)st.st_size)) {
+        printf(COLOR_RED "Shared fleet %s is not usable.\n" COLOR_RESET, SHARED_NAME);
+        return 0;
+    }
+    for (int tries = 0; __atomic_load_n(&shared_fleet->magic, __ATOMIC_ACQUIRE) !=
+                        SHARED_MAGIC && tries < 500; tries++) {
+        shared_sleep_ms(10);
+    }
+    if (shared_fleet->magic != SHARED_MAGIC || shared_fleet->bus_size != sizeof(Bus) ||
+        shared_size < sizeof(SharedFleet) +
+                      (size_t)shared_fleet->capacity * sizeof(Bus)) {
+        printf(COLOR_RED "Shared fleet %s was made by a different build.\n"
+               COLOR_RESET, SHARED_NAME);
+        munmap(shared_fleet, shared_size);
+        shared_fleet = NULL;
+        return 0;
+    }
+    int attached = shared_attach(fleet_ptr, count, capacity, 0);
+    if (attached <= 0) {
+        munmap(shared_fleet, shared_size);
+        shared_fleet = NULL;
+        if (attached == 0) {
+            printf(COLOR_YELLOW "Shared fleet %s was left behind by terminals that "
+                   "are gone; starting it afresh.\n" COLOR_RESET, SHARED_NAME);
+        }
+        return 0;
+    }
+    printf(COLOR_GREEN "Joined shared fleet %s: %d buses, %d terminals.\n"
+           COLOR_RESET, SHARED_NAME, *count, shared_fleet->attached);
+    return 1;
+}
+
+/* Moves the loaded fleet into a new segment. Returns 0 (fleet untouched)
+   if that fails; joins instead if another terminal won the race. */
+int shared_create(Bus **fleet_ptr, int *count, int *capacity) {
+    int cap = (*count > SHARED_MIN_CAPACITY / 2) ? *count * 2 : SHARED_MIN_CAPACITY;
+    size_t size = sizeof(SharedFleet) + (size_t)cap * sizeof(Bus);
+    int fd = shm_open(SHARED_NAME, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            Bus *own = *fleet_ptr;
+            if (!shared_open(fleet_ptr, count, capacity)) return 0;
+            free(own);
+            return 1;
+        }
+        printf(COLOR_RED "Could not create shared fleet %s: %s\n" COLOR_RESET,
+               SHARED_NAME, strerror(errno));
+        return 0;
+    }
+    if (ftruncate(fd, (off_t)size) != 0 || !shared_map(fd, size)) {
+        printf(COLOR_RED "Could not size shared fleet %s.\n" COLOR_RESET, SHARED_NAME);
+        shm_unlink(SHARED_NAME);
+        return 0;
+    }
+
+    SharedFleet *s = shared_fleet;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&s->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    s->bus_size = sizeof(Bus);
+    s->capacity = cap;
+    s->count = *count;
+    s->last_seq = changes.last_seq;
+    if (*count > 0) memcpy(s->buses, *fleet_ptr, (size_t)*count * sizeof(Bus));
+    __atomic_store_n(&s->magic, SHARED_MAGIC, __ATOMIC_RELEASE);
+
+    free(*fleet_ptr);
+    shared_attach(fleet_ptr, count, capacity, 1);
+    printf(COLOR_GREEN "Created shared fleet %s (room for %d buses).\n" COLOR_RESET,
+           SHARED_NAME, cap);
+    return 1;
+}
+
+/* The shared reference date, if some terminal has entered one. */
+int shared_date(Date *today) {
+    if (shared_fleet->today.year == 0) return 0;
+    *today = shared_fleet->today;
+    return 1;
+}
+
+void shared_write_begin(int *count) {
+    SharedFleet *s = shared_fleet;
+    shared_lock();
+    shared_prune();                     /* keeps the terminal count honest */
+    s->writer_pid = (int)getpid();
+    __atomic_add_fetch(&s->seq, 1, __ATOMIC_ACQ_REL);
+    *count = s->count;
+    if (s->last_seq > changes.last_seq) changes.last_seq = s->last_seq;
+}
+
+void shared_write_end(Bus *fleet, int count, Date today) {
+    SharedFleet *s = shared_fleet;
+    for (int i = 0; i < count; i++) refresh_bus_status(&fleet[i], today);
+    change_log_flush(CHANGE_LOG);       /* a failure leaves them queued */
+    s->count = count;
+    s->today = today;
+    s->last_seq = changes.last_seq;
+    __atomic_add_fetch(&s->seq, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Waits out any writer and returns the seq to validate against. */
+uint64_t shared_read_begin(int *count) {
+    SharedFleet *s = shared_fleet;
+    int waited = 0;
+    uint64_t seq;
+    while ((seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE)) & 1) {
+        int pid = s->writer_pid;
+        if (kill(pid, 0) != 0 && errno == ESRCH) {
+            shared_lock();              /* recovers the dead writer's lock */
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+        if (!waited++) {
+            printf(COLOR_YELLOW "Waiting for terminal %d to finish a change...\n"
+                   COLOR_RESET, pid);
+            fflush(stdout);
+        }
+        shared_sleep_ms(5);
+    }
+    *count = s->count;
+    return seq;
+}
+
+/* Nonzero if a writer ran since shared_read_begin returned `seen`. */
+int shared_read_changed(uint64_t seen) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&shared_fleet->seq, __ATOMIC_RELAXED) != seen;
+}
+
+void print_shared_status(void) {
+    printf("Shared fleet %s: %d of %d slots used, %d terminals\n", SHARED_NAME,
+           shared_fleet->count, shared_fleet->capacity, shared_fleet->attached);
+}
+
+/* Unmaps the segment; the last terminal out removes it. */
+void shared_close(Bus **fleet_ptr) {
+    SharedFleet *s = shared_fleet;
+    int self = (int)getpid();
+    shared_lock();
+    for (int k = 0; k < SHARED_MAX_TERMINALS; k++) {
+        if (s->pids[k] == self) s->pids[k] = 0;
+    }
+    if (shared_prune() == 0) shared_retire();
+    pthread_mutex_unlock(&s->lock);
+    munmap(shared_fleet, shared_size);
+    shared_fleet = NULL;
+    *fleet_ptr = NULL;
+    fleet_capacity_fixed = 0;
+}
+#else
+typedef struct SharedFleet SharedFleet;
+static SharedFleet *shared_fleet;
+
+int shared_open(Bus **fleet_ptr, int *count, int *capacity) {
+    (void)fleet_ptr; (void)count; (void)capacity;
+    return 0;
+}
+int shared_create(Bus **fleet_ptr, int *count, int *capacity) {
+    (void)fleet_ptr; (void)count; (void)capacity;
+    printf(COLOR_YELLOW "--shared needs POSIX shared memory; running unshared.\n"
+           COLOR_RESET);
+    return 0;
+}
+int shared_date(Date *today) { (void)today; return 0; }
+void shared_write_begin(int *count) { (void)count; }
+void shared_write_end(Bus *fleet, int count, Date today) {
+    (void)fleet; (void)count; (void)today;
+}
+uint64_t shared_read_begin(int *count) {
+    (void)count;
+    return 0;
+}
+int shared_read_changed(uint64_t seen) { (void)seen; return 0; }
+void print_shared_status(void) {}
+void shared_close(Bus **fleet_ptr) { (void)fleet_ptr; }
+#endif
+
+/* Menu choices that only read the fleet; main() checks afterwards
+   whether another terminal changed it while they ran. The others lock
+   (or, like the dashboard, validate) for themselves. */
+int shared_command_reads(int choice) {
+    switch (choice) {
+        case 6: case 7: case 8: case 9: case 12: case 13:
+        case 18: case 19: case 20: case 21: case 22:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/* The menu's FleetLock hooks: the autosave lock, which the autosave and
+   standby threads take to copy the fleet, plus the writer side of the
+   shared segment when there is one. */
+typedef struct {
+    AutoSaver *autosave;
+    Date      *today;
+} MenuLock;
+
+void menu_write_begin(void *ctx, int *count) {
+    MenuLock *m = ctx;
+    autosave_lock(m->autosave);
+    if (shared_fleet) {
+        shared_write_begin(count);
+        shared_date(m->today);
+    }
+}
+
+void menu_write_end(void *ctx, Bus *fleet, int count) {
+    MenuLock *m = ctx;
+    if (shared_fleet) shared_write_end(fleet, count, *m->today);
+    autosave_mark_dirty(m->autosave);
+    autosave_unlock(m->autosave);
+}
+
+uint64_t menu_read_begin(void *ctx, int *count) {
+    MenuLock *m = ctx;
+    uint64_t seen = shared_read_begin(count);
+    shared_date(m->today);
+    return seen;
+}
+
+int menu_read_changed(void *ctx, uint64_t seen) {
+    (void)ctx;
+    return shared_read_changed(seen);
+}
+
+/* ---------- Warm standby (journal shipping) ---------- */
+
+/* A menu session started with --primary listens on STANDBY_SOCKET and
+   ships its mutation journal to any --standby process on the same box.
+   The journal is the change tracker itself: every STANDBY_TICK_MS the
+   shipper thread tries the autosave lock and, if it gets it, collects
+   the buses stamped since the last batch and the deletions queued
+   since then, and sends them as one batch. While a save holds the lock
+   it sends a bare heartbeat instead, so a slow fsync is not mistaken
+   for a dead primary. A standby that connects
+   first receives the whole fleet. Heartbeats carry the primary's
+   newest seq, so the standby can show how far behind it is; its acks
+   let the primary show the same.
+
+   The standby applies each batch with fleet_apply_batch and queues the
+   primary's change entries as its own. When the primary goes away, by
+   crash or by Save & exit, the standby drops into the normal menu with
+   the fleet already in memory and becomes the primary itself. Every
+   header carries the primary's pid, and the standby only takes over
+   once kill(pid, 0) says that process is gone: a primary that is stuck
+   but alive is waited for, never run alongside. */
+#define STANDBY_SOCKET    "fleetguardian.sock"
+#define STANDBY_MAGIC     0x324A4746u           /* "FGJ2" */
+#define STANDBY_TICK_MS   200
+#define STANDBY_TIMEOUT_MS 5000                 /* five missed heartbeats */
+#define STANDBY_MAX       8
+
+typedef enum {
+    JOURNAL_SNAPSHOT = 1,       /* nupserts = the whole fleet */
+    JOURNAL_BATCH,
+    JOURNAL_HEARTBEAT,
+    JOURNAL_BYE                 /* ndeleted = 1 if the primary saved */
+} JournalKind;
+
+/* Followed by ndeleted ChangeEntry and nupserts Bus records. */
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;
+    int32_t  last_seq;          /* primary's newest change seq */
+    int32_t  ndeleted;
+    int32_t  nupserts;
+    Date     today;
+    double   sent;              /* now_seconds() on the primary */
+    int32_t  pid;               /* the primary's process, checked before takeover */
+} JournalHeader;
+
+/* Applies one journal batch: removes the deleted bus numbers in a single
+   compaction pass, then replaces each upserted bus or appends it. The
+   change tracker is left as it was; callers record entries themselves.
+   May reorder upserts. Returns 0 if memory runs out. */
+int fleet_apply_batch(Bus **fleet_ptr, int *count, int *capacity,
+                      const ChangeEntry *deleted, int ndeleted,
+                      Bus *upserts, int nupserts) {
+    int last_seq = changes.last_seq, npending = changes.npending;
+    if (ndeleted > 0) {
+        uint64_t *marked = calloc(BITMAP_WORDS(*count) + 1, sizeof *marked);
+        int *gone = malloc((size_t)ndeleted * sizeof *gone);
+        if (!marked || !gone) {
+            free(marked);
+            free(gone);
+            return 0;
+        }
+        for (int k = 0; k < ndeleted; k++) gone[k] = deleted[k].bus_no;
+        qsort(gone, (size_t)ndeleted, sizeof *gone, compare_int);
+        for (int i = 0; i < *count; i++) {
+            if (bsearch(&(*fleet_ptr)[i].bus_no, gone, (size_t)ndeleted, sizeof *gone,
+                        compare_int))
+                bitmap_set(marked, i);
+        }
+        fleet_remove_marked(*fleet_ptr, count, marked, NULL);
+        free(marked);
+        free(gone);
+    }
+    changes.last_seq = last_seq;
+    changes.npending = npending;
+
+    if (*count + nupserts > *capacity) {
+        if (fleet_capacity_fixed) return 0;
+        Bus *tmp = realloc(*fleet_ptr, (size_t)(*count + nupserts) * sizeof(Bus));
+        if (!tmp) return 0;
+        *fleet_ptr = tmp;
+        *capacity = *count + nupserts;
+    }
+    Bus *fleet = *fleet_ptr;
+
+    /* Few upserts: look each one up; many: one pass over the fleet. */
+    if (nupserts <= 16) {
+        for (int k = 0; k < nupserts; k++) {
+            int i = find_bus_index(fleet, *count, upserts[k].bus_no);
+            fleet[i >= 0 ? i : (*count)++] = upserts[k];
+        }
+        return 1;
+    }
+    unsigned char *placed = calloc((size_t)nupserts, 1);
+    if (!placed) return 0;
+    qsort(upserts, (size_t)nupserts, sizeof *upserts, compare_bus_no);
+    for (int i = 0, n = *count; i < n; i++) {
+        Bus *u = bsearch(&fleet[i], upserts, (size_t)nupserts, sizeof *upserts,
+                         compare_bus_no);
+        if (!u) continue;
+        fleet[i] = *u;
+        placed[u - upserts] = 1;
+    }
+    for (int k = 0; k < nupserts; k++) {
+        if (!placed[k]) fleet[(*count)++] = upserts[k];
+    }
+    free(placed);
+    return 1;
+}
+
+#ifndef _WIN32
+typedef struct {
+    int fd;
+    int fresh;                  /* needs the full fleet first */
+    int acked;                  /* newest seq it has applied */
+} Standby;
+
+typedef struct {
+    fg_mutex   *fleet_lock;     /* the lock the menu holds while it edits */
+    Bus       **fleet_ptr;
+    int        *count;
+    Date       *today;
+
+    fg_thread   thread;
+    int         running;
+    volatile int stop;
+    int         saved;          /* set before stopping: told to standbys */
+    int         listen_fd;
+
+    Standby     standbys[STANDBY_MAX];
+    int         nstandbys;
+    int         shipped;        /* seq the last batch went up to */
+    int         seen_seq;       /* last_seq and today as of the last collect, */
+    Date        seen_today;     /* for heartbeats sent while the menu saves */
+    double      last_sent;
+    TextBuf     queue;          /* batches collected but not yet sent */
+} Shipper;
+
+static int send_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int journal_append(TextBuf *tb, JournalKind kind, int last_seq, Date today,
+                          const ChangeEntry *deleted, int ndeleted,
+                          const Bus *upserts, int nupserts) {
+    JournalHeader h = {STANDBY_MAGIC, (uint32_t)kind, last_seq, ndeleted, nupserts,
+                       today, now_seconds(), (int32_t)getpid()};
+    size_t need = sizeof h + (size_t)ndeleted * sizeof *deleted +
+                  (size_t)nupserts * sizeof *upserts;
+    if (!tb_reserve(tb, need)) return 0;
+    memcpy(tb->data + tb->len, &h, sizeof h);
+    tb->len += sizeof h;
+    if (ndeleted > 0) {
+        memcpy(tb->data + tb->len, deleted, (size_t)ndeleted * sizeof *deleted);
+        tb->len += (size_t)ndeleted * sizeof *deleted;
+    }
+    if (nupserts > 0) {
+        memcpy(tb->data + tb->len, upserts, (size_t)nupserts * sizeof *upserts);
+        tb->len += (size_t)nupserts * sizeof *upserts;
+    }
+    return 1;
+}
+
+/* Queues a batch with everything changed since the last one. Call with
+   the fleet lock held; the menu calls it before Save & exit flushes the
+   queued change entries away. */
+void standby_collect(Shipper *sh) {
+    if (!sh->running || changes.last_seq <= sh->shipped) return;
+    Bus *fleet = *sh->fleet_ptr;
+    int n = *sh->count, nup = 0, ndel = 0;
+
+    for (int i = 0; i < n; i++) nup += fleet[i].change_seq > sh->shipped;
+    for (int k = 0; k < changes.npending; k++) {
+        ndel += changes.pending[k].seq > sh->shipped &&
+                changes.pending[k].op == CHANGE_DELETE;
+    }
+    JournalHeader h = {STANDBY_MAGIC, JOURNAL_BATCH, changes.last_seq, ndel, nup,
+                       *sh->today, now_seconds(), (int32_t)getpid()};
+    size_t need = sizeof h + (size_t)ndel * sizeof(ChangeEntry) + (size_t)nup * sizeof(Bus);
+    if (!tb_reserve(&sh->queue, need)) return;
+
+    char *p = sh->queue.data + sh->queue.len;
+    memcpy(p, &h, sizeof h);
+    p += sizeof h;
+    for (int k = 0; k < changes.npending; k++) {
+        const ChangeEntry *e = &changes.pending[k];
+        if (e->seq > sh->shipped && e->op == CHANGE_DELETE) {
+            memcpy(p, e, sizeof *e);
+            p += sizeof *e;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (fleet[i].change_seq > sh->shipped) {
+            memcpy(p, &fleet[i], sizeof(Bus));
+            p += sizeof(Bus);
+        }
+    }
+    sh->queue.len += need;
+    sh->shipped = changes.last_seq;
+}
+
+static void standby_drop(Shipper *sh, int k) {
+    close(sh->standbys[k].fd);
+    sh->standbys[k] = sh->standbys[--sh->nstandbys];
+}
+
+/* One round: acks and new standbys, then a batch and any snapshots. The
+   fleet lock is only tried (unless `wait`): while the menu holds it, for
+   instance through Save & exit's fsyncs, the round sends just a
+   heartbeat, so the standby does not take the primary for dead. */
+static void shipper_tick(Shipper *sh, int wait) {
+    struct pollfd pfd[STANDBY_MAX + 1];
+    pfd[0].fd = sh->listen_fd;
+    pfd[0].events = POLLIN;
+    for (int k = 0; k < sh->nstandbys; k++) {
+        pfd[k + 1].fd = sh->standbys[k].fd;
+        pfd[k + 1].events = POLLIN;
+    }
+    int nfds = sh->nstandbys + 1;
+    if (poll(pfd, (nfds_t)nfds, STANDBY_TICK_MS) > 0) {
+        /* Acks first (from the end, since drops move the last one down). */
+        for (int k = nfds - 2; k >= 0; k--) {
+            int32_t ack[64];
+            if (!(pfd[k + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            ssize_t n = recv(sh->standbys[k].fd, ack, sizeof ack, MSG_DONTWAIT);
+            if (n < (ssize_t)sizeof ack[0]) {
+                standby_drop(sh, k);
+            } else {
+                sh->standbys[k].acked = ack[n / (ssize_t)sizeof ack[0] - 1];
+            }
+        }
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(sh->listen_fd, NULL, NULL);
+            if (fd >= 0 && sh->nstandbys < STANDBY_MAX) {
+                Standby s = {fd, 1, 0};
+                sh->standbys[sh->nstandbys++] = s;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    TextBuf snap = {0};
+    int fresh = 0, last_seq;
+    Date today;
+    for (int k = 0; k < sh->nstandbys; k++) fresh += sh->standbys[k].fresh;
+    if (wait) fg_mutex_lock(sh->fleet_lock);
+    if (wait || fg_mutex_trylock(sh->fleet_lock)) {
+        standby_collect(sh);
+        sh->seen_seq = changes.last_seq;
+        sh->seen_today = *sh->today;
+        if (fresh && !journal_append(&snap, JOURNAL_SNAPSHOT, sh->seen_seq,
+                                     sh->seen_today, NULL, 0,
+                                     *sh->fleet_ptr, *sh->count)) {
+            fresh = 0;                  /* out of memory: try next tick */
+        }
+        fg_mutex_unlock(sh->fleet_lock);
+    } else {
+        fresh = 0;                      /* snapshots wait for the lock */
+    }
+    last_seq = sh->seen_seq;
+    today = sh->seen_today;
+
+    int heartbeat = sh->queue.len == 0 && now_seconds() - sh->last_sent >= 1.0;
+    if (heartbeat) journal_append(&sh->queue, JOURNAL_HEARTBEAT, last_seq, today,
+                                  NULL, 0, NULL, 0);
+    for (int k = sh->nstandbys - 1; k >= 0; k--) {
+        Standby *s = &sh->standbys[k];
+        int rc;
+        if (s->fresh) {
+            /* The snapshot already holds everything queued so far. */
+            if (!fresh) continue;
+            rc = send_all(s->fd, snap.data, snap.len);
+            s->fresh = 0;
+        } else {
+            rc = sh->queue.len ? send_all(s->fd, sh->queue.data, sh->queue.len) : 0;
+        }
+        if (rc != 0) standby_drop(sh, k);
+    }
+    if (sh->queue.len) sh->last_sent = now_seconds();
+    sh->queue.len = 0;
+    tb_free(&snap);
+}
+
+static void *shipper_thread(void *arg) {
+    Shipper *sh = arg;
+    while (!sh->stop) shipper_tick(sh, 0);
+    shipper_tick(sh, 1);                /* last batch, collected before the flush */
+    JournalHeader bye = {STANDBY_MAGIC, JOURNAL_BYE, changes.last_seq, sh->saved, 0,
+                         *sh->today, now_seconds(), (int32_t)getpid()};
+    for (int k = 0; k < sh->nstandbys; k++) {
+        send_all(sh->standbys[k].fd, &bye, sizeof bye);
+        close(sh->standbys[k].fd);
+    }
+    return NULL;
+}
+
+/* Starts listening; the lock is the one the menu holds while it edits. */
+int standby_start(Shipper *sh, fg_mutex *fleet_lock, Bus **fleet_ptr, int *count,
+                  Date *today) {
+    struct sockaddr_un addr;
+    memset(sh, 0, sizeof *sh);
+    sh->fleet_lock = fleet_lock;
+    sh->fleet_ptr = fleet_ptr;
+    sh->count = count;
+    sh->today = today;
+    sh->shipped = changes.last_seq;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", STANDBY_SOCKET);
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    int live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof addr) == 0;
+    if (probe >= 0) close(probe);
+    if (live) {
+        printf(COLOR_RED "Another primary is listening on %s; not shipping.\n"
+               COLOR_RESET, STANDBY_SOCKET);
+        return 0;
+    }
+    sh->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(STANDBY_SOCKET);             /* left by a primary that died */
+    if (sh->listen_fd < 0 || bind(sh->listen_fd, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+        listen(sh->listen_fd, STANDBY_MAX) != 0) {
+        printf(COLOR_RED "Could not listen on %s: %s\n" COLOR_RESET, STANDBY_SOCKET,
+               strerror(errno));
+        if (sh->listen_fd >= 0) close(sh->listen_fd);
+        return 0;
+    }
+    sh->running = fg_thread_start(&sh->thread, shipper_thread, sh);
+    if (!sh->running) {
+        close(sh->listen_fd);
+        unlink(STANDBY_SOCKET);
+        return 0;
+    }
+    printf(COLOR_GREEN "Primary: standbys can follow on %s.\n" COLOR_RESET, STANDBY_SOCKET);
+    return 1;
+}
+
+/* Sends what is left and signs off; `saved` tells standbys the data file
+   (and change log) already hold every change. */
+void standby_stop(Shipper *sh, int saved) {
+    if (!sh->running) return;
+    sh->saved = saved;
+    sh->stop = 1;
+    fg_thread_join(sh->thread);
+    sh->running = 0;
+    close(sh->listen_fd);
+    unlink(STANDBY_SOCKET);
+    tb_free(&sh->queue);
+}
+
+/* The shipper thread only writes acked/nstandbys as ints; a slightly
+   stale read here is harmless. */
+void print_standby_status(Shipper *sh) {
+    if (!sh->running) return;
+    if (sh->nstandbys == 0) {
+        printf("Standby: none connected (%s)\n", STANDBY_SOCKET);
+        return;
+    }
+    int behind = 0;
+    for (int k = 0; k < sh->nstandbys; k++) {
+        int lag = changes.last_seq - sh->standbys[k].acked;
+        if (lag > behind) behind = lag;
+    }
+    printf("Standby: %d connected, at most %d change(s) behind\n", sh->nstandbys, behind);
+}
+
+static void record_replicated(const ChangeEntry *deleted, int ndeleted,
+                              const Bus *upserts, int nupserts) {
+    int k = 0, j = 0;
+    while (k < ndeleted || j < nupserts) {
+        if (j == nupserts || (k < ndeleted && deleted[k].seq < upserts[j].change_seq)) {
+            changes.last_seq = deleted[k].seq;
+            change_record(CHANGE_DELETE, deleted[k++].bus_no);
+        } else {
+            changes.last_seq = upserts[j].change_seq;
+            change_record(CHANGE_UPSERT, upserts[j++].bus_no);
+        }
+    }
+}
+
+static int compare_bus_change_seq(const void *a, const void *b) {
+    int x = ((const Bus *)a)->change_seq, y = ((const Bus *)b)->change_seq;
+    return (x > y) - (x < y);
+}
+
+/* Follows the primary until it goes away. Returns 1 with the replicated
+   fleet (and its reference date) once it has, 0 if no primary answered. */
+int standby_follow(Bus **fleet_ptr, int *count, int *capacity, Date *today) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", STANDBY_SOCKET);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        printf(COLOR_RED "No primary on %s: %s\n" COLOR_RESET, STANDBY_SOCKET,
+               strerror(errno));
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    printf(COLOR_CYAN "Standby: following the primary on %s.\n" COLOR_RESET,
+           STANDBY_SOCKET);
+    /* A frame that stops halfway counts as a lost primary. */
+    struct timeval tv = {STANDBY_TIMEOUT_MS / 1000, (STANDBY_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+
+    changes.last_seq = change_log_last_seq(CHANGE_LOG);
+    changes.npending = 0;
+
+    ChangeEntry *deleted = NULL;
+    Bus *upserts = NULL;
+    int synced = 0, primary_seq = 0, primary_pid = 0, clean = 0, saved = 0;
+    double lag_ms = 0.0, heard = now_seconds(), shown = 0.0;
+    for (;;) {
+        JournalHeader h;
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, STANDBY_TIMEOUT_MS) == 0) {
+            /* Silent for STANDBY_TIMEOUT_MS: only a primary that is gone is
+               replaced; one that is merely stuck is waited for. */
+            if (primary_pid > 0 && !(kill(primary_pid, 0) != 0 && errno == ESRCH)) {
+                printf(COLOR_YELLOW "\nStandby: primary %d is silent but still "
+                       "running; waiting.\n" COLOR_RESET, primary_pid);
+                continue;
+            }
+            break;
+        }
+        if (recv_all(fd, &h, sizeof h) != 0) break;
+        if (h.magic != STANDBY_MAGIC || h.ndeleted < 0 || h.nupserts < 0) {
+            printf(COLOR_RED "\nStandby: bad journal frame; stopping.\n" COLOR_RESET);
+            break;
+        }
+        if (h.kind == JOURNAL_BYE) {
+            clean = 1;
+            saved = h.ndeleted;
+            break;
+        }
+        int ndel = h.ndeleted;
+        ChangeEntry *d = realloc(deleted, (size_t)(ndel + 1) * sizeof *d);
+        Bus *u = realloc(upserts, (size_t)(h.nupserts + 1) * sizeof *u);
+        if (d) deleted = d;
+        if (u) upserts = u;
+        if (!d || !u ||
+            recv_all(fd, deleted, (size_t)ndel * sizeof *deleted) != 0 ||
+            recv_all(fd, upserts, (size_t)h.nupserts * sizeof *upserts) != 0) {
+            break;
+        }
+
+        if (h.kind == JOURNAL_SNAPSHOT) {
+            free(*fleet_ptr);
+            *fleet_ptr = upserts;
+            *count = *capacity = h.nupserts;
+            upserts = NULL;
+            if (h.last_seq > changes.last_seq) changes.last_seq = h.last_seq;
+            synced = 1;
+        } else if (h.kind == JOURNAL_BATCH && synced) {
+            if (!fleet_apply_batch(fleet_ptr, count, capacity, deleted, ndel,
+                                   upserts, h.nupserts)) {
+                printf(COLOR_RED "\nStandby: out of memory; stopping.\n" COLOR_RESET);
+                break;
+            }
+            qsort(upserts, (size_t)h.nupserts, sizeof *upserts, compare_bus_change_seq);
+            record_replicated(deleted, ndel, upserts, h.nupserts);
+            if (h.last_seq > changes.last_seq) changes.last_seq = h.last_seq;
+        }
+        *today = h.today;
+        primary_seq = h.last_seq;
+        primary_pid = h.pid;
+        heard = now_seconds();
+        if (h.kind != JOURNAL_HEARTBEAT) lag_ms = (heard - h.sent) * 1000.0;
+
+        int32_t ack = changes.last_seq;
+        if (send_all(fd, &ack, sizeof ack) != 0) break;
+        if (heard - shown >= 1.0 || h.kind != JOURNAL_HEARTBEAT) {
+            printf("\rStandby: %d buses, seq %d of %d, lag %.1f ms   ", *count,
+                   changes.last_seq, primary_seq, lag_ms);
+            fflush(stdout);
+            shown = heard;
+        }
+    }
+    close(fd);
+    free(deleted);
+    free(upserts);
+    if (!synced) {
+        printf(COLOR_RED "\nStandby: the primary went away before sending the fleet.\n"
+               COLOR_RESET);
+        return 0;
+    }
+    /* Its socket closes a moment before the process is gone; one that
+       stays alive only dropped us, and two primaries would log the same
+       changes twice. */
+    double wait_until = now_seconds() + STANDBY_TIMEOUT_MS / 1000.0;
+    while (!clean && primary_pid > 0 && !(kill(primary_pid, 0) != 0 && errno == ESRCH)) {
+        if (now_seconds() >= wait_until) {
+            printf(COLOR_RED "\nStandby: lost the connection, but primary %d is still "
+                   "running; not taking over.\n" COLOR_RESET, primary_pid);
+            return 0;
+        }
+        shared_sleep_ms(STANDBY_TICK_MS);
+    }
+    /* A primary that saved on its way out has logged these itself. */
+    if (saved) changes.npending = 0;
+    printf(COLOR_YELLOW "\nPrimary %s; taking over with %d buses at seq %d "
+           "(last heard %.1f s ago).\n" COLOR_RESET,
+           clean ? "signed off" : "lost", *count, changes.last_seq, now_seconds() - heard);
+    return 1;
+}
+#else
+typedef struct {
+    int running;
+} Shipper;
+
+void standby_collect(Shipper *sh) { (void)sh; }
+int standby_start(Shipper *sh, fg_mutex *fleet_lock, Bus **fleet_ptr, int *count,
+                  Date *today) {
+    (void)fleet_lock; (void)fleet_ptr; (void)count; (void)today;
+    sh->running = 0;
+    printf(COLOR_YELLOW "--primary needs Unix domain sockets; running alone.\n"
+           COLOR_RESET);
+    return 0;
+}
+void standby_stop(Shipper *sh, int saved) { (void)sh; (void)saved; }
+void print_standby_status(Shipper *sh) { (void)sh; }
+int standby_follow(Bus **fleet_ptr, int *count, int *capacity, Date *today) {
+    (void)fleet_ptr; (void)count; (void)capacity; (void)today;
+    printf(COLOR_RED "--standby needs Unix domain sockets.\n" COLOR_RESET);
+    return 0;
+}
+#endif
+
+/* ---------- Command-line modes ---------- */
+
+void print_usage(const char *prog) {
+    printf("Usage: %s [--autosave N] [--shards K] [--shared] [--primary | --standby]\n"
+           "                 interactive menu (autosave every N s, 0 = off,\n"
+           "                 default %d; keep data in K parallel shard files;\n"
+           "                 share one fleet with other --shared terminals;\n"
+           "                 ship changes to / follow them from %s)\n",
+           prog, AUTOSAVE_SECS, STANDBY_SOCKET);
+    printf("       %s --dashboard [dd/mm/yyyy]  live wall-screen dashboard\n", prog);
+    printf("       %s --report [dd/mm/yyyy] [in] [out]\n"
+           "                 stream a CSV report without loading the fleet\n", prog);
+    printf("       %s --build-index [in] [out]     write indexed file (%s)\n",
+           prog, INDEX_FILE);
+    printf("       %s --lookup BUS_NO [file]       show one bus from indexed file\n", prog);
+    printf("       %s --set-mileage BUS_NO KM [file]\n"
+           "                 update one bus in place in the indexed file\n", prog);
+    printf("       %s --btree [tree]               interactive menu run directly\n"
+           "                 on the B+tree store (%s)\n", prog, BTREE_FILE);
+    printf("       %s --btree-import [in] [tree]   build B+tree store (%s)\n",
+           prog, BTREE_FILE);
+    printf("       %s --btree-get BUS_NO [tree]\n", prog);
+    printf("       %s --btree-add [tree]\n", prog);
+    printf("       %s --btree-mileage BUS_NO KM [tree]\n", prog);
+    printf("       %s --btree-delete BUS_NO [tree]\n", prog);
+    printf("       %s --btree-scan [tree]          all buses in bus number order\n", prog);
+    printf("       %s --btree-bench N [cache_pages]\n", prog);
+    printf("       %s --snapshot [in] [out]         write checksummed snapshot (%s)\n",
+           prog, SNAPSHOT_FILE);
+    printf("       %s --restore-snapshot [snap] [out]\n"
+           "                 rebuild a text data file, skipping damaged blocks\n", prog);
+    printf("       %s --fsck [snap]                 verify snapshot block checksums\n", prog);
+    printf("       %s --export-arrow [dd/mm/yyyy] [in] [out]\n"
+           "                 write an Arrow/Feather file (%s)\n", prog, ARROW_FILE);
+    printf("       %s --export-json [dd/mm/yyyy] [in] [out]\n"
+           "                 write one JSON object per bus (%s)\n", prog, JSON_FILE);
+    printf("       %s --migrate-nimbus [in] [out]\n"
+           "                 convert a NIMBUS %s into a new %s\n",
+           prog, NIMBUS_FILE, DATA_FILE);
+    printf("       %s --convert IN OUT               any fleet file (format detected)\n"
+           "                 to the %s text format\n", prog, DATA_FILE);
+    printf("       %s --since SEQ [in] [out]\n"
+           "                 buses changed after SEQ (per %s) as JSON Lines,\n"
+           "                 with tombstones for deleted ones (%s)\n",
+           prog, CHANGE_LOG, DELTA_FILE);
+    printf("       %s --audit BUS|all [FIELD|all] [from] [to]\n"
+           "                 edits from %s, newest first (dates dd/mm/yyyy)\n",
+           prog, AUDIT_LOG);
+    printf("       %s --bulk-edit \"set F=V[, ...] where F OP V [and ...]\" [file]\n"
+           "                 update every matching bus in one pass\n", prog);
+    printf("       %s --bulk-delete \"BUS_NO,... | @FILE | where ...\" [file]\n"
+           "                 delete every listed or matching bus in one pass\n", prog);
+    printf("       %s --due-calendar [dd/mm/yyyy] [in] [out]\n"
+           "                 buses due per day for the next %d days (%s)\n",
+           prog, DUE_CALENDAR_DAYS, DUE_CALENDAR_FILE);
+    printf("       %s --aging [dd/mm/yyyy] [in]     overdue aging by depot\n", prog);
+    printf("       %s --availability FROM TO [in] [out]\n"
+           "                 workshop downtime (%s) and availability per bus,\n"
+           "                 depot and month (%s)\n",
+           prog, DOWNTIME_FILE, AVAILABILITY_FILE);
+    printf("       %s --cost-projection [dd/mm/yyyy] [in] [out]\n"
+           "                 spend per depot and month from %s (%s)\n",
+           prog, COST_MODEL_FILE, COST_FILE);
+}
+
+/* Optional trailing dd/mm/yyyy argument, defaulting to the system date. */
+static int date_arg_or_today(int argc, char **argv, int idx, Date *out) {
+    if (idx < argc) {
+        if (!parse_date_arg(argv[idx], out)) {
+            printf(COLOR_RED "Invalid date '%s'. Use dd/mm/yyyy.\n" COLOR_RESET,
+                   argv[idx]);
+            return 0;
+        }
+        return 1;
+    }
+    *out = today_from_clock();
+    return 1;
+}
+
+static int cmd_build_index(const char *in_file, const char *out_file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
+    }
+    int rc = fgx_write(out_file, fleet, count);
+    free(fleet);
+    if (rc != 0) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, out_file);
+        return 1;
+    }
+    printf(COLOR_GREEN "Indexed %d buses into %s\n" COLOR_RESET, count, out_file);
+    return 0;
+}
+
+/* Point lookup (km < 0) or in-place mileage update against a .fgx file. */
+static int cmd_indexed_bus(const char *file, const char *bus_arg, float km) {
+    FgxFile f;
+    Bus b;
+    int bus_no;
+
+    if (!parse_int_field(bus_arg, &bus_no)) {
+        printf(COLOR_RED "Invalid bus number '%s'.\n" COLOR_RESET, bus_arg);
+        return 1;
+    }
+    double t0 = now_seconds();
+    if (!fgx_open(&f, file, km >= 0.0f)) {
+        printf(COLOR_RED "%s is missing or not an indexed fleet file.\n"
+               COLOR_RESET, file);
+        return 1;
+    }
+    long long slot = fgx_find(&f, bus_no);
+    int ok = (slot >= 0);
+    if (ok && km >= 0.0f) ok = fgx_update_mileage(&f, slot, km);
+    if (ok) ok = fgx_read(&f, slot, &b);
+    double elapsed = now_seconds() - t0;
+    fgx_close(&f);
+
+    if (!ok) {
+        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+        return 1;
+    }
+    if (km >= 0.0f) printf(COLOR_GREEN "Mileage updated.\n" COLOR_RESET);
+    display_one_bus(&b);
+    printf("(%.3f ms)\n", elapsed * 1000.0);
+    return 0;
+}
+
+/* B+tree counterparts of the interactive operations: get ~ search /
+   find_bus_index, add ~ add_bus, mileage ~ update_mileage, delete ~
+   delete_bus, scan ~ display_all_buses. */
+static int cmd_btree_import(const char *in_file, const char *tree_file) {
+    LineReader lr;
+    BTree bt;
+    Bus b;
+    char *line;
+    size_t len;
+    long bad = 0;
+
+    if (!lr_open(&lr, in_file)) {
+        printf(COLOR_RED "Could not open %s.\n" COLOR_RESET, in_file);
+        return 1;
+    }
+    if (!bt_open(&bt, tree_file, BT_DEFAULT_CACHE, 1)) {
+        printf(COLOR_RED "Could not create %s.\n" COLOR_RESET, tree_file);
+        lr_close(&lr);
+        return 1;
+    }
+    while ((line = lr_next(&lr, &len)) != NULL) {
+        if (len == 0 || (lr.line_no == 1 && !memchr(line, '|', len))) continue;
+        if (!parse_bus_line(line, &b)) {
+            bad++;
+            continue;
+        }
+        if (!bt_put(&bt, &b)) break;
+    }
+    lr_close(&lr);
+    unsigned long long records = bt.meta.records;
+    int failed = bt.io_error;
+    bt_close(&bt);
+
+    if (failed) {
+        printf(COLOR_RED "I/O error while writing %s.\n" COLOR_RESET, tree_file);
+        return 1;
+    }
+    printf(COLOR_GREEN "Imported %llu buses into %s\n" COLOR_RESET, records, tree_file);
+    if (bad > 0) {
+        printf(COLOR_YELLOW "Warning: skipped %ld corrupted line(s).\n"
+               COLOR_RESET, bad);
+    }
+    return 0;
+}
+
+static int btree_open_or_report(BTree *bt, const char *tree_file, int cache) {
+    if (!bt_open(bt, tree_file, cache, 0)) {
+        printf(COLOR_RED "%s is missing or not a B+tree fleet store.\n"
+               COLOR_RESET, tree_file);
+        return 0;
+    }
+    return 1;
+}
+
+static int cmd_btree_bus(const char *tree_file, const char *bus_arg,
+                         const char *op, float km) {
+    BTree bt;
+    Bus b;
+    int bus_no, ok;
+
+    if (!parse_int_field(bus_arg, &bus_no)) {
+        printf(COLOR_RED "Invalid bus number '%s'.\n" COLOR_RESET, bus_arg);
+        return 1;
+    }
+    if (!btree_open_or_report(&bt, tree_file, BT_MIN_CACHE)) return 1;
+
+    if (strcmp(op, "delete") == 0) {
+        ok = bt_delete(&bt, bus_no);
+        if (ok) printf(COLOR_YELLOW "Bus deleted. Remaining: %llu\n" COLOR_RESET,
+                       (unsigned long long)bt.meta.records);
+    } else {
+        ok = (strcmp(op, "mileage") != 0 || bt_update_mileage(&bt, bus_no, km)) &&
+             bt_get(&bt, bus_no, &b);
+        if (ok) {
+            if (strcmp(op, "mileage") == 0) {
+                printf(COLOR_GREEN "Mileage updated.\n" COLOR_RESET);
+            }
+            display_one_bus(&b);
+        }
+    }
+    bt_close(&bt);
+    if (!ok) printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+    return ok ? 0 : 1;
+}
+
+typedef struct {
+    const char *code;
+    int         found;
+} CodeProbe;
+
+static int btree_code_probe(Bus *b, void *ctx) {
+    CodeProbe *p = ctx;
+    p->found = str_ieq(b->bus_code, p->code);
+    return !p->found;
+}
+
+/* add_bus's prompts, then the uniqueness checks against the tree (the
+   code check is a scan). Returns 1 if added. */
+static int btree_add_prompted(BTree *bt) {
+    Bus one;
+    CodeProbe probe = {one.bus_code, 0};
+
+    read_new_bus(NULL, 0, &one);
+    if (bt_get(bt, one.bus_no, NULL)) {
+        printf(COLOR_RED "This bus number already exists.\n" COLOR_RESET);
+        return 0;
+    }
+    bt_scan(bt, btree_code_probe, &probe);
+    if (probe.found) {
+        printf(COLOR_RED "This bus code already exists (case-insensitive).\n"
+               COLOR_RESET);
+        return 0;
+    }
+    if (!bt_put(bt, &one)) return 0;
+    printf(COLOR_GREEN "Bus added. Total buses: %llu\n" COLOR_RESET,
+           (unsigned long long)bt->meta.records);
+    return 1;
+}
+
+static int cmd_btree_add(const char *tree_file) {
+    BTree bt;
+
+    if (!btree_open_or_report(&bt, tree_file, BT_MIN_CACHE)) return 1;
+    int rc = btree_add_prompted(&bt) ? 0 : 1;
+    bt_close(&bt);
+    return rc;
+}
+
+typedef struct {
+    TextBuf     out;
+    long        rows;
+    const Date *today;        /* refresh each row's status first if set */
+} ScanPrinter;
+
+static int btree_print_row(Bus *b, void *ctx) {
+    ScanPrinter *p = ctx;
+    Bus row;
+    if (p->today) {
+        row = *b;             /* b points into a cached page: leave it be */
+        update_maintenance_status(&row, *p->today);
+        b = &row;
+    }
+    render_table_row(&p->out, b);
+    p->rows++;
+    if (p->out.len >= REPORT_FLUSH_BYTES) {
+        write_block(p->out.data, p->out.len);
+        p->out.len = 0;
+    }
+    return 1;
+}
+
+static void btree_print_all(BTree *bt, const Date *today) {
+    ScanPrinter p;
+
+    memset(&p, 0, sizeof p);
+    p.today = today;
+    tb_puts(&p.out, "Bus  | Code      | Driver        | Last Service | Next Due   | CurrKm     | KmLeft    | Health   | Status   \n");
+    tb_puts(&p.out, "-----+-----------+---------------+--------------+------------+------------+-----------+----------+---------\n");
+    bt_scan(bt, btree_print_row, &p);
+    if (p.out.len > 0) write_block(p.out.data, p.out.len);
+    printf("\nTotal buses: %ld\n", p.rows);
+    tb_free(&p.out);
+}
+
+static int cmd_btree_scan(const char *tree_file) {
+    BTree bt;
+
+    if (!btree_open_or_report(&bt, tree_file, BT_DEFAULT_CACHE)) return 1;
+    btree_print_all(&bt, NULL);
+    bt_close(&bt);
+    return 0;
+}
+
+/* --btree: the menu's search, add, mileage, delete and view commands
+   run straight on the tree file, so the fleet never has to fit in
+   memory; only the page cache does. Statuses are worked out for the
+   reference date as buses are shown and are not stored back. */
+static int run_btree_menu(const char *tree_file) {
+    BTree bt;
+    Bus b;
+
+    if (!btree_open_or_report(&bt, tree_file, BT_DEFAULT_CACHE)) return 1;
+    Date today = read_date("Enter reference date for maintenance check (dd/mm/yyyy): ");
+
+    int choice;
+    do {
+        printf(COLOR_BOLD "------------ B+tree Menu -------------\n" COLOR_RESET);
+        printf("Current reference date: ");
+        print_date(today);
+        printf("\n");
+        printf("Store: %s, %llu buses, %d-page cache\n", tree_file,
+               (unsigned long long)bt.meta.records, bt.nframes);
+        printf("---------------------------------------\n");
+        printf("1. Change reference date (dd/mm/yyyy)\n");
+        printf("2. Add new bus\n");
+        printf("3. Update mileage\n");
+        printf("4. Delete bus\n");
+        printf("5. Search by bus number\n");
+        printf("6. View all buses (bus number order)\n");
+        printf("7. Save & exit\n");
+        printf("---------------------------------------\n");
+
+        choice = read_int_strict("Enter choice: ", 1, 7);
+        switch (choice) {
+            case 1:
+                today = read_date("Enter new reference date (dd/mm/yyyy): ");
+                break;
+            case 2: btree_add_prompted(&bt); break;
+            case 3: {
+                int bus_no = read_int_strict("Enter bus number to update mileage: ",
+                                             1, 9999999);
+                if (!bt_get(&bt, bus_no, &b)) {
+                    printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+                    break;
+                }
+                printf("Current mileage for bus %d: %.1f km\n",
+                       b.bus_no, b.current_mileage);
+                float km = read_float_strict("Enter new current mileage (km): ",
+                                             0.0f, 100000000.0f);
+                if (bt_update_mileage(&bt, bus_no, km))
+                    printf(COLOR_GREEN "Mileage updated.\n" COLOR_RESET);
+                break;
+            }
+            case 4: {
+                int bus_no = read_int_strict("Enter bus number to delete: ",
+                                             1, 9999999);
+                if (!bt_delete(&bt, bus_no)) {
+                    printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+                    break;
+                }
+                printf(COLOR_YELLOW "Bus deleted. Remaining: %llu\n" COLOR_RESET,
+                       (unsigned long long)bt.meta.records);
+                break;
+            }
+            case 5: {
+                int bus_no = read_int_strict("Enter bus number to search: ",
+                                             1, 9999999);
+                if (!bt_get(&bt, bus_no, &b)) {
+                    printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
+                    break;
+                }
+                update_maintenance_status(&b, today);
+                display_one_bus(&b);
+                break;
+            }
+            case 6: btree_print_all(&bt, &today); break;
+            case 7: break;
+        }
+        if (bt.io_error) {
+            printf(COLOR_RED "I/O error on %s; stopping.\n" COLOR_RESET, tree_file);
+            break;
         }
-        strncpy(b->bus_code, tmp, sizeof b->bus_code - 1);
-        b->bus_code[sizeof b->bus_code - 1] = '\0';
-        break;
-    }
+    } while (choice != 7);
 
-    /* Unique bus_no */
-    while (1) {
-        int no = read_int_strict("Enter numeric bus number: ", 1, 9999999);
-        if (bus_no_exists(*fleet_ptr, *count, no, -1)) {
-            printf(COLOR_RED
-                   "This bus number already exists. Please enter a different number.\n"
-                   COLOR_RESET);
-            continue;
-        }
-        b->bus_no = no;
-        break;
+    int failed = bt_flush(&bt) != 0;
+    bt_close(&bt);
+    if (failed) {
+        printf(COLOR_RED "Could not write %s.\n" COLOR_RESET, tree_file);
+        return 1;
     }
+    printf(COLOR_CYAN "Goodbye. Data saved.\n" COLOR_RESET);
+    return 0;
+}
 
-    read_driver_name(b->driver_name, sizeof b->driver_name);
+static uint32_t bench_rand(uint32_t *state) {
+    uint32_t x = *state;           /* xorshift32 */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
 
-    b->last_service = read_date("Enter last service date (dd/mm/yyyy): ");
+/* Asks the OS to forget cached pages of the file, so "out-of-cache"
+   lookups really go to the device where the platform allows it. */
+static void drop_os_cache(const char *filename) {
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)filename;
+#endif
+}
 
-    b->last_service_mileage =
-        read_float_strict("Enter last service mileage (km): ",
-                          0.0f, 100.0f);
+static int count_row(Bus *b, void *ctx) {
+    (void)b;
+    (*(long *)ctx)++;
+    return 1;
+}
 
-    b->current_mileage =
-        read_float_strict("Enter current mileage (km): ",
-                          0.0f, 100.0f);
+static int cmd_btree_bench(int n, int small_cache) {
+    const char *file = "btree_bench.fgt";
+    BTree bt;
+    Bus b;
+    uint32_t seed = 12345;
+    double t0;
+    int *keys = malloc((size_t)n * sizeof(int));
+
+    if (!keys) return 1;
+    for (int i = 0; i < n; i++) keys[i] = i + 1;
+    for (int i = n - 1; i > 0; i--) {          /* shuffled insert order */
+        int j = (int)(bench_rand(&seed) % (uint32_t)(i + 1));
+        int t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+    }
 
-    b->service_interval_km =
-        read_float_strict("Enter service interval (km), e.g. 10000: ",
-                          1.0f, 100000.0f);
+    memset(&b, 0, sizeof b);
+    strcpy(b.driver_name, "Bench Driver");
+    b.service_interval_km = 10000.0f;
+    b.last_service.day = b.last_service.month = 1;
+    b.last_service.year = 2024;
 
-    b->service_interval_days =
-        read_int_strict("Enter service interval in days (0 if not used): ",
-                        0, 5000);
+    printf("B+tree benchmark: %d buses, leaf fan-out %d, inner fan-out %d\n",
+           n, BT_LEAF_MAX, BT_INNER_MAX);
 
-    b->avg_daily_km =
-        read_float_strict("Enter average daily km: ",
-                          0.0f, 100000.0f);
+    if (!bt_open(&bt, file, BT_DEFAULT_CACHE, 1)) {
+        free(keys);
+        return 1;
+    }
+    t0 = now_seconds();
+    for (int i = 0; i < n; i++) {
+        b.bus_no = keys[i];
+        snprintf(b.bus_code, sizeof b.bus_code, "BN-%d", keys[i]);
+        b.current_mileage = (float)(keys[i] % 20000);
+        bt_put(&bt, &b);
+    }
+    bt_close(&bt);
+    double t_insert = now_seconds() - t0;
+    printf("  insert (cache %4d pages)      : %8.0f ops/s\n",
+           BT_DEFAULT_CACHE, n / t_insert);
+
+    struct {
+        const char *label;
+        int cache;
+        int drop;
+    } runs[2];
+    runs[0].label = "in-cache lookup";
+    runs[0].cache = 0;              /* sized to the whole tree below */
+    runs[0].drop = 0;
+    runs[1].label = "out-of-cache lookup";
+    runs[1].cache = small_cache;
+    runs[1].drop = 1;
+
+    for (int r = 0; r < 2; r++) {
+        if (runs[r].drop) drop_os_cache(file);
+        if (!bt_open(&bt, file, runs[r].cache, 0)) break;
+        if (runs[r].cache == 0) {
+            uint32_t pages = bt.meta.page_count;
+            bt_close(&bt);
+            if (!bt_open(&bt, file, (int)pages + 1, 0)) break;
+            long warm = 0;
+            bt_scan(&bt, count_row, &warm);   /* load every leaf */
+            for (int i = 0; i < n; i++) bt_get(&bt, keys[i], NULL);
+        }
+        bt.hits = bt.misses = 0;
+        int lookups = (n < 200000) ? n : 200000;
+        t0 = now_seconds();
+        for (int i = 0; i < lookups; i++) {
+            bt_get(&bt, (int)(bench_rand(&seed) % (uint32_t)n) + 1, &b);
+        }
+        double t = now_seconds() - t0;
+        printf("  %-19s (cache %6d) : %8.0f ops/s  (hit rate %.1f%%)\n",
+               runs[r].label, bt.nframes, lookups / t,
+               100.0 * bt.hits / (double)(bt.hits + bt.misses));
+
+        t0 = now_seconds();
+        for (int i = 0; i < lookups; i++) {
+            int k = (int)(bench_rand(&seed) % (uint32_t)n) + 1;
+            bt_update_mileage(&bt, k, (float)i);
+        }
+        t = now_seconds() - t0;
+        printf("  %-19s (cache %6d) : %8.0f ops/s\n",
+               r == 0 ? "in-cache update" : "out-of-cache update",
+               bt.nframes, lookups / t);
+        bt_close(&bt);
+    }
 
-    b->fuel_efficiency =
-        read_float_strict("Enter fuel efficiency (km/l): ",
-                          0.0f, 200.0f);
+    if (bt_open(&bt, file, BT_DEFAULT_CACHE, 0)) {
+        long rows = 0;
+        t0 = now_seconds();
+        bt_scan(&bt, count_row, &rows);
+        double t = now_seconds() - t0;
+        printf("  ordered scan                   : %8.0f rows/s (%ld rows)\n",
+               rows / t, rows);
+        bt_close(&bt);
+    }
 
-    b->service_history_count =
-        read_int_strict("Enter service history count: ",
-                        0, 1500);
+    remove(file);
+    free(keys);
+    return 0;
+}
 
-    b->next_due.day = b->next_due.month = b->next_due.year = 0;
-    b->km_left = 0.0f;
-    b->status = STATUS_OK;
-    b->health_score = 100;
+static int cmd_snapshot(const char *in_file, const char *out_file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
 
-    (*count)++;
-    printf(COLOR_GREEN "Bus added. Total buses: %d\n" COLOR_RESET, *count);
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
+    }
+    int rc = write_snapshot(out_file, fleet, count);
+    free(fleet);
+    if (rc != 0) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, out_file);
+        return 1;
+    }
+    printf(COLOR_GREEN "Snapshot of %d buses written to %s\n" COLOR_RESET,
+           count, out_file);
+    return 0;
 }
 
-void update_mileage(Bus *fleet, int count) {
-    int bus_no = read_int_strict("Enter bus number to update mileage: ",
-                                 1, 9999999);
+/* Loads a data file, refreshes statuses for `today` and runs an exporter. */
+static int cmd_export(const char *in_file, const char *out_file, Date today,
+                      int (*export_fn)(Bus *, int, const char *)) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
 
-    int idx = find_bus_index(fleet, count, bus_no);
-    if (idx == -1) {
-        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
-        return;
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        update_maintenance_status(&fleet[i], today);
     }
+    int rc = export_fn(fleet, count, out_file);
+    free(fleet);
+    return rc == 0 ? 0 : 1;
+}
 
-    Bus *b = &fleet[idx];
-    printf("Current mileage for bus %d: %.1f km\n",
-           b->bus_no, b->current_mileage);
-    b->current_mileage =
-        read_float_strict("Enter new current mileage (km): ",
-                          0.0f, 100000000.0f);
-    printf(COLOR_GREEN "Mileage updated.\n" COLOR_RESET);
+static int cmd_convert(const char *in_file, const char *out_file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+    FleetFormat fmt = detect_fleet_format(in_file);
+
+    LoadResult lr = load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted);
+    if (lr != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s (%s).\n" COLOR_RESET,
+               in_file, fleet_format_name(fmt));
+        free(fleet);
+        return 1;
+    }
+    int rc = save_fleet_atomic(fleet, count, out_file);
+    free(fleet);
+    if (rc != 0) {
+        printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, out_file);
+        return 1;
+    }
+    printf(COLOR_GREEN "Converted %d buses from %s (%s) to %s\n" COLOR_RESET,
+           count, in_file, fleet_format_name(fmt), out_file);
+    if (corrupted > 0) {
+        printf(COLOR_YELLOW "Warning: %d damaged record(s) or block(s) skipped.\n"
+               COLOR_RESET, corrupted);
+    }
+    return 0;
 }
 
-void delete_bus(Bus *fleet, int *count) {
-    int bus_no = read_int_strict("Enter bus number to delete: ",
-                                 1, 9999999);
+/* Midnight (local time) at the start of d plus `extra` days. */
+static time_t local_day_start(Date d, int extra) {
+    struct tm tm;
+    memset(&tm, 0, sizeof tm);
+    tm.tm_mday = d.day + extra;
+    tm.tm_mon = d.month - 1;
+    tm.tm_year = d.year - 1900;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
 
-    int idx = find_bus_index(fleet, *count, bus_no);
-    if (idx == -1) {
-        printf(COLOR_RED "Bus not found.\n" COLOR_RESET);
-        return;
+static int cmd_audit(int argc, char **argv) {
+    int bus_no = 0, field = -1;
+    time_t from = 0, to = 0;
+    Date d;
+
+    if (strcmp(argv[2], "all") != 0 &&
+        (!parse_int_field(argv[2], &bus_no) || bus_no <= 0)) {
+        printf(COLOR_RED "Invalid bus number '%s'.\n" COLOR_RESET, argv[2]);
+        return 1;
+    }
+    if (argc > 3 && strcmp(argv[3], "all") != 0) {
+        for (int f = 0; f < AUDIT_NFIELDS; f++) {
+            if (strcmp(argv[3], audit_fields[f].name) == 0) field = f;
+        }
+        if (field < 0) {
+            printf(COLOR_RED "Unknown field '%s'. Fields:" COLOR_RESET, argv[3]);
+            for (int f = 0; f < AUDIT_NFIELDS; f++) printf(" %s", audit_fields[f].name);
+            printf("\n");
+            return 1;
+        }
+    }
+    if (bus_no == 0 && field < 0) {
+        printf(COLOR_RED "Name a bus, a field, or both.\n" COLOR_RESET);
+        return 1;
+    }
+    if (argc > 4) {
+        if (!parse_date_arg(argv[4], &d)) {
+            printf(COLOR_RED "Invalid date '%s' (use dd/mm/yyyy).\n" COLOR_RESET, argv[4]);
+            return 1;
+        }
+        from = local_day_start(d, 0);
     }
+    if (argc > 5) {
+        if (!parse_date_arg(argv[5], &d)) {
+            printf(COLOR_RED "Invalid date '%s' (use dd/mm/yyyy).\n" COLOR_RESET, argv[5]);
+            return 1;
+        }
+        to = local_day_start(d, 1);
+    }
+    audit_open(AUDIT_LOG, AUDIT_INDEX);
+    return audit_query(AUDIT_LOG, bus_no, field, from, to) == 0 ? 0 : 1;
+}
 
-    for (int i = idx; i < *count - 1; i++) {
-        fleet[i] = fleet[i + 1];
+static int cmd_bulk_edit(const char *expr, const char *file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted, matched;
+    BulkEdit be;
+
+    if (!parse_bulk_edit(expr, &be)) return 1;
+    if (load_fleet_quiet(&fleet, &count, &capacity, file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, file);
+        free(fleet);
+        return 1;
     }
-    (*count)--;
-    printf(COLOR_YELLOW "Bus deleted. Remaining: %d\n" COLOR_RESET, *count);
+    change_tracker_init(fleet, count, CHANGE_LOG);
+    audit_open(AUDIT_LOG, AUDIT_INDEX);
+
+    int changed = apply_bulk_edit(fleet, count, &be, today_from_clock(), &matched);
+    int rc = 0;
+    if (changed < 0) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+        rc = 1;
+    } else if (changed > 0) {
+        if (save_fleet_atomic(fleet, count, file) != 0) {
+            printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, file);
+            rc = 1;
+        } else if (change_log_flush(CHANGE_LOG) != 0 ||
+                   audit_flush(AUDIT_LOG, AUDIT_INDEX) != 0) {
+            printf(COLOR_RED "Saved, but could not append to %s / %s.\n" COLOR_RESET,
+                   CHANGE_LOG, AUDIT_LOG);
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        printf(COLOR_GREEN "%d bus(es) matched, %d updated in %s.\n" COLOR_RESET,
+               matched, changed, file);
+    }
+    free(fleet);
+    return rc;
 }
 
-/* ---------- Quick summary after entering reference date ---------- */
+static int cmd_bulk_delete(const char *spec, const char *file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+    BulkDelete bd;
 
-void summarize_maintenance(Bus *fleet, int count, Date today) {
-    if (count == 0) {
-        printf(COLOR_YELLOW
-               "No buses in fleet yet. Add bus data to check maintenance.\n"
-               COLOR_RESET);
-        return;
+    if (!parse_bulk_delete(spec, &bd)) {
+        bulk_delete_free(&bd);
+        return 1;
+    }
+    if (load_fleet_quiet(&fleet, &count, &capacity, file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, file);
+        bulk_delete_free(&bd);
+        free(fleet);
+        return 1;
     }
+    change_tracker_init(fleet, count, CHANGE_LOG);
+
+    double t0 = now_seconds();
+    uint64_t *marked = malloc((BITMAP_WORDS(count) + 1) * sizeof *marked);
+    int n = marked ? bulk_delete_mark(fleet, count, &bd, marked) : -1;
+    if (n > 0) fleet_remove_marked(fleet, &count, marked, NULL);
+    double elapsed = now_seconds() - t0;
+    free(marked);
+    bulk_delete_free(&bd);
+
+    int rc = 0;
+    if (n < 0) {
+        printf(COLOR_RED "Memory error.\n" COLOR_RESET);
+        rc = 1;
+    } else if (n > 0) {
+        if (save_fleet_atomic(fleet, count, file) != 0) {
+            printf(COLOR_RED "Error writing %s.\n" COLOR_RESET, file);
+            rc = 1;
+        } else if (change_log_flush(CHANGE_LOG) != 0) {
+            printf(COLOR_RED "Saved, but could not append to %s.\n" COLOR_RESET,
+                   CHANGE_LOG);
+            rc = 1;
+        }
+    }
+    if (rc == 0) {
+        printf(COLOR_GREEN "%d bus(es) deleted in %.1f ms, %d left in %s.\n"
+               COLOR_RESET, n, elapsed * 1000.0, count, file);
+    }
+    free(fleet);
+    return rc;
+}
 
-    int overdue = 0;
-    int due_soon = 0;
+static int cmd_due_calendar(const char *in_file, const char *out_file, Date today) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
+    }
+    int rc = export_due_calendar(fleet, count, today, out_file);
+    free(fleet);
+    return rc == 0 ? 0 : 1;
+}
 
+static int cmd_aging(const char *in_file, Date today) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
+    }
+    aging_reset();
     for (int i = 0; i < count; i++) {
         update_maintenance_status(&fleet[i], today);
-        if (fleet[i].status == STATUS_OVERDUE) {
-            overdue++;
-        } else if (fleet[i].status == STATUS_DUE_SOON) {
-            due_soon++;
-        }
+        aging_add(&fleet[i], today);
     }
+    show_overdue_aging();
+    free(fleet);
+    return 0;
+}
 
-    if (overdue == 0 && due_soon == 0) {
-        printf(COLOR_GREEN
-               "No maintenance due right now, or upcoming in the next few days.\n"
-               COLOR_RESET);
-        return;
-    }
+static int cmd_availability(const char *from_arg, const char *to_arg,
+                            const char *in_file, const char *out_file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
+    Date from, to;
 
-    if (overdue > 0) {
-        printf(COLOR_RED
-               "\nThese buses NEED maintenance on or before the chosen date:\n"
-               COLOR_RESET);
-        for (int i = 0; i < count; i++) {
-            if (fleet[i].status == STATUS_OVERDUE) {
-                printf("  - Bus %d [%s] (driver: %s)\n",
-                       fleet[i].bus_no,
-                       fleet[i].bus_code,
-                       fleet[i].driver_name);
-            }
-        }
+    if (!parse_date_arg(from_arg, &from) || !parse_date_arg(to_arg, &to)) {
+        printf(COLOR_RED "Dates must be dd/mm/yyyy.\n" COLOR_RESET);
+        return 1;
     }
-
-    if (due_soon > 0) {
-        printf(COLOR_YELLOW
-               "\nThese buses will need maintenance SOON (within %d km):\n"
-               COLOR_RESET, DUE_SOON_KM);
-        for (int i = 0; i < count; i++) {
-            if (fleet[i].status == STATUS_DUE_SOON) {
-                printf("  - Bus %d [%s] (driver: %s), km left: %.1f\n",
-                       fleet[i].bus_no,
-                       fleet[i].bus_code,
-                       fleet[i].driver_name,
-                       fleet[i].km_left);
-            }
-        }
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
     }
-
-    printf("\n");
+    int rc = availability_report(fleet, count, from, to, DOWNTIME_FILE, out_file);
+    free(fleet);
+    return rc == 0 ? 0 : 1;
 }
 
-/* ---------- CSV export ---------- */
+static int cmd_cost_projection(const char *in_file, const char *out_file, Date today) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0, corrupted;
 
-void export_report(Bus *fleet, int count, const char *filename) {
-    FILE *fp = fopen(filename, "w");
-    if (!fp) {
-        printf(COLOR_RED "Could not open report file.\n" COLOR_RESET);
-        return;
+    if (load_fleet_quiet(&fleet, &count, &capacity, in_file, &corrupted) != LOAD_OK) {
+        printf(COLOR_RED "Could not load %s.\n" COLOR_RESET, in_file);
+        free(fleet);
+        return 1;
     }
+    int rc = export_cost_projection(fleet, count, today, out_file);
+    free(fleet);
+    return rc == 0 ? 0 : 1;
+}
 
-    fprintf(fp,
-            "BusNo,BusCode,DriverName,LastServiceDate,NextDueDate,"
-            "CurrentKm,KmLeft,HealthScore,Status,ServiceHistoryCount\n");
+static int cmd_restore_snapshot(const char *snap_file, const char *out_file) {
+    Bus *fleet = NULL;
+    int count = 0, capacity = 0;
+    long long bad;
 
-    for (int i = 0; i < count; i++) {
-        Bus *b = &fleet[i];
-        char last_buf[16];
-        char next_buf[16];
-
-        snprintf(last_buf, sizeof last_buf, "%02d-%02d-%04d",
-                 b->last_service.day, b->last_service.month, b->last_service.year);
-        if (b->next_due.year > 0)
-            snprintf(next_buf, sizeof next_buf, "%02d-%02d-%04d",
-                     b->next_due.day, b->next_due.month, b->next_due.year);
-        else
-            next_buf[0] = '\0';
-
-        fprintf(fp,
-                "%d,\"%s\",\"%s\",\"%s\",\"%s\",%.1f,%.1f,%d,\"%s\",%d\n",
-                b->bus_no,
-                b->bus_code,
-                b->driver_name,
-                last_buf,
-                next_buf,
-                b->current_mileage,
-                b->km_left,
-                b->health_score,
-                status_label(b->status),
-                b->service_history_count);
+    if (load_fleet_snapshot(&fleet, &count, &capacity, snap_file, &bad) != LOAD_OK) {
+        printf(COLOR_RED "Could not load snapshot %s.\n" COLOR_RESET, snap_file);
+        free(fleet);
+        return 1;
+    }
+    if (bad > 0) {
+        printf(COLOR_YELLOW
+               "Warning: %lld damaged block(s) skipped and copied to %s.quarantine\n"
+               COLOR_RESET, bad, snap_file);
     }
+    int rc = save_fleet_to_file(fleet, count, out_file);
+    free(fleet);
+    return rc == 0 ? 0 : 1;
+}
 
-    fclose(fp);
-    printf(COLOR_GREEN "CSV report exported to %s\n" COLOR_RESET, filename);
+int run_command_line(int argc, char **argv) {
+    Bus *fleet = NULL;
+    int count = 0;
+    int capacity = 0;
+    Date today;
+    int rc = 0;
+
+    if (strcmp(argv[1], "--dashboard") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        int corrupted;
+        load_fleet_quiet(&fleet, &count, &capacity, DATA_FILE, &corrupted);
+        run_dashboard(&fleet, &count, &capacity, today, DATA_FILE);
+    } else if (strcmp(argv[1], "--report") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = stream_report(argc > 3 ? argv[3] : DATA_FILE,
+                           argc > 4 ? argv[4] : REPORT_FILE, today);
+    } else if (strcmp(argv[1], "--build-index") == 0) {
+        rc = cmd_build_index(argc > 2 ? argv[2] : DATA_FILE,
+                             argc > 3 ? argv[3] : INDEX_FILE);
+    } else if (strcmp(argv[1], "--lookup") == 0 && argc > 2) {
+        rc = cmd_indexed_bus(argc > 3 ? argv[3] : INDEX_FILE, argv[2], -1.0f);
+    } else if (strcmp(argv[1], "--set-mileage") == 0 && argc > 3) {
+        float km;
+        if (!parse_float_field(argv[3], &km) || km < 0.0f) {
+            printf(COLOR_RED "Invalid mileage '%s'.\n" COLOR_RESET, argv[3]);
+            return 1;
+        }
+        rc = cmd_indexed_bus(argc > 4 ? argv[4] : INDEX_FILE, argv[2], km);
+    } else if (strcmp(argv[1], "--btree-import") == 0) {
+        rc = cmd_btree_import(argc > 2 ? argv[2] : DATA_FILE,
+                              argc > 3 ? argv[3] : BTREE_FILE);
+    } else if (strcmp(argv[1], "--btree-get") == 0 && argc > 2) {
+        rc = cmd_btree_bus(argc > 3 ? argv[3] : BTREE_FILE, argv[2], "get", 0.0f);
+    } else if (strcmp(argv[1], "--btree-delete") == 0 && argc > 2) {
+        rc = cmd_btree_bus(argc > 3 ? argv[3] : BTREE_FILE, argv[2], "delete", 0.0f);
+    } else if (strcmp(argv[1], "--btree-mileage") == 0 && argc > 3) {
+        float km;
+        if (!parse_float_field(argv[3], &km) || km < 0.0f) {
+            printf(COLOR_RED "Invalid mileage '%s'.\n" COLOR_RESET, argv[3]);
+            return 1;
+        }
+        rc = cmd_btree_bus(argc > 4 ? argv[4] : BTREE_FILE, argv[2], "mileage", km);
+    } else if (strcmp(argv[1], "--btree") == 0) {
+        print_banner();
+        rc = run_btree_menu(argc > 2 ? argv[2] : BTREE_FILE);
+    } else if (strcmp(argv[1], "--btree-add") == 0) {
+        rc = cmd_btree_add(argc > 2 ? argv[2] : BTREE_FILE);
+    } else if (strcmp(argv[1], "--btree-scan") == 0) {
+        rc = cmd_btree_scan(argc > 2 ? argv[2] : BTREE_FILE);
+    } else if (strcmp(argv[1], "--btree-bench") == 0 && argc > 2) {
+        int n, cache = BT_MIN_CACHE;
+        if (!parse_int_field(argv[2], &n) || n <= 0 ||
+            (argc > 3 && !parse_int_field(argv[3], &cache))) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        rc = cmd_btree_bench(n, cache);
+    } else if (strcmp(argv[1], "--snapshot") == 0) {
+        rc = cmd_snapshot(argc > 2 ? argv[2] : DATA_FILE,
+                          argc > 3 ? argv[3] : SNAPSHOT_FILE);
+    } else if (strcmp(argv[1], "--restore-snapshot") == 0) {
+        rc = cmd_restore_snapshot(argc > 2 ? argv[2] : SNAPSHOT_FILE,
+                                  argc > 3 ? argv[3] : DATA_FILE);
+    } else if (strcmp(argv[1], "--fsck") == 0) {
+        rc = fsck_snapshot(argc > 2 ? argv[2] : SNAPSHOT_FILE);
+    } else if (strcmp(argv[1], "--export-arrow") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = cmd_export(argc > 3 ? argv[3] : DATA_FILE,
+                        argc > 4 ? argv[4] : ARROW_FILE, today, export_arrow);
+    } else if (strcmp(argv[1], "--migrate-nimbus") == 0) {
+        rc = migrate_nimbus(argc > 2 ? argv[2] : NIMBUS_FILE,
+                            argc > 3 ? argv[3] : DATA_FILE, today_from_clock());
+    } else if (strcmp(argv[1], "--convert") == 0 && argc > 3) {
+        rc = cmd_convert(argv[2], argv[3]);
+    } else if (strcmp(argv[1], "--since") == 0 && argc > 2) {
+        int since;
+        if (!parse_int_field(argv[2], &since) || since < 0) {
+            printf(COLOR_RED "Invalid change sequence '%s'.\n" COLOR_RESET, argv[2]);
+            return 1;
+        }
+        rc = export_changes_since(since, argc > 3 ? argv[3] : DATA_FILE, CHANGE_LOG,
+                                  argc > 4 ? argv[4] : DELTA_FILE);
+    } else if (strcmp(argv[1], "--bulk-edit") == 0 && argc > 2) {
+        rc = cmd_bulk_edit(argv[2], argc > 3 ? argv[3] : DATA_FILE);
+    } else if (strcmp(argv[1], "--bulk-delete") == 0 && argc > 2) {
+        rc = cmd_bulk_delete(argv[2], argc > 3 ? argv[3] : DATA_FILE);
+    } else if (strcmp(argv[1], "--due-calendar") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = cmd_due_calendar(argc > 3 ? argv[3] : DATA_FILE,
+                              argc > 4 ? argv[4] : DUE_CALENDAR_FILE, today);
+    } else if (strcmp(argv[1], "--aging") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = cmd_aging(argc > 3 ? argv[3] : DATA_FILE, today);
+    } else if (strcmp(argv[1], "--availability") == 0 && argc > 3) {
+        rc = cmd_availability(argv[2], argv[3], argc > 4 ? argv[4] : DATA_FILE,
+                              argc > 5 ? argv[5] : AVAILABILITY_FILE);
+    } else if (strcmp(argv[1], "--cost-projection") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = cmd_cost_projection(argc > 3 ? argv[3] : DATA_FILE,
+                                 argc > 4 ? argv[4] : COST_FILE, today);
+    } else if (strcmp(argv[1], "--audit") == 0 && argc > 2) {
+        rc = cmd_audit(argc, argv);
+    } else if (strcmp(argv[1], "--export-json") == 0) {
+        if (!date_arg_or_today(argc, argv, 2, &today)) return 1;
+        rc = cmd_export(argc > 3 ? argv[3] : DATA_FILE,
+                        argc > 4 ? argv[4] : JSON_FILE, today, export_json);
+    } else {
+        print_usage(argv[0]);
+        rc = (strcmp(argv[1], "--help") == 0) ? 0 : 1;
+    }
+
+    free(fleet);
+    return rc;
 }
 
 /* ---------- Main menu ---------- */
 
-int main(void) {
+int main(int argc, char **argv) {
     Bus *fleet = NULL;
     int count = 0;
     int capacity = 0;
     Date today;
+    int autosave_secs = AUTOSAVE_SECS;
+    int shards = 0;
+    int shared = 0;
+    int primary = 0, standby = 0;
+    AutoSaver autosave;
+    Shipper shipper = {0};
+
+    workshop_load(WORKSHOP_FILE);
+
+    /* Interactive options first; anything else is a command-line mode. */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--autosave") == 0 && i + 1 < argc &&
+            parse_int_field(argv[i + 1], &autosave_secs) && autosave_secs >= 0) {
+            i++;
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc &&
+                   parse_int_field(argv[i + 1], &shards) &&
+                   shards >= 1 && shards <= MAX_SHARDS) {
+            i++;
+        } else if (strcmp(argv[i], "--shared") == 0) {
+            shared = 1;
+        } else if (strcmp(argv[i], "--primary") == 0) {
+            primary = 1;
+        } else if (strcmp(argv[i], "--standby") == 0) {
+            standby = 1;
+        } else {
+            return run_command_line(argc, argv);
+        }
+    }
 
     print_banner();
+    if (workshop.loaded) {
+        printf(COLOR_CYAN "Workshop calendar %s loaded: service intervals count "
+               "working days.\n" COLOR_RESET, WORKSHOP_FILE);
+    }
+
+    if (shared && (primary || standby)) {
+        printf(COLOR_RED "--shared cannot be combined with --primary or --standby.\n"
+               COLOR_RESET);
+        return 1;
+    }
 
-    load_fleet_from_file(&fleet, &count, &capacity, DATA_FILE);
+    /* A standby runs the menu only once it has taken over. */
+    int joined = 0;
+    if (standby) {
+        if (!standby_follow(&fleet, &count, &capacity, &today)) return 1;
+        primary = 1;
+    } else {
+        joined = shared && shared_open(&fleet, &count, &capacity);
+        if (!joined) {
+            if (shards == 0 || !load_fleet_from_shards(&fleet, &count, &capacity)) {
+                load_fleet_from_file(&fleet, &count, &capacity, DATA_FILE);
+            }
+            offer_autosave_recovery(&fleet, &count, &capacity, AUTOSAVE_FILE);
+        }
+        change_tracker_init(fleet, count, CHANGE_LOG);
+    }
+    audit_open(AUDIT_LOG, AUDIT_INDEX);
+    if (shared && !joined) shared_create(&fleet, &count, &capacity);
 
-    today = read_date("Enter reference date for maintenance check (dd/mm/yyyy): ");
+    if (standby) {
+        printf("Reference date from the primary: ");
+        print_date(today);
+        printf("\n");
+    } else if (shared_fleet && shared_date(&today)) {
+        printf("Shared reference date: ");
+        print_date(today);
+        printf("\n");
+    } else {
+        today = read_date("Enter reference date for maintenance check (dd/mm/yyyy): ");
+        if (shared_fleet) {
+            shared_write_begin(&count);
+            shared_write_end(fleet, count, today);
+        }
+    }
 
     summarize_maintenance(fleet, count, today);
 
+    /* The segment outlives a terminal that dies, so it needs no recovery file. */
+    autosave_start(&autosave, &fleet, &count, AUTOSAVE_FILE,
+                   shared_fleet ? 0 : autosave_secs);
+    if (primary) standby_start(&shipper, &autosave.lock, &fleet, &count, &today);
+
+    MenuLock menu_lock = {&autosave, &today};
+    fleet_lock.write_begin = menu_write_begin;
+    fleet_lock.write_end = menu_write_end;
+    if (shared_fleet) {
+        fleet_lock.read_begin = menu_read_begin;
+        fleet_lock.read_changed = menu_read_changed;
+    }
+    fleet_lock.ctx = &menu_lock;
+
     int choice;
+    int saved = 0;
     do {
-        for (int i = 0; i < count; i++) {
-            update_maintenance_status(&fleet[i], today);
+        if (shared_fleet) {
+            uint64_t seen;
+            do {
+                seen = shared_read_begin(&count);
+                shared_date(&today);
+                aging_reset();
+                for (int i = 0; i < count; i++) aging_add(&fleet[i], today);
+            } while (shared_read_changed(seen));
+        } else {
+            autosave_lock(&autosave);
+            aging_reset();
+            for (int i = 0; i < count; i++) {
+                refresh_bus_status(&fleet[i], today);
+                aging_add(&fleet[i], today);
+            }
+            autosave_unlock(&autosave);
         }
 
         printf(COLOR_BOLD "-------------- Main Menu --------------\n" COLOR_RESET);
         printf("Current reference date: ");
         print_date(today);
         printf("\n");
+        print_autosave_status(&autosave);
+        print_standby_status(&shipper);
+        if (shared_fleet) print_shared_status();
         printf("---------------------------------------\n");
         printf("1. Change reference date (dd/mm/yyyy)\n");
         printf("2. Add new bus\n");
@@ -946,18 +9839,41 @@ int main(void) {
         printf("8. Show buses due soon / overdue\n");
         printf("9. Export maintenance report (CSV)\n");
         printf("10. Save & exit\n");
+        printf("11. Live dashboard (q + Enter to leave)\n");
+        printf("12. Export analytics file (Arrow/Feather)\n");
+        printf("13. Export JSON Lines (%s)\n", JSON_FILE);
+        printf("14. Undo last change (%d available)\n", undo_available());
+        printf("15. Redo (%d available)\n", redo_available());
+        printf("16. Bulk edit (set ... where ...)\n");
+        printf("17. Bulk delete (bus list, @file or where ...)\n");
+        printf("18. Due calendar, next %d days (%s)\n", DUE_CALENDAR_DAYS,
+               DUE_CALENDAR_FILE);
+        printf("19. Overdue aging by depot\n");
+        printf("20. Record workshop downtime\n");
+        printf("21. Availability report (%s)\n", AVAILABILITY_FILE);
+        printf("22. Cost projection, next %d months (%s)\n", COST_MONTHS, COST_FILE);
         printf("---------------------------------------\n");
 
-        choice = read_int_strict("Enter choice: ", 1, 10);
+        choice = read_int_strict("Enter choice: ", 1, 22);
 
+        int reading = shared_fleet && shared_command_reads(choice);
+        uint64_t seen = 0;
+        if (reading) {
+            seen = shared_read_begin(&count);
+            shared_date(&today);
+        }
         switch (choice) {
-            case 1:
-                today = read_date("Enter new reference date (dd/mm/yyyy): ");
+            case 1: {
+                Date d = read_date("Enter new reference date (dd/mm/yyyy): ");
+                fleet_write_begin(&count);
+                today = d;
+                fleet_write_end(fleet, count);
                 printf(COLOR_GREEN "Reference date updated to: " COLOR_RESET);
                 print_date(today);
                 printf("\n");
                 summarize_maintenance(fleet, count, today);
                 break;
+            }
             case 2: add_bus(&fleet, &count, &capacity); break;
             case 3: edit_bus_by_position(fleet, count); break;
             case 4: update_mileage(fleet, count); break;
@@ -967,12 +9883,55 @@ int main(void) {
             case 8: show_due_soon_or_overdue(fleet, count); break;
             case 9: export_report(fleet, count, REPORT_FILE); break;
             case 10:
-                save_fleet_to_file(fleet, count, DATA_FILE);
+                fleet_write_begin(&count);
+                standby_collect(&shipper);      /* before the flush below */
+                if (shards > 0) {
+                    saved = (save_fleet_to_shards(fleet, count, shards) == 0);
+                } else {
+                    saved = (save_fleet_to_file(fleet, count, DATA_FILE) == 0);
+                }
+                if (saved && change_log_flush(CHANGE_LOG) != 0) {
+                    printf(COLOR_RED "Could not append to %s.\n" COLOR_RESET,
+                           CHANGE_LOG);
+                }
+                if (saved && audit_flush(AUDIT_LOG, AUDIT_INDEX) != 0) {
+                    printf(COLOR_RED "Could not append to %s.\n" COLOR_RESET,
+                           AUDIT_LOG);
+                }
+                fleet_write_end(fleet, count);
                 printf(COLOR_CYAN "Goodbye. Data saved.\n" COLOR_RESET);
                 break;
+            case 11:
+                run_dashboard(&fleet, &count, &capacity, today, NULL);
+                break;
+            case 12: export_arrow(fleet, count, ARROW_FILE); break;
+            case 13: export_json(fleet, count, JSON_FILE); break;
+            case 14:
+            case 15:
+                fleet_write_begin(&count);
+                undo_step(&fleet, &count, &capacity, choice == 15);
+                fleet_write_end(fleet, count);
+                break;
+            case 16: bulk_edit_menu(fleet, count, today); break;
+            case 17: bulk_delete_menu(fleet, &count); break;
+            case 18:
+                export_due_calendar(fleet, count, today, DUE_CALENDAR_FILE);
+                break;
+            case 19: show_overdue_aging(); break;
+            case 20: record_downtime_menu(fleet, count); break;
+            case 21: availability_menu(fleet, count); break;
+            case 22: export_cost_projection(fleet, count, today, COST_FILE); break;
+        }
+        if (reading && shared_read_changed(seen)) {
+            printf(COLOR_YELLOW "Another terminal changed the fleet meanwhile; "
+                   "repeat the command for a consistent view.\n" COLOR_RESET);
         }
     } while (choice != 10);
 
+    standby_stop(&shipper, saved);
+    /* Keep the recovery file if the final save failed. */
+    autosave_stop(&autosave, saved);
+    if (shared_fleet) shared_close(&fleet);
     free(fleet);
     return 0;
 }